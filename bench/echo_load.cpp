@@ -0,0 +1,515 @@
+// 回环echo负载生成器
+// 多个线程各自驱动一部分连接，每个连接保持pipeline条消息在途：收到一条完整的回显就补发一条，
+// 统计预热之后的吞吐与每条消息从发出到收齐回显的延迟。默认在进程内启动echo服务器，
+// 也可以用server=0压测另一个进程中的服务器（例如EchoIOCP）。
+//
+// 用法: echo_load_bench [key=value ...]
+//   connections=64    连接数
+//   threads=4         客户端线程数
+//   size=64           消息长度，写成min-max时每条消息在其间均匀随机
+//   pipeline=1        每个连接同时在途的消息数
+//   duration=10       压测时长（秒），包含预热
+//   warmup=1          预热时长（秒），期间的消息不计入结果
+//   host=127.0.0.1 port=8899
+//   server=1          1为在进程内启动echo服务器，0为连接已有的服务器
+//   workers=0 sharded=0 batch=64   进程内服务器的工作线程数、分片模式与批量大小
+//   latency=0         1为开启进程内服务器的延迟统计，结束时输出各阶段耗时
+//   coro=0            1为进程内服务器改用协程处理连接（需以IOCP_ENABLE_COROUTINES=ON构建）
+//   spin=0            进程内服务器每次收到数据后额外占用的CPU时间（微秒），模拟耗时的处理
+//   compute=0         进程内服务器的计算线程数，非0时回显（连同spin）交给计算线程池执行
+// 服务器后端同样可由IOCP_BACKEND=epoll选择；比较结果时应以-DCMAKE_BUILD_TYPE=Release构建
+
+#include "Coroutine.h"
+#include "IOCPServer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+  #include <fcntl.h>
+  #include <poll.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+#ifdef _WIN32
+constexpr int kSendFlags = 0;
+#else
+constexpr int kSendFlags = MSG_NOSIGNAL; // 服务器断开时不因SIGPIPE退出
+#endif
+
+struct Options {
+  size_t connections  = 64;
+  size_t threads      = 4;
+  size_t minSize      = 64;
+  size_t maxSize      = 64;
+  size_t pipeline     = 1;
+  double duration     = 10;
+  double warmup       = 1;
+  std::string host    = "127.0.0.1";
+  unsigned short port = 8899;
+  bool server         = true;
+  size_t workers      = 0;
+  bool sharded        = false;
+  size_t batch        = 64;
+  bool latency        = false;
+  bool coro           = false;
+  double spinUs       = 0;
+  size_t compute      = 0;
+};
+
+bool parseOptions(int argc, char* argv[], Options& opts) {
+  std::map<std::string, std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    const char* eq = std::strchr(argv[i], '=');
+    if (eq == nullptr) {
+      std::fprintf(stderr, "bad argument '%s', expected key=value\n", argv[i]);
+      return false;
+    }
+    args[std::string(argv[i], static_cast<size_t>(eq - argv[i]))] = eq + 1;
+  }
+
+  auto number = [&](const char* key, double def) {
+    auto it = args.find(key);
+    return it == args.end() ? def : std::atof(it->second.c_str());
+  };
+  opts.connections = static_cast<size_t>(number("connections", 64));
+  opts.threads     = std::max<size_t>(static_cast<size_t>(number("threads", 4)), 1);
+  opts.pipeline    = std::max<size_t>(static_cast<size_t>(number("pipeline", 1)), 1);
+  opts.duration    = number("duration", 10);
+  opts.warmup      = std::min(number("warmup", 1), opts.duration);
+  opts.port        = static_cast<unsigned short>(number("port", 8899));
+  opts.server      = number("server", 1) != 0;
+  opts.workers     = static_cast<size_t>(number("workers", 0));
+  opts.sharded     = number("sharded", 0) != 0;
+  opts.batch       = static_cast<size_t>(number("batch", 64));
+  opts.latency     = number("latency", 0) != 0;
+  opts.coro        = number("coro", 0) != 0;
+  opts.spinUs      = number("spin", 0);
+  opts.compute     = static_cast<size_t>(number("compute", 0));
+  if (args.count("host")) {
+    opts.host = args["host"];
+  }
+  if (args.count("size")) {
+    const std::string& size = args["size"];
+    size_t dash             = size.find('-');
+    opts.minSize            = std::strtoul(size.c_str(), nullptr, 10);
+    opts.maxSize = dash == std::string::npos ? opts.minSize : std::strtoul(size.c_str() + dash + 1, nullptr, 10);
+  }
+  if (opts.minSize == 0 || opts.maxSize < opts.minSize) {
+    std::fprintf(stderr, "bad size, expected N or MIN-MAX with 0 < MIN <= MAX\n");
+    return false;
+  }
+  opts.threads = std::min(opts.threads, std::max<size_t>(opts.connections, 1));
+  return opts.connections > 0 && opts.duration > opts.warmup;
+}
+
+#ifdef IOCP_HAS_COROUTINES
+// coro=1时的echo协程：读到的数据原样写回，写完再读下一批，其间到达的数据在协程的输入缓冲区中累积
+SessionTask echoSession(shared_session_ptr session) {
+  while (Buffer* buffer = co_await session->readSome()) {
+    std::vector<char> msg(buffer->readableBytes());
+    buffer->read(msg.data(), msg.size());
+    if (!co_await session->write(Payload(std::move(msg)))) {
+      break;
+    }
+  }
+}
+#endif
+
+bool wouldBlock() {
+#ifdef _WIN32
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+SOCKET connectTo(const std::string& host, unsigned short port) {
+  SOCKET sock = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (sock == INVALID_SOCKET) {
+    return INVALID_SOCKET;
+  }
+  sockaddr_in addr{};
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = inet_addr(host.c_str());
+  addr.sin_port        = htons(port);
+  if (::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR) {
+    closesocket(sock);
+    return INVALID_SOCKET;
+  }
+
+  // 连接建立后改为非阻塞，并关闭Nagle，否则小消息的延迟由延迟确认决定
+  int noDelay = 1;
+  ::setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char*>(&noDelay), sizeof(noDelay));
+#ifdef _WIN32
+  u_long mode = 1;
+  ::ioctlsocket(sock, FIONBIO, &mode);
+#else
+  ::fcntl(sock, F_SETFL, ::fcntl(sock, F_GETFL) | O_NONBLOCK);
+#endif
+  return sock;
+}
+
+// 一个连接的状态：待写出的数据与在途消息的发出时间
+struct Conn {
+  SOCKET sock = INVALID_SOCKET;
+  std::string out;
+  size_t outOffset = 0;
+  struct Inflight {
+    Clock::time_point sentAt;
+    size_t size;
+  };
+  std::deque<Inflight> inflight;
+  size_t headReceived = 0; // 队首消息已收到的回显字节数
+  bool failed         = false;
+};
+
+// 一个客户端线程的结果
+struct Result {
+  std::uint64_t messages = 0;
+  std::uint64_t bytes    = 0;
+  std::uint64_t failures = 0;
+  std::vector<std::uint32_t> latencyNs; // 饱和于约4.29秒
+};
+
+class Client {
+public:
+  Client(const Options& opts, std::vector<SOCKET> socks, unsigned seed)
+      : opts_(opts)
+      , rng_(seed)
+      , sizeDist_(opts.minSize, opts.maxSize)
+      , payload_(opts.maxSize, 'x') {
+    conns_.resize(socks.size());
+    for (size_t i = 0; i < socks.size(); ++i) {
+      conns_[i].sock = socks[i];
+    }
+  }
+
+  ~Client() {
+    for (Conn& conn : conns_) {
+      closesocket(conn.sock);
+    }
+  }
+
+  void Run(Clock::time_point warmupEnd, Clock::time_point end) {
+    for (Conn& conn : conns_) {
+      for (size_t i = 0; i < opts_.pipeline; ++i) {
+        Queue(conn);
+      }
+      Flush(conn);
+    }
+
+#ifdef _WIN32
+    std::vector<WSAPOLLFD> fds(conns_.size());
+#else
+    std::vector<pollfd> fds(conns_.size());
+#endif
+    std::vector<char> buf(64 * 1024);
+    for (Clock::time_point now = Clock::now(); now < end && !conns_.empty(); now = Clock::now()) {
+      fds.resize(conns_.size());
+      for (size_t i = 0; i < conns_.size(); ++i) {
+        fds[i].fd      = conns_[i].sock;
+        fds[i].events  = static_cast<short>(POLLIN | (conns_[i].out.size() > conns_[i].outOffset ? POLLOUT : 0));
+        fds[i].revents = 0;
+      }
+#ifdef _WIN32
+      int ready = ::WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), 10);
+#else
+      int ready = ::poll(fds.data(), fds.size(), 10);
+#endif
+      if (ready <= 0) {
+        continue;
+      }
+
+      for (size_t i = 0; i < conns_.size(); ++i) {
+        Conn& conn = conns_[i];
+        if (fds[i].revents == 0 || conn.failed) {
+          continue;
+        }
+        if (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+          Receive(conn, buf, warmupEnd, end);
+        }
+        if (!conn.failed) {
+          Flush(conn);
+        }
+      }
+
+      // 出错的连接不再参与轮询
+      for (size_t i = 0; i < conns_.size();) {
+        if (conns_[i].failed) {
+          closesocket(conns_[i].sock);
+          if (i + 1 != conns_.size()) {
+            conns_[i] = std::move(conns_.back());
+          }
+          conns_.pop_back();
+        } else {
+          ++i;
+        }
+      }
+    }
+  }
+
+  Result& GetResult() { return result_; }
+
+private:
+  // 生成一条消息放入发送缓冲区
+  void Queue(Conn& conn) {
+    size_t size = sizeDist_(rng_);
+    conn.out.append(payload_.data(), size);
+    conn.inflight.push_back({Clock::now(), size});
+  }
+
+  void Flush(Conn& conn) {
+    if (conn.outOffset == conn.out.size()) {
+      return;
+    }
+    int n = ::send(conn.sock,
+                   conn.out.data() + conn.outOffset,
+                   static_cast<int>(conn.out.size() - conn.outOffset),
+                   kSendFlags);
+    if (n < 0) {
+      if (!wouldBlock()) {
+        Fail(conn);
+      }
+      return;
+    }
+    conn.outOffset += static_cast<size_t>(n);
+    if (conn.outOffset == conn.out.size()) {
+      conn.out.clear();
+      conn.outOffset = 0;
+    }
+  }
+
+  void Receive(Conn& conn, std::vector<char>& buf, Clock::time_point warmupEnd, Clock::time_point end) {
+    for (;;) {
+      int n = ::recv(conn.sock, buf.data(), static_cast<int>(buf.size()), 0);
+      if (n == 0 || (n < 0 && !wouldBlock())) {
+        Fail(conn);
+        return;
+      }
+      if (n < 0) {
+        return;
+      }
+
+      // 回显按发送顺序到达，依次扣除在途消息的长度
+      size_t left          = static_cast<size_t>(n);
+      Clock::time_point at = Clock::now();
+      while (left > 0 && !conn.inflight.empty()) {
+        Conn::Inflight& head = conn.inflight.front();
+        size_t take          = std::min(left, head.size - conn.headReceived);
+        conn.headReceived += take;
+        left -= take;
+        if (conn.headReceived < head.size) {
+          break;
+        }
+
+        if (head.sentAt >= warmupEnd && at < end) {
+          auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(at - head.sentAt).count();
+          result_.latencyNs.push_back(static_cast<std::uint32_t>(std::min<long long>(ns, UINT32_MAX)));
+          result_.messages++;
+          result_.bytes += head.size;
+        }
+        conn.inflight.pop_front();
+        conn.headReceived = 0;
+        Queue(conn);
+      }
+      if (static_cast<size_t>(n) < buf.size()) {
+        return;
+      }
+    }
+  }
+
+  void Fail(Conn& conn) {
+    conn.failed = true;
+    result_.failures++;
+  }
+
+  const Options& opts_;
+  std::mt19937 rng_;
+  std::uniform_int_distribution<size_t> sizeDist_;
+  std::string payload_;
+  std::vector<Conn> conns_;
+  Result result_;
+};
+
+double percentileUs(const std::vector<std::uint32_t>& sorted, double q) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t index = static_cast<size_t>(q * static_cast<double>(sorted.size() - 1) + 0.5);
+  return sorted[index] / 1000.0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opts;
+  if (!parseOptions(argc, argv, opts)) {
+    std::fprintf(stderr, "usage: %s [connections=N] [threads=N] [size=N|MIN-MAX] [pipeline=N] "
+                         "[duration=S] [warmup=S] [host=IP] [port=N] [server=0|1] [workers=N] "
+                         "[sharded=0|1] [batch=N] [latency=0|1] [coro=0|1] [spin=US] [compute=N]\n",
+                 argv[0]);
+    return 1;
+  }
+
+#ifdef _WIN32
+  WSADATA wsaData;
+  ::WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+  // 进程内的echo服务器
+  std::unique_ptr<IOCPServer> server;
+  if (opts.server) {
+    server = std::make_unique<IOCPServer>(opts.host, opts.port);
+    server->setWorkerCount(opts.workers);
+    server->setShardedLoops(opts.sharded);
+    server->setCompletionBatchSize(opts.batch);
+    server->setLatencyTracing(opts.latency);
+    server->setComputeThreads(opts.compute);
+    auto spin = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::micro>(opts.spinUs));
+    bool offload = opts.compute > 0;
+    server->setMessageCallback([spin, offload](shared_session_ptr session, Buffer* buffer) {
+      std::vector<char> msg(buffer->readableBytes());
+      buffer->read(msg.data(), msg.size());
+      auto echo = [spin, msg = std::move(msg)](shared_session_ptr session) mutable {
+        for (auto until = Clock::now() + spin; Clock::now() < until;) {
+        }
+        session->send(std::move(msg));
+      };
+      if (offload) {
+        session->post(std::move(echo)); // 同一连接的任务按顺序执行，回显的字节流保持原样
+      } else {
+        echo(session);
+      }
+    });
+    if (opts.coro) {
+#ifdef IOCP_HAS_COROUTINES
+      server->setSessionHandler(echoSession);
+#else
+      std::fprintf(stderr, "coro=1 requires a build with IOCP_ENABLE_COROUTINES=ON\n");
+      return 1;
+#endif
+    }
+    if (!server->Start()) {
+      std::fprintf(stderr, "failed to start server\n");
+      return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+
+  // 建立连接并分给各线程
+  std::vector<std::vector<SOCKET>> socks(opts.threads);
+  for (size_t i = 0; i < opts.connections; ++i) {
+    SOCKET sock = connectTo(opts.host, opts.port);
+    if (sock == INVALID_SOCKET) {
+      std::fprintf(stderr, "connect failed after %zu connections, error: %d\n", i, WSAGetLastError());
+      return 1;
+    }
+    socks[i % opts.threads].push_back(sock);
+  }
+
+  std::vector<std::unique_ptr<Client>> clients;
+  for (size_t t = 0; t < opts.threads; ++t) {
+    clients.push_back(std::make_unique<Client>(opts, std::move(socks[t]), static_cast<unsigned>(t + 1)));
+  }
+
+  auto start     = Clock::now();
+  auto warmupEnd = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.warmup));
+  auto end       = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.duration));
+  auto before    = server ? server->getMetrics().Total() : MetricsSnapshot::Worker{};
+
+  std::vector<std::thread> threads;
+  for (auto& client : clients) {
+    threads.emplace_back([&client, warmupEnd, end] { client->Run(warmupEnd, end); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // 汇总
+  Result total;
+  for (auto& client : clients) {
+    Result& result = client->GetResult();
+    total.messages += result.messages;
+    total.bytes += result.bytes;
+    total.failures += result.failures;
+    total.latencyNs.insert(total.latencyNs.end(), result.latencyNs.begin(), result.latencyNs.end());
+  }
+  std::sort(total.latencyNs.begin(), total.latencyNs.end());
+  double seconds = opts.duration - opts.warmup;
+
+  std::printf("connections: %zu, threads: %zu, size: %zu-%zu, pipeline: %zu, measured: %.1fs\n",
+              opts.connections,
+              opts.threads,
+              opts.minSize,
+              opts.maxSize,
+              opts.pipeline,
+              seconds);
+  std::printf("throughput: %.0f msgs/s, %.2f MB/s (echoed payload)\n",
+              static_cast<double>(total.messages) / seconds,
+              static_cast<double>(total.bytes) / seconds / 1e6);
+  std::printf("latency us: p50 %.1f, p99 %.1f, p999 %.1f, max %.1f\n",
+              percentileUs(total.latencyNs, 0.50),
+              percentileUs(total.latencyNs, 0.99),
+              percentileUs(total.latencyNs, 0.999),
+              total.latencyNs.empty() ? 0.0 : total.latencyNs.back() / 1000.0);
+  if (total.failures != 0) {
+    std::printf("failed connections: %llu\n", static_cast<unsigned long long>(total.failures));
+  }
+
+  if (server) {
+    auto after               = server->getMetrics().Total();
+    std::uint64_t batches    = after.batches - before.batches;
+    std::uint64_t completion = after.completions() - before.completions();
+    std::printf("server: %llu completions in %llu batches (%.1f per batch)\n",
+                static_cast<unsigned long long>(completion),
+                static_cast<unsigned long long>(batches),
+                batches ? static_cast<double>(completion) / static_cast<double>(batches) : 0.0);
+
+    if (opts.compute > 0) {
+      std::uint64_t tasks  = 0;
+      std::uint64_t steals = 0;
+      for (const auto& thread : server->getMetrics().compute.threads) {
+        tasks += thread.tasks;
+        steals += thread.steals;
+      }
+      std::printf("server compute: %llu tasks, %llu steals\n",
+                  static_cast<unsigned long long>(tasks),
+                  static_cast<unsigned long long>(steals));
+    }
+
+    // 服务器端各阶段耗时，含预热期间；直方图以2的幂分桶，数值为所在桶的上界
+    if (opts.latency) {
+      auto stage = [](const char* name, const Histogram::Snapshot& h) {
+        std::printf("server %-12s us: p50 <%.1f, p99 <%.1f, p999 <%.1f\n",
+                    name,
+                    h.Percentile(0.50) / 1000.0,
+                    h.Percentile(0.99) / 1000.0,
+                    h.Percentile(0.999) / 1000.0);
+      };
+      auto latency = server->getMetrics().latency;
+      stage("queue delay", latency.queueDelay);
+      stage("handler", latency.handler);
+      stage("response", latency.response);
+    }
+  }
+
+  clients.clear();
+  if (server) {
+    server->Stop();
+  }
+  return total.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+// 空闲连接内存基准
+// 在进程内启动服务器，建立N个连接，每个连接收发一条消息后保持空闲，
+// 比较建立连接前后的RSS，折算为每1万个空闲session占用的内存。
+//
+// 用法: idle_rss_bench [connections=10000] [lean=1] [port=8899]
+//   lean=1 开启IOCPServer::setLeanIdleRecv，lean=0 为默认的常驻接收缓冲区模式
+
+#include "ChunkPool.h"
+#include "IOCPServer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+namespace {
+
+// 当前进程的常驻内存，单位字节
+size_t residentBytes() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters{};
+  ::GetProcessMemoryInfo(::GetCurrentProcess(), &counters, sizeof(counters));
+  return counters.WorkingSetSize;
+#else
+  long pages = 0, resident = 0;
+  FILE* fp   = std::fopen("/proc/self/statm", "r");
+  if (fp != nullptr) {
+    if (std::fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    std::fclose(fp);
+  }
+  return static_cast<size_t>(resident) * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+}
+
+// 每个连接在本进程中占用客户端与服务端两个描述符，按上限调整连接数
+size_t clampConnections(size_t wanted) {
+#ifdef _WIN32
+  return wanted;
+#else
+  rlimit limit{};
+  ::getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  ::setrlimit(RLIMIT_NOFILE, &limit);
+  size_t maxConns = limit.rlim_cur > 256 ? (limit.rlim_cur - 256) / 2 : 0;
+  if (wanted > maxConns) {
+    std::printf("RLIMIT_NOFILE=%llu, connections clamped to %zu\n",
+                static_cast<unsigned long long>(limit.rlim_cur),
+                maxConns);
+    return maxConns;
+  }
+  return wanted;
+#endif
+}
+
+SOCKET connectTo(unsigned short port) {
+  SOCKET sock = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (sock == INVALID_SOCKET) {
+    return INVALID_SOCKET;
+  }
+  sockaddr_in addr{};
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  addr.sin_port        = htons(port);
+  if (::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR) {
+    closesocket(sock);
+    return INVALID_SOCKET;
+  }
+  return sock;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  size_t connections  = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+  bool lean           = argc > 2 ? std::atoi(argv[2]) != 0 : true;
+  unsigned short port = argc > 3 ? static_cast<unsigned short>(std::atoi(argv[3])) : 8899;
+
+  connections = clampConnections(connections);
+  if (connections == 0) {
+    return 1;
+  }
+
+  IOCPServer server("127.0.0.1", port);
+  server.setLeanIdleRecv(lean);
+  server.setMessageCallback([](shared_session_ptr session, Buffer* buffer) {
+    std::vector<char> msg(buffer->peek(), buffer->peek() + buffer->readableBytes());
+    buffer->retrieve(buffer->readableBytes());
+    session->send(std::move(msg));
+  });
+  if (!server.Start()) {
+    std::fprintf(stderr, "failed to start server\n");
+    return 1;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  size_t before = residentBytes();
+  auto chunks0  = ChunkPool::GetStats();
+
+  // 每个连接发一条消息并等到回显，之后保持空闲
+  std::vector<SOCKET> clients;
+  clients.reserve(connections);
+  const char hello[] = "hello";
+  for (size_t i = 0; i < connections; ++i) {
+    SOCKET sock = connectTo(port);
+    if (sock == INVALID_SOCKET) {
+      std::fprintf(stderr, "connect failed after %zu connections, error: %d\n", i, WSAGetLastError());
+      break;
+    }
+    char echo[sizeof(hello)];
+    if (::send(sock, hello, sizeof(hello), 0) != static_cast<int>(sizeof(hello)) ||
+        ::recv(sock, echo, sizeof(echo), MSG_WAITALL) != static_cast<int>(sizeof(echo))) {
+      std::fprintf(stderr, "echo failed on connection %zu\n", i);
+      closesocket(sock);
+      break;
+    }
+    clients.push_back(sock);
+  }
+
+  // 等待所有session登记完成并稳定下来
+  for (int i = 0; i < 100 && server.getSessionCount() < clients.size(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+  size_t after   = residentBytes();
+  auto chunks1   = ChunkPool::GetStats();
+  size_t idle    = server.getSessionCount();
+  double delta   = after > before ? static_cast<double>(after - before) : 0.0;
+  double per10k  = idle ? delta / static_cast<double>(idle) * 10000.0 : 0.0;
+  auto chunksNow = static_cast<long long>(chunks1.inUse()) - static_cast<long long>(chunks0.inUse());
+
+  std::printf("mode: %s\n", lean ? "lean idle recv" : "resident recv buffer");
+  std::printf("idle sessions: %zu\n", idle);
+  std::printf("rss before: %.2f MiB, after: %.2f MiB\n", before / 1048576.0, after / 1048576.0);
+  std::printf("rss per 10k idle sessions: %.2f MiB (%.0f bytes/session)\n",
+              per10k / 1048576.0,
+              idle ? delta / static_cast<double>(idle) : 0.0);
+  std::printf("buffer chunks held: %lld (%.2f MiB)\n",
+              chunksNow,
+              static_cast<double>(chunksNow) * ChunkPool::kChunkSize / 1048576.0);
+
+  for (SOCKET sock : clients) {
+    closesocket(sock);
+  }
+  server.Stop();
+  return 0;
+}
@@ -0,0 +1,227 @@
+// 微基准
+// 逐项测量热路径上的单个操作：Buffer的写入/取出/增长、Session::send入队、按id查找session。
+// 每项自动增加迭代次数直到耗时超过约200毫秒，输出每次操作的纳秒数，用于比较改动前后的差异。
+//
+// 用法: micro_bench [filter]
+//   只运行名称中包含filter的项，例如 micro_bench buffer
+// 比较结果时应以-DCMAKE_BUILD_TYPE=Release构建
+
+#include "Buffer.h"
+#include "CompletionPort.h"
+#include "Payload.h"
+#include "Session.h"
+#include "SessionRegistry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// 防止被测结果被优化掉
+std::atomic<size_t> sink{0};
+
+// 重复执行fn(iterations)直到单轮耗时足够长，返回每次操作的纳秒数；
+// fn自行循环iterations次，避免std::function调用计入每次操作
+double measure(const std::function<void(size_t)>& fn, size_t& iterations) {
+  constexpr auto kMinTime = std::chrono::milliseconds(200);
+  fn(std::max<size_t>(iterations / 10, 1)); // 预热
+  for (;;) {
+    auto start   = Clock::now();
+    fn(iterations);
+    auto elapsed = Clock::now() - start;
+    if (elapsed >= kMinTime || iterations >= (size_t(1) << 32)) {
+      return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+    }
+    iterations *= 2;
+  }
+}
+
+// 投递总是成功、但永远不会完成的完成端口：session第一次send之后一直处于发送中，
+// 此后的send只入队，测得的就是入队本身的开销
+class NullPort : public CompletionPort {
+public:
+  bool Listen(SOCKET) override { return true; }
+  bool Associate(SOCKET, ULONG_PTR) override { return true; }
+  bool PostAccept(SOCKET, IoCtx*) override { return false; }
+  void GetAcceptAddrs(IoCtx*, sockaddr_in*, sockaddr_in*) override {}
+  bool PostConnect(IoCtx*) override { return false; }
+  bool PostRecv(IoCtx*) override { return false; }
+  bool PostRecvReady(IoCtx*) override { return false; }
+  bool PostSend(IoCtx* ctx) override {
+    posted_.push_back(ctx);
+    return true;
+  }
+  bool PostSendFile(IoCtx*) override { return false; }
+  void Shutdown(SOCKET) override {}
+  void Close(SOCKET) override {}
+  bool Dequeue(size_t, Completion*, size_t, size_t& count, int) override {
+    count = 0;
+    return false;
+  }
+  void Wakeup() override {}
+
+  // 释放挂起的发送持有的session引用，之后session可以析构
+  void Abandon() {
+    for (IoCtx* ctx : posted_) {
+      ctx->session.reset();
+    }
+    posted_.clear();
+  }
+
+private:
+  std::vector<IoCtx*> posted_;
+};
+
+std::shared_ptr<Session> makeSession(const std::shared_ptr<NullPort>& port) {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  return std::make_shared<Session>(port, INVALID_SOCKET, &addr, &addr);
+}
+
+struct Bench {
+  std::string name;
+  std::function<void(size_t)> run;
+};
+
+std::vector<Bench> buildBenches() {
+  std::vector<Bench> benches;
+
+  // Buffer：稳定状态下写入后立即取出，不发生增长
+  for (size_t size : {64, 4096, 65536}) {
+    benches.push_back({"buffer/write_retrieve_" + std::to_string(size), [size](size_t n) {
+                         Buffer buf;
+                         std::vector<char> data(size, 'x');
+                         for (size_t i = 0; i < n; ++i) {
+                           buf.write(data.data(), size);
+                           buf.retrieve(size);
+                         }
+                         sink += buf.readableBytes();
+                       }});
+  }
+
+  // Buffer：接收路径，预留可写空间、提交、再取出
+  benches.push_back({"buffer/prepare_commit_4096", [](size_t n) {
+                       Buffer buf;
+                       WSABUF bufs[4];
+                       size_t count = 0;
+                       for (size_t i = 0; i < n; ++i) {
+                         count += buf.prepareWrite(4096, bufs, 4);
+                         buf.commitWrite(4096);
+                         buf.retrieve(4096);
+                       }
+                       sink += count;
+                     }});
+
+  // Buffer：从空缓冲区按4 KiB写满1 MiB，每次操作包含全部增长与释放
+  benches.push_back({"buffer/growth_1m", [](size_t n) {
+                       std::vector<char> data(4096, 'x');
+                       for (size_t i = 0; i < n; ++i) {
+                         Buffer buf;
+                         for (size_t written = 0; written < 1024 * 1024; written += data.size()) {
+                           buf.write(data.data(), data.size());
+                         }
+                         sink.store(buf.readableBytes(), std::memory_order_relaxed);
+                       }
+                     }});
+
+  // Buffer：在16 KiB数据中查找位于末尾的分隔符，跨越多个块
+  benches.push_back({"buffer/find_16k", [](size_t n) {
+                       Buffer buf;
+                       std::vector<char> data(16 * 1024, 'x');
+                       data.back() = '\n';
+                       buf.write(data.data(), data.size());
+                       size_t pos = 0;
+                       for (size_t i = 0; i < n; ++i) {
+                         pos += buf.find("\n", 1);
+                       }
+                       sink += pos;
+                     }});
+
+  // Session::send：已在发送中时的入队，拷贝数据 / 共享数据
+  benches.push_back({"session/send_copy_64", [](size_t n) {
+                       auto port = std::make_shared<NullPort>();
+                       char data[64] = {};
+                       for (size_t done = 0; done < n;) {
+                         // 每轮换一个session，避免发送队列无限增长
+                         auto session = makeSession(port);
+                         for (size_t i = 0; i < 65536 && done < n; ++i, ++done) {
+                           session->send(data, sizeof(data));
+                         }
+                         port->Abandon();
+                       }
+                     }});
+  benches.push_back({"session/send_shared_64", [](size_t n) {
+                       auto port = std::make_shared<NullPort>();
+                       auto data = std::make_shared<const std::string>(64, 'x');
+                       for (size_t done = 0; done < n;) {
+                         auto session = makeSession(port);
+                         for (size_t i = 0; i < 65536 && done < n; ++i, ++done) {
+                           session->send(Payload(data));
+                         }
+                         port->Abandon();
+                       }
+                     }});
+
+  // SessionRegistry：在10万个session中按随机id查找，单线程 / 4线程同时查找
+  struct Registry {
+    std::shared_ptr<NullPort> port = std::make_shared<NullPort>();
+    SessionRegistry registry;
+    std::vector<SessionId> ids;
+
+    Registry() {
+      for (size_t i = 0; i < 100000; ++i) {
+        ids.push_back(registry.Add(makeSession(port)));
+      }
+    }
+    ~Registry() { registry.Clear(); }
+  };
+  auto registry = std::make_shared<Registry>();
+  auto lookup   = [registry](size_t n, unsigned seed) {
+    std::mt19937 rng(seed);
+    size_t found = 0;
+    for (size_t i = 0; i < n; ++i) {
+      found += registry->registry.Find(registry->ids[rng() % registry->ids.size()]) != nullptr;
+    }
+    sink += found;
+  };
+  benches.push_back({"registry/find_100k", [lookup](size_t n) { lookup(n, 1); }});
+  benches.push_back({"registry/find_100k_4threads", [lookup](size_t n) {
+                       // 每个线程各查找n次，结果为墙钟时间除以n
+                       std::vector<std::thread> threads;
+                       for (unsigned t = 0; t < 4; ++t) {
+                         threads.emplace_back(lookup, n, t + 1);
+                       }
+                       for (auto& thread : threads) {
+                         thread.join();
+                       }
+                     }});
+
+  return benches;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  const char* filter = argc > 1 ? argv[1] : "";
+
+  std::printf("%-32s %14s %12s %12s\n", "benchmark", "iterations", "ns/op", "Mops/s");
+  for (const Bench& bench : buildBenches()) {
+    if (bench.name.find(filter) == std::string::npos) {
+      continue;
+    }
+    size_t iterations = 1000;
+    double ns         = measure(bench.run, iterations);
+    std::printf("%-32s %14zu %12.1f %12.2f\n", bench.name.c_str(), iterations, ns, ns > 0 ? 1000.0 / ns : 0.0);
+  }
+  return 0;
+}
@@ -0,0 +1,278 @@
+// Session::sendFile吞吐与正确性检查
+// 生成一个内容随偏移变化的文件，在进程内启动服务器：客户端发送一行"offset length"，服务器以
+// sendFile回送文件的这一段。逐个检查各个文件段收到的字节，并统计每段的耗时与吞吐。
+// 默认的文件段覆盖页对齐与不对齐的起点、恰好与超过一个分块（SENDFILE_CHUNK_SIZE）的长度；
+// 任何一段内容不符或在timeout秒内没有收齐时以非0退出。
+//
+// 用法: sendfile_bench [key=value ...]
+//   size=4194304      生成的文件大小（字节）
+//   rounds=3          每个文件段重复的次数
+//   range=OFF:LEN     只测试这一段，可重复指定
+//   timeout=10        每一段等待收齐的最长时间（秒）
+//   port=8897 workers=0 sharded=0
+//   file=sendfile_bench.dat   生成的文件路径，结束时删除
+// 服务器后端同样可由IOCP_BACKEND=epoll选择
+
+#include "IOCPServer.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Range {
+  std::uint64_t offset;
+  std::uint64_t length;
+};
+
+struct Options {
+  std::uint64_t size  = 4 * 1024 * 1024;
+  size_t rounds       = 3;
+  double timeout      = 10;
+  unsigned short port = 8897;
+  size_t workers      = 0;
+  bool sharded        = false;
+  std::string file    = "sendfile_bench.dat";
+  std::vector<Range> ranges;
+};
+
+bool parseOptions(int argc, char* argv[], Options& opts) {
+  std::map<std::string, std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    const char* eq = std::strchr(argv[i], '=');
+    if (eq == nullptr) {
+      std::fprintf(stderr, "bad argument '%s', expected key=value\n", argv[i]);
+      return false;
+    }
+    std::string key(argv[i], static_cast<size_t>(eq - argv[i]));
+    if (key == "range") {
+      // range可以重复指定
+      char* end;
+      Range range;
+      range.offset = std::strtoull(eq + 1, &end, 10);
+      if (*end != ':') {
+        std::fprintf(stderr, "bad range '%s', expected OFF:LEN\n", eq + 1);
+        return false;
+      }
+      range.length = std::strtoull(end + 1, nullptr, 10);
+      opts.ranges.push_back(range);
+      continue;
+    }
+    args[key] = eq + 1;
+  }
+
+  auto number = [&](const char* key, double def) {
+    auto it = args.find(key);
+    return it == args.end() ? def : std::atof(it->second.c_str());
+  };
+  opts.size    = static_cast<std::uint64_t>(number("size", 4 * 1024 * 1024));
+  opts.rounds  = std::max<size_t>(static_cast<size_t>(number("rounds", 3)), 1);
+  opts.timeout = number("timeout", 10);
+  opts.port    = static_cast<unsigned short>(number("port", 8897));
+  opts.workers = static_cast<size_t>(number("workers", 0));
+  opts.sharded = number("sharded", 0) != 0;
+  if (args.count("file")) {
+    opts.file = args["file"];
+  }
+
+  if (opts.ranges.empty()) {
+    std::uint64_t chunk = SENDFILE_CHUNK_SIZE;
+    opts.ranges         = {
+        {0, opts.size},                // 整个文件
+        {0, chunk + 1},                // 对齐的起点，比一个分块多一个字节
+        {100, chunk - 100},            // 不对齐的起点，连同页内偏移恰好占满一个分块的页
+        {100, chunk - 99},             // 不对齐的起点，连同页内偏移比一个分块多一个字节
+        {100, 2000000},                // 不对齐的起点，超过一个分块
+        {4096, 2000000},               // 对齐的起点，超过一个分块
+        {1, opts.size - 1},            // 不对齐的起点，直到文件末尾
+        {opts.size - 10, 10},          // 文件末尾的几个字节
+    };
+  }
+  for (const Range& range : opts.ranges) {
+    if (range.length == 0 || range.offset >= opts.size || range.length > opts.size - range.offset) {
+      std::fprintf(stderr,
+                   "range %llu:%llu is outside the %llu-byte file\n",
+                   static_cast<unsigned long long>(range.offset),
+                   static_cast<unsigned long long>(range.length),
+                   static_cast<unsigned long long>(opts.size));
+      return false;
+    }
+  }
+  return opts.size > 0;
+}
+
+// 文件第i个字节的内容；混入页号，使错位一页或错位几个字节的数据都不会恰好相同
+unsigned char patternAt(std::uint64_t i) { return static_cast<unsigned char>(i * 131 + (i >> 12) * 7); }
+
+bool writeFile(const Options& opts) {
+  FILE* fp = std::fopen(opts.file.c_str(), "wb");
+  if (fp == nullptr) {
+    std::fprintf(stderr, "failed to create %s\n", opts.file.c_str());
+    return false;
+  }
+  std::vector<unsigned char> block(64 * 1024);
+  bool ok = true;
+  for (std::uint64_t pos = 0; ok && pos < opts.size; pos += block.size()) {
+    size_t n = static_cast<size_t>(std::min<std::uint64_t>(block.size(), opts.size - pos));
+    for (size_t i = 0; i < n; ++i) {
+      block[i] = patternAt(pos + i);
+    }
+    ok = std::fwrite(block.data(), 1, n, fp) == n;
+  }
+  return std::fclose(fp) == 0 && ok;
+}
+
+// 请求一段文件并检查收到的内容，返回收齐所用的秒数，失败返回负数
+double fetchRange(const Options& opts, const Range& range) {
+  SOCKET sock = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (sock == INVALID_SOCKET) {
+    return -1;
+  }
+  sockaddr_in addr{};
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  addr.sin_port        = htons(opts.port);
+  if (::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR) {
+    std::fprintf(stderr, "connect failed, error: %d\n", WSAGetLastError());
+    closesocket(sock);
+    return -1;
+  }
+
+  // 每次recv最多阻塞到整段的期限，服务器停止发送时不会一直等下去
+#ifdef _WIN32
+  DWORD wait = static_cast<DWORD>(opts.timeout * 1000);
+#else
+  timeval wait{};
+  wait.tv_sec  = static_cast<time_t>(opts.timeout);
+  wait.tv_usec = static_cast<suseconds_t>((opts.timeout - static_cast<double>(wait.tv_sec)) * 1e6);
+#endif
+  ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&wait), sizeof(wait));
+
+  auto start = Clock::now();
+  auto deadline =
+      start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.timeout));
+  std::string request = std::to_string(range.offset) + " " + std::to_string(range.length) + "\n";
+  ::send(sock, request.data(), static_cast<int>(request.size()), 0);
+
+  std::vector<char> buf(256 * 1024);
+  std::uint64_t received = 0;
+  bool ok                = true;
+  while (ok && received < range.length) {
+    int n = ::recv(sock, buf.data(), static_cast<int>(buf.size()), 0);
+    if (n <= 0 || Clock::now() > deadline) {
+      std::fprintf(stderr,
+                   "range %llu:%llu stalled after %llu bytes\n",
+                   static_cast<unsigned long long>(range.offset),
+                   static_cast<unsigned long long>(range.length),
+                   static_cast<unsigned long long>(received));
+      ok = false;
+      break;
+    }
+    for (int i = 0; i < n; ++i) {
+      std::uint64_t pos = range.offset + received + static_cast<std::uint64_t>(i);
+      if (received + static_cast<std::uint64_t>(i) >= range.length ||
+          static_cast<unsigned char>(buf[i]) != patternAt(pos)) {
+        std::fprintf(stderr,
+                     "range %llu:%llu: wrong or extra byte at file offset %llu\n",
+                     static_cast<unsigned long long>(range.offset),
+                     static_cast<unsigned long long>(range.length),
+                     static_cast<unsigned long long>(pos));
+        ok = false;
+        break;
+      }
+    }
+    received += static_cast<std::uint64_t>(n);
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  closesocket(sock);
+  return ok ? seconds : -1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opts;
+  if (!parseOptions(argc, argv, opts)) {
+    std::fprintf(stderr, "usage: %s [size=N] [rounds=N] [range=OFF:LEN ...] [timeout=S] [port=N] "
+                         "[workers=N] [sharded=0|1] [file=PATH]\n",
+                 argv[0]);
+    return 1;
+  }
+
+#ifdef _WIN32
+  WSADATA wsaData;
+  ::WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+  if (!writeFile(opts)) {
+    return 1;
+  }
+
+  // 每个请求行"offset length"以sendFile回送文件的这一段
+  IOCPServer server("127.0.0.1", opts.port);
+  server.setWorkerCount(opts.workers);
+  server.setShardedLoops(opts.sharded);
+  std::string path = opts.file;
+  server.setMessageCallback([path](shared_session_ptr session, Buffer* buffer) {
+    size_t eol;
+    while ((eol = buffer->find("\n", 1)) != Buffer::npos) {
+      std::string line(buffer->peek(eol + 1), eol);
+      buffer->retrieve(eol + 1);
+      unsigned long long offset = 0;
+      unsigned long long length = 0;
+      if (std::sscanf(line.c_str(), "%llu %llu", &offset, &length) != 2 ||
+          !session->sendFile(path, offset, length)) {
+        session->shutdown();
+        return;
+      }
+    }
+  });
+  if (!server.Start()) {
+    std::fprintf(stderr, "failed to start server\n");
+    std::remove(opts.file.c_str());
+    return 1;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  std::printf("%12s %12s %10s %10s\n", "offset", "length", "ms", "MiB/s");
+  bool allOk = true;
+  for (const Range& range : opts.ranges) {
+    double best = -1;
+    for (size_t round = 0; round < opts.rounds; ++round) {
+      double seconds = fetchRange(opts, range);
+      if (seconds < 0) {
+        best = -1;
+        break;
+      }
+      best = best < 0 ? seconds : std::min(best, seconds);
+    }
+    if (best < 0) {
+      allOk = false;
+      std::printf("%12llu %12llu %10s %10s\n",
+                  static_cast<unsigned long long>(range.offset),
+                  static_cast<unsigned long long>(range.length),
+                  "FAILED",
+                  "-");
+      continue;
+    }
+    std::printf("%12llu %12llu %10.2f %10.1f\n",
+                static_cast<unsigned long long>(range.offset),
+                static_cast<unsigned long long>(range.length),
+                best * 1000,
+                static_cast<double>(range.length) / (1024.0 * 1024.0) / best);
+  }
+
+  server.Stop();
+  std::remove(opts.file.c_str());
+  std::printf("%s\n", allOk ? "all ranges OK" : "some ranges FAILED");
+  return allOk ? 0 : 1;
+}
@@ -1,104 +1,119 @@
 #pragma once
 
-#include <algorithm>
-#include <cstddef>
-#include <cstring>
-#include <vector>
+#include "ChunkPool.h"
+#include "Platform.h"
 
+#include <cstddef>
+#include <deque>
+#include <stdexcept>
+
+// 分段缓冲区
+// 数据存放在从ChunkPool取得的定长块组成的链中，写入只追加到尾部的块，取出只前移头部，
+// 读空的块立即归还内存池，不再有整体搬移或成倍扩容的拷贝。
+// peek()需要连续内存时才把跨块的数据合并为一段（linearize），readableBufs/prepareWrite
+// 可以把各段直接导出给writev/readv等分散-聚集I/O
 class Buffer {
   using size_t = std::size_t;
 
 public:
-  // 构造函数，默认大小
-  explicit Buffer(size_t initialSize = 1024 * 4)
-      : buffer_(initialSize)
-      , readPos_(0)
-      , writePos_(0) {}
+  static constexpr size_t npos = static_cast<size_t>(-1);
 
-  // 写入数据
-  void write(const void* data, size_t length) {
-    ensureWriteSpace(length);
-    std::memcpy(buffer_.data() + writePos_, data, length);
-    writePos_ += length;
-  }
+  // initialSize仅为兼容旧接口保留，内存块在写入时按需分配
+  explicit Buffer(size_t initialSize = 1024 * 4);
 
-  // 读取数据
-  size_t read(void* output, size_t length) {
-    length = std::min<size_t>(length, readableBytes());
-    if (length == 0)
-      return 0;
+  ~Buffer();
+
+  Buffer(Buffer&& other) noexcept;
+
+  Buffer& operator=(Buffer&& other) noexcept;
 
-    std::memcpy(output, buffer_.data() + readPos_, length);
-    readPos_ += length;
+  // 写入数据
+  void write(const void* data, size_t length);
 
-    // 如果所有数据都已读取，重置位置
-    if (readPos_ == writePos_) {
-      readPos_ = writePos_ = 0;
-    }
+  // 把other的全部可读数据接到末尾，other随后为空；本缓冲区为空时直接接管other的内存块，否则拷贝
+  void append(Buffer&& other);
 
-    return length;
-  }
+  // 读取数据
+  size_t read(void* output, size_t length);
 
   // 获取当前可读数据大小
-  size_t readableBytes() const { return writePos_ - readPos_; }
+  size_t readableBytes() const { return readable_; }
 
   // 获取当前可写空间大小（连续空间）
-  size_t writableBytes() const { return buffer_.size() - writePos_; }
+  size_t writableBytes() const;
 
   // 获取缓冲区容量
-  size_t capacity() const { return buffer_.size(); }
+  size_t capacity() const { return capacity_; }
+
+  // 清空缓冲区，并归还所有内存块
+  void clear();
 
-  // 清空缓冲区
-  void clear() {
-    readPos_ = writePos_ = 0;
-    buffer_.clear();
-  }
+  // 获取全部可读数据的连续视图，数据跨越多个块时先合并为一段；
+  // 合并只改变内部的分段方式，可读内容不变，因此是const操作，但会使之前取得的地址失效
+  const char* peek() const;
 
-  // 获取可读数据的指针
-  const char* peek() const { return buffer_.data() + readPos_; }
+  // 保证前len字节（不超过可读字节数）位于一段连续内存中并返回其起始地址；
+  // 已经连续时不做任何拷贝，否则只合并这len字节，其后的数据保持原样
+  const char* peek(size_t len) const;
 
   // 丢弃已读取的数据
-  void retrieve(size_t len) {
-    if (len > readableBytes()) {
-      throw std::out_of_range("Buffer::retrieve");
-    }
-    readPos_ += len;
+  void retrieve(size_t len);
+
+  // 首段中可直接访问的可读字节数，不会触发合并
+  size_t contiguousBytes() const;
+
+  // 首段可读数据的起始地址，长度为contiguousBytes()；缓冲区为空时为nullptr
+  const char* peekContiguous() const;
+
+  // 从可读数据的from处开始查找pattern，跨越块边界也能找到，不合并；返回其偏移，找不到返回npos
+  size_t find(const char* pattern, size_t patternLen, size_t from = 0) const;
 
-    if (readPos_ == writePos_) {
-      readPos_ = writePos_ = 0;
-    }
-  }
+  // 从可读数据的offset处拷贝至多length字节到output，不取出也不合并，返回拷贝的字节数
+  size_t copyOut(void* output, size_t length, size_t offset = 0) const;
+
+  // 将可读数据按段导出到bufs（至多maxBufs段），返回段数，可直接交给WSASend/writev
+  size_t readableBufs(WSABUF* bufs, size_t maxBufs) const;
+
+  // 保证尾部至少有length字节可写空间，并将可写空间按段导出到bufs（至多maxBufs段），返回段数；
+  // 外部直接写入（例如recv）之后调用commitWrite登记写入的字节数
+  size_t prepareWrite(size_t length, WSABUF* bufs, size_t maxBufs);
+
+  // 登记外部已按prepareWrite导出的顺序写入了length字节
+  void commitWrite(size_t length);
 
 private:
-  // 获取总可用空间（前面空闲+后面空闲）
-  size_t totalWritableBytes() const { return buffer_.size() - (writePos_ - readPos_); }
-
-  // 确保有足够的写入空间
-  void ensureWriteSpace(size_t length) {
-    // 如果后面空间足够，直接返回
-    if (length <= writableBytes()) {
-      return;
-    }
-
-    // 计算总可用空间（前面空闲+后面空闲）
-    size_t totalAvailable = totalWritableBytes();
-
-    if (length <= totalAvailable) {
-      // 移动可读数据到头部
-      size_t readable = readableBytes();
-      if (readable > 0) {
-        std::memmove(buffer_.data(), buffer_.data() + readPos_, readable);
-      }
-      readPos_  = 0;
-      writePos_ = readable;
-    } else {
-      // 需要扩容 - 至少扩容到当前内容+新数据的两倍大小
-      size_t newSize = std::max<size_t>(buffer_.size() * 2, writePos_ + length);
-      buffer_.resize(newSize);
-    }
-  }
-
-  std::vector<char> buffer_;
-  size_t readPos_  = 0;
-  size_t writePos_ = 0;
-};
\ No newline at end of file
+  // 一段连续内存，可读数据位于[begin, end)
+  struct Segment {
+    char* data;
+    size_t cap;
+    size_t begin;
+    size_t end;
+
+    // 由ChunkPool分配的块；合并时产生的更大的段直接从堆上分配
+    bool pooled() const { return cap == ChunkPool::kChunkSize; }
+  };
+
+  Buffer(const Buffer&)            = delete;
+  Buffer& operator=(const Buffer&) = delete;
+
+  // 追加一个空块
+  void appendChunk();
+
+  // 当前接收写入的段，必要时追加新块
+  Segment& writeSegment();
+
+  // 把全部可读数据合并到一段连续内存中
+  void linearize() const;
+
+  // 可读数据的pos处是否为[data, data + len)
+  bool equalsAt(size_t pos, const char* data, size_t len) const;
+
+  // 归还段的内存，调用方负责把它从segs_中移除
+  void releaseSegment(const Segment& seg) const;
+
+  // 分段方式可在const的peek中合并调整，可读字节数不受影响
+  mutable std::deque<Segment> segs_;
+  mutable size_t writeIdx_ = 0; // 写入位置所在的段，其之前的段都已写满
+  size_t readable_         = 0;
+  mutable size_t capacity_ = 0;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Buffer使用的定长内存块大小
+#ifndef BUFFER_CHUNK_SIZE
+  #define BUFFER_CHUNK_SIZE (1024 * 8)
+#endif
+
+// Buffer内存块池
+// 块大小固定为BUFFER_CHUNK_SIZE，释放后放回当前线程的空闲链表，
+// 线程本地缓存过多时成批归还全局链表，全局链表也超过上限时才真正释放内存
+class ChunkPool {
+public:
+  static constexpr std::size_t kChunkSize = BUFFER_CHUNK_SIZE;
+
+  struct Stats {
+    std::uint64_t acquired  = 0; // Acquire总次数
+    std::uint64_t reused    = 0; // 由空闲链表复用的次数
+    std::uint64_t allocated = 0; // 新分配内存的次数
+    std::uint64_t released  = 0; // Release总次数
+    std::uint64_t freed     = 0; // 超出缓存上限而真正释放的块数
+
+    // 当前在用的块数
+    std::uint64_t inUse() const { return acquired - released; }
+
+    // 池命中率
+    double hitRate() const { return acquired ? static_cast<double>(reused) / acquired : 0.0; }
+  };
+
+  // 取出一块kChunkSize字节、按缓存行对齐的内存，内容未初始化
+  static char* Acquire();
+
+  // 归还内存块，调用后不得再访问chunk
+  static void Release(char* chunk);
+
+  // 汇总所有线程的计数
+  static Stats GetStats();
+};
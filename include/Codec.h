@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Buffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 分帧编解码器
+// 直接在session的输入缓冲区上解析，不取出数据：解析出完整的一帧后，
+// 由Session把这一帧以std::string_view的形式交给onFrameCallback，回调返回后才从缓冲区中丢弃；
+// 不完整的帧留在缓冲区中等待后续数据，不做拷贝。编解码器本身无状态，可以被所有session共享
+class Codec {
+public:
+  // 一帧在可读数据中的位置
+  struct Frame {
+    size_t offset  = 0; // 帧内容相对可读数据起点的偏移（跳过帧头）
+    size_t length  = 0; // 帧内容的长度
+    size_t consume = 0; // 这一帧连同帧头、分隔符在内占用的字节数
+  };
+
+  enum class Status {
+    Complete,   // 解析出一帧，结果在frame中
+    Incomplete, // 数据不足一帧
+    Invalid,    // 帧超过上限或格式错误，应断开连接
+  };
+
+  explicit Codec(size_t maxFrameSize)
+      : maxFrameSize_(maxFrameSize) {}
+
+  virtual ~Codec() = default;
+
+  // 从buf的可读数据起点解析一帧；scanned为session保存的解析进度（已检查过的字节数），
+  // 数据不足时可以据此避免重复扫描，取出一帧后由调用方清零
+  virtual Status decode(const Buffer& buf, size_t& scanned, Frame& frame) const = 0;
+
+  // 把长度为length的帧内容编码时需要的帧头写入header，返回帧头字节数（不超过kMaxHeaderSize），
+  // 帧内容超过上限时返回npos
+  virtual size_t encodeHeader(size_t length, char* header) const = 0;
+
+  // 帧内容之后需要追加的数据，例如分隔符
+  virtual const std::string& trailer() const;
+
+  size_t maxFrameSize() const { return maxFrameSize_; }
+
+  static constexpr size_t kMaxHeaderSize = 8;
+  static constexpr size_t npos           = static_cast<size_t>(-1);
+
+private:
+  size_t maxFrameSize_;
+};
+
+// 长度前缀：帧头为headerSize（1/2/4/8）字节的无符号整数，表示其后帧内容的长度
+class LengthFieldCodec : public Codec {
+public:
+  enum class ByteOrder { BigEndian, LittleEndian };
+
+  explicit LengthFieldCodec(size_t headerSize    = 4,
+                            ByteOrder order      = ByteOrder::BigEndian,
+                            size_t maxFrameSize  = 4 * 1024 * 1024);
+
+  Status decode(const Buffer& buf, size_t& scanned, Frame& frame) const override;
+
+  size_t encodeHeader(size_t length, char* header) const override;
+
+private:
+  size_t headerSize_;
+  ByteOrder order_;
+};
+
+// 分隔符：帧内容以delimiter结尾，交给回调的内容不含分隔符；默认按行（"\n"）分帧
+class DelimiterCodec : public Codec {
+public:
+  explicit DelimiterCodec(std::string delimiter = "\n", size_t maxFrameSize = 64 * 1024);
+
+  Status decode(const Buffer& buf, size_t& scanned, Frame& frame) const override;
+
+  size_t encodeHeader(size_t length, char* header) const override;
+
+  const std::string& trailer() const override { return delimiter_; }
+
+private:
+  std::string delimiter_;
+};
+
+// 定长：每frameSize字节为一帧
+class FixedLengthCodec : public Codec {
+public:
+  explicit FixedLengthCodec(size_t frameSize);
+
+  Status decode(const Buffer& buf, size_t& scanned, Frame& frame) const override;
+
+  size_t encodeHeader(size_t length, char* header) const override;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "IOContext.h"
+
+#include <memory>
+
+// 一次完成事件，由各平台后端统一成相同的形式交给WorkerThread
+struct Completion {
+  IoCtx* ctx              = nullptr; // 完成的I/O上下文，为空表示唤醒事件
+  ULONG_PTR completionKey = 0;
+  DWORD bytesTransferred  = 0;
+  DWORD error             = 0; // 0 表示成功，否则为平台错误码
+};
+
+// 完成端口抽象：Windows下为IOCP，Linux下为io_uring，io_uring不可用时退化为epoll模拟
+// 投递的I/O完成后由Dequeue返回，多个工作线程可以同时调用Dequeue
+class CompletionPort {
+public:
+  virtual ~CompletionPort() = default;
+
+  // 创建当前平台的完成端口，workers为将要调用Dequeue的工作线程数，失败返回nullptr
+  // Linux下可通过环境变量 IOCP_BACKEND=epoll 强制使用epoll后端
+  static std::unique_ptr<CompletionPort> Create(size_t workers);
+
+  // 准备监听套接字，使其可以投递Accept
+  virtual bool Listen(SOCKET listenSock) = 0;
+
+  // 关联指定Sock至完成端口
+  virtual bool Associate(SOCKET sock, ULONG_PTR key) = 0;
+
+  // 投递Accept请求，完成后ctx->sock为新连接的套接字
+  virtual bool PostAccept(SOCKET listenSock, IoCtx* ctx) = 0;
+
+  // 预先创建至多count个供Accept使用的套接字，使投递Accept时不必当场创建；
+  // 只有需要预先提供套接字的后端（IOCP的AcceptEx）实现，其他后端由accept本身创建套接字
+  virtual void ReserveAcceptSockets(size_t /* count */) {}
+
+  // 取出Accept完成后的本地/远端地址
+  virtual void GetAcceptAddrs(IoCtx* ctx, sockaddr_in* localAddr, sockaddr_in* remoteAddr) = 0;
+
+  // 投递连接请求：ctx->sock为已关联到本端口的新套接字，连接ctx->peerAddr，
+  // 完成时bytesTransferred为0，失败时error为平台错误码
+  virtual bool PostConnect(IoCtx* ctx) = 0;
+
+  // 投递接收请求，数据按顺序写入ctx->recvBufs中的recvBufCount个缓冲区
+  virtual bool PostRecv(IoCtx* ctx) = 0;
+
+  // 投递零字节读：不占用任何接收缓冲区，套接字可读（或已断开、出错）时以0字节完成，
+  // 之后再投递真正的接收；用于让空闲连接不持有接收内存
+  virtual bool PostRecvReady(IoCtx* ctx) = 0;
+
+  // 投递发送请求，按顺序发送ctx->sendBufs中的sendBufCount个缓冲区
+  virtual bool PostSend(IoCtx* ctx) = 0;
+
+  // 投递文件发送请求，从ctx->sendFile的fileOffset处发送至多SENDFILE_CHUNK_SIZE字节，
+  // 数据由内核直接从文件传输到套接字，完成时bytesTransferred为实际发送的字节数
+  virtual bool PostSendFile(IoCtx* ctx) = 0;
+
+  // 中止套接字上挂起的I/O，对应的完成事件仍会带着错误或0字节送达；
+  // 套接字本身保持有效，直到Close，避免fd被复用后误操作到新连接
+  virtual void Shutdown(SOCKET sock) = 0;
+
+  // 关闭套接字，此时其上不应再有挂起的I/O
+  virtual void Close(SOCKET sock) = 0;
+
+  // 等待完成事件，一次取出已完成的至多maxCount个存入out，count为取到的个数；
+  // worker为调用线程的编号，timeoutMs为负时一直等待。唤醒事件以ctx为空的事件返回，
+  // 超时返回true且count为0，端口失效时返回false
+  virtual bool Dequeue(size_t worker, Completion* out, size_t maxCount, size_t& count, int timeoutMs) = 0;
+
+  // 投递一个空的完成事件，唤醒一个等待中的工作线程
+  virtual void Wakeup() = 0;
+};
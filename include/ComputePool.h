@@ -0,0 +1,78 @@
+#pragma once
+
+#include "IOContext.h"
+#include "Metrics.h"
+#include "callback.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 计算线程池，供消息回调把耗时的计算移出I/O工作线程（见Session::post、IOCPServer::setComputeThreads）
+// 以session为调度单位：每个session的任务排在它自己的队列中，同一时刻只有一个计算线程执行它，
+// 因而同一session的任务按提交顺序依次执行；有待执行任务的session进入某个计算线程的双端队列，
+// 所属线程从尾部取（刚放入的最热），空闲线程从其他线程队列的头部窃取。
+// 一次取出session队列中当时的全部任务连续执行，之后仍有新任务时放回本线程队列的头部，让位于其他session
+class ComputePool {
+public:
+  explicit ComputePool(size_t threads);
+  ~ComputePool();
+
+  // 启动计算线程
+  void Start();
+
+  // 停止计算线程：等待正在执行的任务返回，丢弃尚未执行的任务；可重复调用
+  void Stop();
+
+  // 把task加入session的任务队列，线程池已停止或连接已关闭时返回false；任意线程均可调用。
+  // 执行前连接已关闭的任务被丢弃
+  bool Submit(const shared_session_ptr& session, ComputeTask task);
+
+  size_t ThreadCount() const { return workers_.size(); }
+
+  // 各线程的队列深度与计数，任意线程均可调用
+  ComputeStats getStats() const;
+
+private:
+  ComputePool(const ComputePool&)            = delete;
+  ComputePool& operator=(const ComputePool&) = delete;
+
+  struct alignas(CACHE_LINE_SIZE) Worker {
+    mutable std::mutex mtx;
+    std::deque<shared_session_ptr> ready; // 有待执行任务的session
+    std::atomic<std::uint64_t> tasks{0};  // 执行的任务数，只由本线程写入
+    std::atomic<std::uint64_t> steals{0}; // 从其他线程窃取的session数，只由本线程写入
+    std::thread thread;
+  };
+
+  // 线程主函数
+  void ThreadProc(size_t index);
+
+  // 把session放入一个线程的队列：在计算线程上放入本线程的队列，否则按session id选择；
+  // front为true时放在头部
+  void Schedule(const shared_session_ptr& session, bool front = false);
+
+  // 从本线程队列的尾部取出，或从其他线程队列的头部窃取
+  bool Pop(size_t index, shared_session_ptr& session);
+  bool Steal(size_t index, shared_session_ptr& session);
+
+  // 执行session当前排队的全部任务
+  void Run(Worker& self, const shared_session_ptr& session);
+
+  // 线程池停止后清空session的任务队列
+  void Discard(const shared_session_ptr& session);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<bool> running_{false};
+  std::atomic<size_t> queuedTasks_{0};   // 已提交尚未执行的任务数
+  std::atomic<size_t> readySessions_{0}; // 各线程队列中的session数之和
+
+  // 空闲线程在此等待，只有存在等待者时提交方才加锁唤醒
+  std::mutex sleepMtx_;
+  std::condition_variable wake_;
+  std::atomic<size_t> sleeping_{0};
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+// 基于C++20协程的连接处理接口
+// 以C++20编译（CMake选项IOCP_ENABLE_COROUTINES）时定义IOCP_HAS_COROUTINES，否则本头文件为空，
+// 服务器核心仍按C++17编译，两种方式的Session布局相同。用法：
+//
+//   SessionTask echo(shared_session_ptr session) {
+//     while (Buffer* buf = co_await session->readSome()) {
+//       std::string data(buf->peek(), buf->readableBytes());
+//       buf->retrieve(data.size());
+//       if (!co_await session->write(std::move(data)))
+//         break;
+//     }
+//   }
+//   server.setSessionHandler(echo);
+//
+// 等待直接挂在接收/发送完成的处理路径上：数据到达或发送完成时，由处理该完成事件的工作线程
+// 就地恢复协程，不经过任何队列；等待者保存在Session中，每次co_await不分配内存，协程帧取自FramePool
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+  #define IOCP_HAS_COROUTINES 1
+
+  #include "FramePool.h"
+  #include "Session.h"
+
+  #include <coroutine>
+  #include <exception>
+  #include <string_view>
+
+// 连接处理协程的返回类型：立即开始执行，结束时自行销毁帧，调用方不持有它
+class SessionTask {
+public:
+  struct promise_type {
+    SessionTask get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+
+    // 与回调中抛出的异常一样不在工作线程上吞掉
+    void unhandled_exception() noexcept { std::terminate(); }
+
+    static void* operator new(std::size_t size) { return FramePool::Allocate(size); }
+    static void operator delete(void* frame, std::size_t size) noexcept { FramePool::Release(frame, size); }
+  };
+};
+
+// 各等待类型的公共部分，经由它访问Session的协程状态
+class SessionAwaiter {
+protected:
+  explicit SessionAwaiter(Session& session)
+      : session_(session) {}
+
+  static Session::Waiter waiter(std::coroutine_handle<> handle) {
+    return {[](void* frame) { std::coroutine_handle<>::from_address(frame).resume(); }, handle.address()};
+  }
+
+  bool readReady(size_t need) { return session_.readReady(need); }
+  void suspendRead(size_t need, std::coroutine_handle<> handle) { session_.suspendRead(need, waiter(handle)); }
+  Buffer& input() { return session_.coInput_; }
+  void consumeLater(size_t n) { session_.readConsume_ = n; }
+  bool queueWrite(Payload payload, std::uint64_t& target) {
+    return session_.queueWrite(std::move(payload), target);
+  }
+  bool writeDone(std::uint64_t target) { return session_.writeDone(target); }
+  void suspendWrite(std::uint64_t target, std::coroutine_handle<> handle) {
+    session_.suspendWrite(target, waiter(handle));
+  }
+
+  Session& session_;
+};
+
+class ReadSomeAwaiter : public SessionAwaiter {
+public:
+  explicit ReadSomeAwaiter(Session& session)
+      : SessionAwaiter(session) {}
+
+  bool await_ready() { return readReady(1); }
+  void await_suspend(std::coroutine_handle<> handle) { suspendRead(1, handle); }
+  Buffer* await_resume() { return input().readableBytes() > 0 ? &input() : nullptr; }
+};
+
+class ReadExactlyAwaiter : public SessionAwaiter {
+public:
+  ReadExactlyAwaiter(Session& session, size_t n)
+      : SessionAwaiter(session)
+      , n_(n) {}
+
+  bool await_ready() { return readReady(n_); }
+  void await_suspend(std::coroutine_handle<> handle) { suspendRead(n_, handle); }
+  std::string_view await_resume() {
+    if (n_ == 0 || input().readableBytes() < n_) {
+      return {};
+    }
+    consumeLater(n_);
+    return std::string_view(input().peek(n_), n_);
+  }
+
+private:
+  size_t n_;
+};
+
+class WriteAwaiter : public SessionAwaiter {
+public:
+  WriteAwaiter(Session& session, Payload payload)
+      : SessionAwaiter(session)
+      , payload_(std::move(payload)) {}
+
+  bool await_ready() {
+    queued_ = queueWrite(std::move(payload_), target_);
+    return !queued_ || writeDone(target_);
+  }
+  void await_suspend(std::coroutine_handle<> handle) { suspendWrite(target_, handle); }
+  bool await_resume() { return queued_ && writeDone(target_); }
+
+private:
+  Payload payload_;
+  std::uint64_t target_ = 0;
+  bool queued_          = false;
+};
+
+inline ReadSomeAwaiter Session::readSome() { return ReadSomeAwaiter(*this); }
+
+inline ReadExactlyAwaiter Session::readExactly(size_t n) { return ReadExactlyAwaiter(*this, n); }
+
+inline WriteAwaiter Session::write(Payload payload) { return WriteAwaiter(*this, std::move(payload)); }
+
+#endif
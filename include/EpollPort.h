@@ -0,0 +1,101 @@
+#pragma once
+
+#ifdef __linux__
+
+  #include "CompletionPort.h"
+
+  #include <atomic>
+  #include <cstdint>
+  #include <deque>
+  #include <mutex>
+  #include <vector>
+
+// 基于epoll的模拟完成端口（emulated proactor）
+// 每个工作线程拥有独立的epoll实例与就绪队列，套接字关联时轮询分配给某个线程；
+// 投递的I/O先尝试直接完成，EAGAIN时挂起，待边沿触发的就绪事件到来后再执行读写，
+// 最后合成一个完成事件放入所属线程的就绪队列
+class EpollPort : public CompletionPort {
+public:
+  explicit EpollPort(size_t workers);
+  ~EpollPort() override;
+
+  // 创建各线程的epoll实例与唤醒eventfd
+  bool Init();
+
+  bool Listen(SOCKET listenSock) override;
+
+  bool Associate(SOCKET sock, ULONG_PTR key) override;
+
+  bool PostAccept(SOCKET listenSock, IoCtx* ctx) override;
+
+  void GetAcceptAddrs(IoCtx* ctx, sockaddr_in* localAddr, sockaddr_in* remoteAddr) override;
+
+  bool PostConnect(IoCtx* ctx) override;
+
+  bool PostRecv(IoCtx* ctx) override;
+
+  bool PostRecvReady(IoCtx* ctx) override;
+
+  bool PostSend(IoCtx* ctx) override;
+
+  bool PostSendFile(IoCtx* ctx) override;
+
+  void Shutdown(SOCKET sock) override;
+
+  void Close(SOCKET sock) override;
+
+  bool Dequeue(size_t worker, Completion* out, size_t maxCount, size_t& count, int timeoutMs) override;
+
+  void Wakeup() override;
+
+private:
+  // 单个工作线程的事件循环
+  struct Loop {
+    int epollFd = -1;
+    int wakeFd  = -1; // eventfd，其他线程投递完成事件时用于唤醒
+    std::mutex mtx;
+    std::deque<Completion> ready; // 已合成的完成事件
+  };
+
+  // 每个套接字的挂起操作，按fd下标存放，槽位分配后直到端口销毁才释放；
+  // gen在每次关联/关闭时递增，用来识别复用fd之前残留的就绪事件
+  struct SockSlot {
+    std::mutex mtx;
+    std::uint32_t gen = 0;
+    Loop* loop        = nullptr; // 完成事件投递到的线程，监听套接字为空
+    ULONG_PTR key     = 0;
+    IoCtx* recvCtx    = nullptr;
+    IoCtx* sendCtx    = nullptr;
+    std::deque<IoCtx*> acceptCtxs; // 仅监听套接字使用
+  };
+
+  EpollPort(const EpollPort&)            = delete;
+  EpollPort& operator=(const EpollPort&) = delete;
+
+  SockSlot* GetSlot(SOCKET sock);
+
+  // 在持有slot->mtx时尝试执行挂起的操作，返回false表示仍需等待就绪
+  bool TryAccept(SockSlot* slot, SOCKET listenSock, IoCtx* ctx, Completion& out);
+  bool TryRecv(IoCtx* ctx, Completion& out);
+
+  // PostRecv与PostRecvReady的公共部分，ctx->op已设置好
+  bool PostRead(IoCtx* ctx);
+  bool TrySend(IoCtx* ctx, Completion& out);
+
+  // 挂起的Connect在可写时完成，与发送共用sendCtx
+  bool TryConnect(IoCtx* ctx, Completion& out);
+
+  // 处理一个就绪事件
+  void HandleEvent(Loop* loop, std::uint64_t data, std::uint32_t events);
+
+  // 将完成事件放入loop的就绪队列，必要时唤醒该线程
+  void Complete(Loop* loop, const Completion& completion);
+
+  std::vector<std::unique_ptr<Loop>> loops_;
+  std::atomic<size_t> nextLoop_{0}; // 新连接/唤醒事件轮询分配
+
+  size_t maxSlots_ = 0;
+  std::unique_ptr<std::atomic<SockSlot*>[]> slots_;
+};
+
+#endif
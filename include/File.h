@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+using FileHandle = HANDLE;
+  #define INVALID_FILE_HANDLE INVALID_HANDLE_VALUE
+#else
+using FileHandle = int;
+  #define INVALID_FILE_HANDLE (-1)
+#endif
+
+// 只读打开的文件，供Session::sendFile使用
+// 通过shared_ptr共享，发送队列中还有引用它的数据段时不会被关闭
+class File {
+public:
+  // 只读打开path，失败时记录日志并返回nullptr
+  static std::shared_ptr<File> open(const std::string& path);
+
+  // 接管一个已打开的文件句柄，析构时关闭；Windows下句柄需要以FILE_FLAG_OVERLAPPED打开
+  explicit File(FileHandle handle)
+      : handle_(handle) {}
+
+  ~File();
+
+  FileHandle handle() const { return handle_; }
+
+  // 文件当前大小，失败返回0
+  std::uint64_t size() const;
+
+private:
+  File(const File&)            = delete;
+  File& operator=(const File&) = delete;
+
+  FileHandle handle_;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+
+// 协程帧内存池
+// 按kGranularity字节分级，释放的帧放回当前线程对应级别的空闲链表，下一个同级别的协程直接复用；
+// 超过kMaxPooledSize的帧以及线程缓存已满时直接走全局堆。帧可以在与分配时不同的线程上释放
+class FramePool {
+public:
+  static constexpr std::size_t kGranularity   = 64;
+  static constexpr std::size_t kMaxPooledSize = 4096;
+
+  // 取出至少size字节的内存，内容未初始化
+  static void* Allocate(std::size_t size);
+
+  // 归还Allocate(size)取得的内存，size必须与分配时相同
+  static void Release(void* frame, std::size_t size) noexcept;
+};
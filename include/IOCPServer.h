@@ -1,20 +1,25 @@
 #pragma once
 
+#include "CompletionPort.h"
+#include "Metrics.h"
 #include "Session.h"
+#include "SessionRegistry.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <memory>
-#include <mswsock.h>
 #include <mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
 #include <vector>
-#include <winsock2.h>
-#include <ws2tcpip.h>
 
+class ComputePool;
+class MetricsListener;
 class WorkerThread;
 
-// IOCP服务器类，实现基于IOCP的Echo服务器
+// IOCP服务器类，实现基于完成端口的Echo服务器（Windows下为IOCP，Linux下为io_uring）
 class IOCPServer {
 public:
   IOCPServer(const std::string& address, unsigned short port);
@@ -23,7 +28,104 @@ public:
 
   void setConnectedCallback(onConnectedCallback cb) { onConnected_ = cb; }
   void setMessageCallback(onMessageCallback cb) { onMessage_ = cb; }
+  void setMessageCallback(onMessageNoTimeCallback cb) {
+    onMessage_ = [cb = std::move(cb)](shared_session_ptr session, Buffer* buffer, Timestamp) {
+      cb(std::move(session), buffer);
+    };
+  }
   void setSendCompletedCallback(onSendCompletedCallback cb) { onSendComp_ = cb; }
+  void setTimeoutCallback(onTimeoutCallback cb) { onTimeout_ = cb; }
+  void setHighWatermarkCallback(onHighWatermarkCallback cb) { onHighWatermark_ = cb; }
+  void setWriteDrainedCallback(onWriteDrainedCallback cb) { onWriteDrained_ = cb; }
+
+  // 按codec分帧，收到的每个完整帧交给cb，代替onMessageCallback；codec由所有连接共享，需在Start之前设置
+  void setCodec(std::shared_ptr<const Codec> codec, onFrameCallback cb) {
+    codec_   = std::move(codec);
+    onFrame_ = std::move(cb);
+  }
+
+  // 每个新连接接入后在其所属工作线程上调用handler，通常是返回SessionTask的协程（需C++20，见Coroutine.h），
+  // 以co_await session->readSome()/readExactly(n)/write(payload)顺序地处理这个连接；
+  // 设置后不再回调onMessageCallback/onFrameCallback。需在Start之前设置
+  void setSessionHandler(onSessionCallback handler) { onSession_ = std::move(handler); }
+
+  // 新连接发送队列的高/低水位，见Session::setWriteWatermarks；需在Start之前设置
+  void setWriteWatermarks(size_t high, size_t low) {
+    highWatermark_ = high;
+    lowWatermark_  = low;
+  }
+
+  // 越过高水位的连接暂停接收，直到待发送数据回落到低水位，避免慢读者的请求继续堆积响应
+  void setPauseRecvOnHighWatermark(bool enable) { pauseRecvOnHighWatermark_ = enable; }
+
+  // 进程内所有连接待发送字节数之和的上限，超出时send丢弃数据并返回false；0表示不限制
+  void setMaxPendingSendBytes(size_t bytes) { Session::setGlobalSendLimit(bytes); }
+
+  // 以下超时设置需在Start之前调用，0表示不启用
+  // 空闲超时：既没有收到数据、发送也没有进展的时间超过timeout时关闭连接
+  void setIdleTimeout(std::chrono::milliseconds timeout) { idleTimeout_ = timeout; }
+
+  // 写超时：有数据待发送但发送持续timeout没有进展（对端不读取）时关闭连接
+  void setWriteTimeout(std::chrono::milliseconds timeout) { writeTimeout_ = timeout; }
+
+  // TCP保活：连接空闲idle后开始探测，每隔interval探测一次，由内核发现失联的对端
+  void setKeepAlive(std::chrono::milliseconds idle, std::chrono::milliseconds interval) {
+    keepAliveIdle_     = idle;
+    keepAliveInterval_ = interval;
+  }
+
+  // 空闲连接省内存模式，需在Start之前设置：连接上的数据被读空后改为投递零字节读，
+  // 等待期间session不持有任何接收缓冲区，数据到达后才从内存池取块接收；
+  // 代价是每批消息多一次投递，适合大量长连接、多数时间空闲的场景
+  void setLeanIdleRecv(bool enable) { leanIdleRecv_ = enable; }
+
+  // 工作线程每次从完成端口取出的最多事件数（默认64），需在Start之前设置；
+  // 批量越大，每次系统调用处理的事件越多，单个事件的处理延迟也相应增加
+  void setCompletionBatchSize(size_t count) { completionBatchSize_ = std::max<size_t>(count, 1); }
+
+  // 工作线程每处理完一批完成事件（以及随后的邮箱任务和定时器）后回调，
+  // 可在此合并执行每个事件都做代价较高的工作，例如统一刷出本批积累的发送
+  void setBatchCallback(onBatchCallback cb) { onBatch_ = std::move(cb); }
+
+  // 延迟统计，需在Start之前设置：为每个连接记录接收完成事件的排队时间、回调的执行时间，
+  // 以及每批发送从投递到完成的时间，同时计入各工作线程的指标（见getMetrics、Session::getLatency）；
+  // 代价是每次接收与发送多读取一两次时钟，以及每个连接约1.5 KiB的直方图
+  void setLatencyTracing(bool enable) { latencyTracing_ = enable; }
+
+  // 工作线程数，0表示取硬件并发数（默认）；需在Start之前设置
+  void setWorkerCount(size_t count) { workerCount_ = count; }
+
+  // 计算线程数，0表示不启用（默认）；需在Start之前设置。启用后消息回调可以用Session::post
+  // 把耗时的计算交给这些线程，避免阻塞同一工作线程上排在后面的完成事件
+  void setComputeThreads(size_t count) { computeThreads_ = count; }
+
+  // 分片模式，需在Start之前设置：每个工作线程拥有独立的完成端口，Linux下还各自以SO_REUSEPORT
+  // 监听同一地址，由内核把新连接分给各分片（Windows下由第0个分片接受后轮流分配）；
+  // 连接的接收、回调、发送和定时器都在所属分片的线程上执行，其他线程的send经由该线程的邮箱转交
+  void setShardedLoops(bool enable) { shardedLoops_ = enable; }
+
+  // 每个监听套接字预先投递的Accept数量范围，需在Start之前设置：从minDepth开始，
+  // 在途的Accept耗尽时立即加倍，并按最近的接受速率周期性调整，始终不超过maxDepth
+  void setAcceptDepth(size_t minDepth, size_t maxDepth) {
+    minAccepts_ = std::max<size_t>(minDepth, 1);
+    maxAccepts_ = std::max(maxDepth, minAccepts_);
+  }
+
+  // Accept深度的运行状况，各监听套接字之和
+  using AcceptStats = ::AcceptStats;
+
+  AcceptStats getAcceptStats() const;
+
+  // 汇总各工作线程的指标与当前的连接、发送队列和Accept状况，任意线程均可调用；
+  // 工作线程写入计数时不加锁，快照中各项不是同一瞬间的值
+  MetricsSnapshot getMetrics() const;
+
+  // 在address:port上开启指标导出，以Prometheus文本格式应答GET /metrics；需在Start之前设置，
+  // 端口为0时不开启（默认）。应只监听内网或本机地址
+  void setMetricsListener(const std::string& address, unsigned short port) {
+    metricsAddress_ = address;
+    metricsPort_    = port;
+  }
 
   // 启动服务器
   bool Start();
@@ -34,64 +136,185 @@ public:
   // 获取服务器状态
   bool IsRunning() const { return running_.load(std::memory_order_acquire); }
 
-  // 处理Accept完成
-  void HandleAccept(IoCtx* ctx);
+  // 处理Accept完成，shard为接受连接的分片
+  void HandleAccept(IoCtx* ctx, size_t shard);
+
+  // 异步连接address:port，需在Start之后调用。连接建立后产生与接入连接相同的Session：登记在会话表中，
+  // 由同样的工作线程处理I/O，沿用服务器的水位、保活与延迟统计设置，但不设置任何回调（包括超时检查），
+  // 由done在首个接收投递之前为它设置。返回false表示请求未能发出，此时不会回调done；
+  // Stop时尚未完成的连接被取消，也不再回调
+  bool Connect(const std::string& address, unsigned short port, onConnectCallback done);
+
+  // 处理Connect完成，error非0表示连接失败
+  void HandleConnect(IoCtx* ctx, DWORD error);
+
+  // 处理以错误完成的Accept：回收ctx，由下一次深度调整补足，避免持续出错时（如fd耗尽）空转
+  void HandleAcceptError(IoCtx* ctx, size_t shard);
 
-  void HandleRecv(std::shared_ptr<Session> session, IoCtx* ctx, size_t len);
+  // receiveTime为工作线程取出这次接收完成事件的时间
+  void HandleRecv(std::shared_ptr<Session> session, IoCtx* ctx, size_t len, Timestamp receiveTime);
 
-  void HandleSend(std::shared_ptr<Session> session, IoCtx* ctx, size_t writenBytes);
+  // 处理零字节读完成：套接字已可读，投递真正的接收
+  void HandleRecvReady(std::shared_ptr<Session> session, IoCtx* ctx);
 
-  std::shared_ptr<Session> getSession(SOCKET sock) const;
+  void HandleSend(std::shared_ptr<Session> session, IoCtx* ctx, size_t writenBytes, Timestamp completedAt);
+
+  // 工作线程处理完一批count个完成事件后调用
+  void HandleBatch(size_t count) {
+    if (onBatch_) {
+      onBatch_(count);
+    }
+  }
+
+  // 按id查找session，已断开或不存在时返回nullptr
+  std::shared_ptr<Session> getSession(SessionId id) const { return sessions_.Find(id); }
+
+  // 对当前每个session调用fn，遍历的是各分片的快照，不阻塞I/O线程上的登记与移除
+  template <typename Fn>
+  void forEachSession(Fn&& fn) const {
+    sessions_.ForEach(std::forward<Fn>(fn));
+  }
+
+  size_t getSessionCount() const { return sessions_.Size(); }
 
   // TODO:
   // bool HandleError() const;
 
-  // TODO: as private
-  void RemoveSession(SOCKET target);
+  // 从会话表中移除并中止其挂起的I/O，session在最后一个在途I/O完成后析构；可重复调用
+  void RemoveSession(const std::shared_ptr<Session>& session);
 
 private:
+  // 一个完成端口及其监听套接字；非分片模式下只有一个，由所有工作线程共享
+  struct Shard {
+    std::shared_ptr<CompletionPort> port;  // 完成端口（IOCP/io_uring/epoll），session也持有它
+    SOCKET listenSocket = INVALID_SOCKET;  // 监听套接字，不监听的分片为INVALID_SOCKET
+    std::unique_ptr<SockCtx> listenerCtx;  // Accept上下文池
+    std::unique_ptr<SockCtx> connectorCtx; // Connect上下文池
+
+    // Accept深度
+    std::atomic<size_t> acceptsPending{0};       // 在途的Accept数
+    std::atomic<size_t> acceptTarget{0};         // 目标深度
+    std::atomic<std::uint64_t> accepted{0};      // 接受的连接数
+    std::atomic<std::uint64_t> acceptFailed{0};  // 失败的Accept数
+    std::atomic<std::uint64_t> depthGrows{0};    // 调高目标深度的次数
+    std::atomic<std::uint64_t> depthShrinks{0};  // 调低目标深度的次数
+    std::atomic<std::uint64_t> acceptRate{0};    // 最近一个调整周期的接受速率（个/秒）
+    std::uint64_t acceptedAtTune = 0;            // 上次调整时的accepted，只由调整定时器访问
+    std::shared_ptr<TimerWheel> tuneWheel;       // 调整定时器所在的时间轮
+    TimerPtr tuneTimer;                          // 周期性调整Accept深度
+  };
+
   // 初始化Windows Socket
   bool InitializeWinsock();
 
-  void PreparePostAccept();
+  // 为第index个分片投递初始的Accept，并开始周期性调整深度
+  void PreparePostAccept(size_t index);
 
-  bool InitializeExtraFunc();
+  // 为shard创建监听套接字，reusePort为真时与其他分片以SO_REUSEPORT监听同一地址
+  bool CreateListenSocket(Shard& shard, bool reusePort);
 
-  // 创建监听套接字
-  bool CreateListenSocket();
+  // 工作线程数，未设置时为硬件并发数
+  size_t WorkerCount() const {
+    return workerCount_ != 0 ? workerCount_ : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
 
   // 创建完成端口
   bool CreateCompletionPort();
 
-  // 关联指定Sock至IOCP
-  bool AssociateWithIOCP(SOCKET sock, ULONG_PTR key);
+  // 关联指定Sock至完成端口
+  bool AssociateWithIOCP(CompletionPort& port, SOCKET sock, ULONG_PTR key);
 
   // 启动工作线程
   void StartWorkerThreads();
 
   // 投递Accept请求
-  bool PostAccept(IoCtx* ctx);
+  bool PostAccept(Shard& shard, IoCtx* ctx);
+
+  // 把在途的Accept补足到目标深度，reuse非空时优先复用它，用不上则回收
+  void TopUpAccepts(Shard& shard, IoCtx* reuse = nullptr);
+
+  // 把目标深度调整为target（限制在[minAccepts_, maxAccepts_]内）并记录
+  void SetAcceptTarget(Shard& shard, size_t target, std::uint64_t rate);
+
+  // 周期性地按接受速率调整目标深度
+  void TuneAcceptDepth(Shard& shard);
+
+  // 在session所属的线程上通知接入并投递首个接收
+  void StartSession(const std::shared_ptr<Session>& session);
+
+  // 为新连接分配所属的工作线程，登记后由它投递I/O、执行定时器
+  void AssignOwner(const std::shared_ptr<Session>& session, size_t shard);
+
+  // 投递新连接上的首个接收，失败时移除session
+  void PostFirstRecv(const std::shared_ptr<Session>& session);
 
   bool PostRecv(IoCtx* ctx);
 
+  bool PostRecvReady(IoCtx* ctx);
+
+  // 投递失败时回收ctx并移除其所属session
+  void AbortRecv(IoCtx* ctx);
+
+  // 为新连接开启TCP保活
+  void SetKeepAlive(SOCKET sock);
+
+  // 为session设定空闲/写超时检查
+  void ArmDeadline(const std::shared_ptr<Session>& session);
+
+  // 检查session是否超时，超时则关闭，否则按最近的截止时间重设检查
+  void CheckDeadline(const std::shared_ptr<Session>& session);
+
   // 清理资源
   void Cleanup();
 
-  std::string address_;                                           // 服务器地址
-  unsigned short port_;                                           // 服务器端口
-  SOCKET listenSocket_;                                           // 监听套接字
-  HANDLE completionPort_;                                         // 完成端口句柄
-  std::vector<std::unique_ptr<WorkerThread>> workerThreads_;      // 工作线程池
-  std::atomic<bool> running_;                                     // 服务器运行标志
-  static const size_t MAX_WORKER_THREADS = 4;                     // 工作线程数量
-  static const size_t MAX_POST_ACCEPT    = 10;                    // 最大Accept上下文数量
-  std::unique_ptr<SockCtx> listenerCxt_;                          // Accept上下文池
-  std::unordered_map<SOCKET, std::shared_ptr<Session>> sessions_; // Client session pool
-  mutable std::mutex sessionsMtx_;                                // mutex for sessions
-  LPFN_ACCEPTEX lpfnAcceptEx_{};
-  LPFN_GETACCEPTEXSOCKADDRS lpfnGetAcceptExSockAddrs_{};
+  std::string address_;                                      // 服务器地址
+  unsigned short port_;                                      // 服务器端口
+  std::vector<std::unique_ptr<Shard>> shards_;               // 分片，非分片模式下只有一个
+  std::vector<std::unique_ptr<WorkerThread>> workerThreads_; // 工作线程池，分片模式下与shards_一一对应
+  std::atomic<bool> running_;                                // 服务器运行标志
+  size_t workerCount_         = 0;                           // 工作线程数量，0表示硬件并发数
+  size_t completionBatchSize_ = 64;                          // 每次取出的最多完成事件数
+  bool shardedLoops_          = false;                       // 每个工作线程一个完成端口
+  std::atomic<size_t> nextShard_{0};                         // 单监听时轮流分配新连接，以及主动连接
+  size_t minAccepts_          = 16;                          // 每个监听套接字在途Accept数的下限
+  size_t maxAccepts_          = 1024;                        // 每个监听套接字在途Accept数的上限
+  size_t computeThreads_      = 0;                           // 计算线程数，0表示不启用
+  SessionRegistry sessions_;                                 // Client session pool
+
+  // 尚未完成的主动连接
+  struct PendingConnect {
+    onConnectCallback done;
+    size_t shard = 0;
+  };
+  std::mutex connectMtx_;
+  std::unordered_map<IoCtx*, PendingConnect> connects_;
 
   onConnectedCallback onConnected_{};
   onMessageCallback onMessage_{};
   onSendCompletedCallback onSendComp_{};
+  onTimeoutCallback onTimeout_{};
+  onHighWatermarkCallback onHighWatermark_{};
+  onWriteDrainedCallback onWriteDrained_{};
+  onFrameCallback onFrame_{};
+  onBatchCallback onBatch_{};
+  onSessionCallback onSession_{};
+
+  std::vector<std::unique_ptr<WorkerMetrics>> workerMetrics_; // 与workerThreads_一一对应，Stop后保留
+  std::shared_ptr<ComputePool> compute_; // 启用时在Start中创建，Stop后保留以供统计
+  std::unique_ptr<MetricsListener> metricsListener_;
+  std::string metricsAddress_;
+  unsigned short metricsPort_ = 0;
+  std::shared_ptr<const Codec> codec_;
+
+  bool leanIdleRecv_   = false;
+  bool latencyTracing_ = false;
+
+  size_t highWatermark_          = 0;
+  size_t lowWatermark_           = 0;
+  bool pauseRecvOnHighWatermark_ = false;
+
+  std::chrono::milliseconds idleTimeout_{0};
+  std::chrono::milliseconds writeTimeout_{0};
+  std::chrono::milliseconds keepAliveIdle_{0};
+  std::chrono::milliseconds keepAliveInterval_{0};
 };
\ No newline at end of file
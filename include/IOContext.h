@@ -1,55 +1,215 @@
 #pragma once
 #include "Buffer.h"
+#include "IoCtxPool.h"
+#include "Payload.h"
+#include "Platform.h"
 #include "callback.h"
 
-#include <WinSock2.h>
-#include <Windows.h>
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <deque>
 #include <exception>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
 
+// 每次投递接收前，session输入缓冲区中至少预留的可写空间
 #ifndef WSABUF_SIZE
   #define WSABUF_SIZE 1024 * 4 * 2
 #endif
 
+// 一次接收最多分散写入的缓冲区段数
+#ifndef MAX_RECV_BUFS
+  #define MAX_RECV_BUFS 4
+#endif
+
+// 一次发送最多聚合的数据块数量
+#ifndef MAX_SEND_BUFS
+  #define MAX_SEND_BUFS 16
+#endif
+
+// sendFile每次投递最多发送的字节数，大文件分多次完成
+#ifndef SENDFILE_CHUNK_SIZE
+  #define SENDFILE_CHUNK_SIZE (1024 * 1024)
+#endif
+
+#ifndef CACHE_LINE_SIZE
+  #define CACHE_LINE_SIZE 64
+#endif
+
 #define FMT_ERR_MSG(func, errCode) #func##" failed with error: " + std::to_string(errCode)
 
 enum class OpType {
-  UNDEFINED, // placeholader
-  ACCEPT,    // 接受连接操作
-  RECV,      // 接收数据操作
-  SEND,      // 发送数据操作
+  UNDEFINED,  // placeholader
+  ACCEPT,     // 接受连接操作
+  CONNECT,    // 发起连接操作
+  RECV,       // 接收数据操作
+  RECV_READY, // 零字节读：等待套接字可读，不占用接收缓冲区
+  SEND,       // 发送数据操作
 };
 
-struct IoCtx {
-  WSAOVERLAPPED overlapped; // Windows重叠I/O结构
-  SOCKET sock;              // 关联的套接字
-  std::vector<char> buffer; // 数据缓冲区 TODO: 在子类定义
-  WSABUF wsaBuf;            // Windows Socket缓冲区
-  OpType op;
+// 按缓存行对齐，不同线程使用的相邻对象不会伪共享
+struct alignas(CACHE_LINE_SIZE) IoCtx {
+#ifdef _WIN32
+  WSAOVERLAPPED overlapped{};                         // Windows重叠I/O结构
+  char acceptAddrs[2 * (sizeof(sockaddr_in) + 16)]{}; // AcceptEx写入的本地/远端地址
+#endif
+  SOCKET sock = INVALID_SOCKET; // 关联的套接字
+  sockaddr_in peerAddr{};       // Connect的目标地址，完成之前后端可能仍会访问
+
+  WSABUF recvBufs[MAX_RECV_BUFS]{}; // 接收直接写入session输入缓冲区的这些可写段
+  ULONG recvBufCount = 0;
 
-  IoCtx()
-      : overlapped{}
-      , sock(INVALID_SOCKET)
-      , buffer(WSABUF_SIZE)
-      , wsaBuf{static_cast<ULONG>(buffer.size()), buffer.data()}
-      , op(OpType::UNDEFINED) {}
+  std::vector<Payload> payloads;    // 本次发送聚合的数据块，持有其引用直到发送完成
+  WSABUF sendBufs[MAX_SEND_BUFS]{}; // 指向payloads中尚未发出的部分
+  ULONG sendBufCount = 0;
+#ifndef _WIN32
+  msghdr msg{}; // io_uring的SENDMSG/RECVMSG在完成前会访问它
+#endif
+
+  const File* sendFile        = nullptr; // 非空时本次发送的是文件中的一段，payloads中只有这一项
+  std::uint64_t fileOffset    = 0;       // 下一次从文件的哪里开始发送
+  std::uint64_t fileRemaining = 0;       // 文件段中尚未发送的字节数
+#ifndef _WIN32
+  int pipeFds[2]   = {-1, -1}; // io_uring经由管道splice文件数据，随对象在池中复用
+  size_t pipeBytes = 0;        // 已从文件读入管道、尚未发往套接字的字节数
+#endif
+
+  Timestamp postedAt{}; // 开启延迟统计时，这一批发送的投递时间
+
+  OpType op   = OpType::UNDEFINED;
+  IoCtx* prev = nullptr; // SockCtx中的侵入式链表
+  IoCtx* next = nullptr;
+
+  // I/O挂起期间持有所属session，完成时由工作线程取走；
+  // 保证RemoveSession之后仍在途的完成事件访问到的session有效，同时免去按套接字查表
+  std::shared_ptr<Session> session;
+
+  IoCtx() = default;
 
   explicit IoCtx(SOCKET socket)
-      : IoCtx() {
-    sock = socket;
+      : sock(socket) {}
+
+  // 本次接收准备的缓冲区总大小
+  size_t RecvCapacity() const {
+    size_t total = 0;
+    for (ULONG i = 0; i < recvBufCount; ++i) {
+      total += recvBufs[i].len;
+    }
+    return total;
+  }
+
+  // 本次发送中尚未发出的字节数
+  size_t UnsentBytes() const {
+    if (sendFile != nullptr) {
+      return static_cast<size_t>(fileRemaining);
+    }
+    size_t total = 0;
+    for (ULONG i = 0; i < sendBufCount; ++i) {
+      total += sendBufs[i].len;
+    }
+    return total;
+  }
+
+  // 在payloads末尾追加一个数据块并登记到sendBufs
+  void AddSendBuf(Payload&& data) {
+    assert(sendBufCount < MAX_SEND_BUFS);
+    payloads.emplace_back(std::move(data));
+    // WSABUF的buf不是const，但发送只会读取
+    sendBufs[sendBufCount].buf = const_cast<char*>(payloads.back().data());
+    sendBufs[sendBufCount].len = static_cast<ULONG>(payloads.back().size());
+    ++sendBufCount;
   }
 
-  void ResetBuffer() { buffer.clear(); }
+  // 本次发送文件中的一段
+  void SetSendFile(Payload&& data) {
+    assert(sendBufCount == 0 && data.file() != nullptr);
+    sendFile      = data.file();
+    fileOffset    = data.fileOffset();
+    fileRemaining = data.size();
+    payloads.emplace_back(std::move(data));
+  }
+
+  // 已发出writtenBytes字节：丢弃写完的块描述，调整首个未写完的块，返回是否仍有剩余
+  // 只移动WSABUF，数据本身留在payloads中直到ReleasePayloads
+  bool AdvanceSend(size_t writtenBytes) {
+    if (sendFile != nullptr) {
+      assert(writtenBytes <= fileRemaining);
+      fileOffset += writtenBytes;
+      fileRemaining -= writtenBytes;
+      return fileRemaining > 0;
+    }
+
+    ULONG done = 0;
+    while (done < sendBufCount && writtenBytes >= sendBufs[done].len) {
+      writtenBytes -= sendBufs[done].len;
+      ++done;
+    }
+    if (done < sendBufCount) {
+      sendBufs[done].buf += writtenBytes;
+      sendBufs[done].len -= static_cast<ULONG>(writtenBytes);
+    }
+    std::copy(sendBufs + done, sendBufs + sendBufCount, sendBufs);
+    sendBufCount -= done;
+    return sendBufCount > 0;
+  }
+
+  // 发送全部完成后释放对数据的引用，IoCtx可以继续用于下一批发送
+  void ReleasePayloads() {
+    payloads.clear();
+    sendBufCount  = 0;
+    sendFile      = nullptr;
+    fileRemaining = 0;
+  }
+
+  // 归还IoCtxPool前调用，释放发送数据与session引用
+  void Recycle() {
+    CloseAcceptSocket();
+#ifdef _WIN32
+    overlapped = {};
+#endif
+    sock = INVALID_SOCKET;
+    op   = OpType::UNDEFINED;
+    prev = next = nullptr;
+    session.reset();
+    ReleasePayloads();
+    recvBufCount = 0;
+#ifndef _WIN32
+    if (pipeBytes > 0) {
+      // 连接在文件段发完之前关闭，管道中残留的数据不能带给下一个连接
+      ClosePipe();
+      pipeBytes = 0;
+    }
+#endif
+  }
 
   ~IoCtx() {
-    if (sock != INVALID_SOCKET) {
+    CloseAcceptSocket();
+#ifndef _WIN32
+    ClosePipe();
+#endif
+  }
+
+#ifndef _WIN32
+  void ClosePipe() {
+    for (int& fd : pipeFds) {
+      if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+  }
+#endif
+
+private:
+  // 只有尚未完成的Accept/Connect持有自己的套接字，Session的套接字由Session关闭
+  void CloseAcceptSocket() {
+    if ((op == OpType::ACCEPT || op == OpType::CONNECT) && sock != INVALID_SOCKET) {
       ::closesocket(sock);
+      sock = INVALID_SOCKET;
     }
   }
 };
@@ -63,17 +223,23 @@ public:
     sock_ = INVALID_SOCKET;
     std::lock_guard<std::mutex> guard(mtx_);
     {
-      for (auto ctx : ioCtxs_) {
-        delete ctx;
+      while (head_ != nullptr) {
+        IoCtx* ctx = head_;
+        head_      = ctx->next;
+        IoCtxPool::Release(ctx);
       }
     }
   }
 
   IoCtx* newIoCtx() {
-    IoCtx* newIoCtx = new IoCtx(sock_);
+    IoCtx* newIoCtx = IoCtxPool::Acquire(sock_);
     {
       std::lock_guard<std::mutex> guard(mtx_);
-      ioCtxs_.push_back(newIoCtx);
+      newIoCtx->next = head_;
+      if (head_ != nullptr) {
+        head_->prev = newIoCtx;
+      }
+      head_ = newIoCtx;
     }
     return newIoCtx;
   }
@@ -81,18 +247,22 @@ public:
   void removeIoCtx(IoCtx* target) {
     {
       std::lock_guard<std::mutex> guard(mtx_);
-      auto it = std::find(ioCtxs_.begin(), ioCtxs_.end(), target);
-      if (it != ioCtxs_.end()) {
-        ioCtxs_.erase(it);
+      if (target->prev != nullptr) {
+        target->prev->next = target->next;
+      } else {
+        head_ = target->next;
+      }
+      if (target->next != nullptr) {
+        target->next->prev = target->prev;
       }
     }
-    delete target;
+    IoCtxPool::Release(target);
   }
 
   SOCKET getSocket() const { return sock_; }
 
 private:
   SOCKET sock_;
-  std::vector<IoCtx*> ioCtxs_;
+  IoCtx* head_ = nullptr; // 该套接字上所有IoCtx组成的双向链表
   std::mutex mtx_;
 };
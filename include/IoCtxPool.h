@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <cstddef>
+#include <cstdint>
+
+struct IoCtx;
+
+// IoCtx对象池
+// 对象从按缓存行对齐的slab中分配，释放后放回当前线程的空闲链表，
+// 线程本地缓存过多时成批归还全局链表，缓存为空时再成批取回，热路径上不加锁
+class IoCtxPool {
+public:
+  struct Stats {
+    std::uint64_t acquired = 0; // Acquire总次数
+    std::uint64_t reused   = 0; // 由空闲链表复用的次数
+    std::uint64_t created  = 0; // 新构造对象的次数
+    std::uint64_t released = 0; // Release总次数
+    std::size_t slabs      = 0; // 已分配的slab数量
+
+    // 池命中率
+    double hitRate() const { return acquired ? static_cast<double>(reused) / acquired : 0.0; }
+  };
+
+  // 取出一个已复位的IoCtx并关联到sock
+  static IoCtx* Acquire(SOCKET sock);
+
+  // 归还IoCtx，调用后不得再访问ctx
+  static void Release(IoCtx* ctx);
+
+  // 汇总所有线程的计数
+  static Stats GetStats();
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#ifdef _WIN32
+
+  #include "CompletionPort.h"
+
+  #include <mutex>
+  #include <vector>
+
+// 基于Windows IOCP的完成端口
+class IocpPort : public CompletionPort {
+public:
+  IocpPort() = default;
+  ~IocpPort() override;
+
+  // 创建完成端口句柄
+  bool Init();
+
+  bool Listen(SOCKET listenSock) override;
+
+  bool Associate(SOCKET sock, ULONG_PTR key) override;
+
+  bool PostAccept(SOCKET listenSock, IoCtx* ctx) override;
+
+  void ReserveAcceptSockets(size_t count) override;
+
+  void GetAcceptAddrs(IoCtx* ctx, sockaddr_in* localAddr, sockaddr_in* remoteAddr) override;
+
+  bool PostConnect(IoCtx* ctx) override;
+
+  bool PostRecv(IoCtx* ctx) override;
+
+  bool PostRecvReady(IoCtx* ctx) override;
+
+  bool PostSend(IoCtx* ctx) override;
+
+  bool PostSendFile(IoCtx* ctx) override;
+
+  void Shutdown(SOCKET sock) override;
+
+  void Close(SOCKET sock) override;
+
+  bool Dequeue(size_t worker, Completion* out, size_t maxCount, size_t& count, int timeoutMs) override;
+
+  void Wakeup() override;
+
+private:
+  // 获取AcceptEx等扩展函数指针
+  bool InitializeExtraFunc(SOCKET listenSock);
+
+  // 每次Dequeue最多取出的事件数
+  static constexpr size_t kMaxDequeueEntries = 256;
+
+  // 创建一个供AcceptEx使用的套接字
+  static SOCKET CreateAcceptSocket();
+
+  HANDLE completionPort_ = NULL; // 完成端口句柄
+  std::mutex spareMtx_;
+  std::vector<SOCKET> spareSockets_; // 预先创建、尚未交给AcceptEx的套接字
+  LPFN_ACCEPTEX lpfnAcceptEx_{};
+  LPFN_GETACCEPTEXSOCKADDRS lpfnGetAcceptExSockAddrs_{};
+  LPFN_TRANSMITFILE lpfnTransmitFile_{};
+  std::once_flag connectExOnce_;
+  LPFN_CONNECTEX lpfnConnectEx_{}; // 不依赖监听套接字，第一次Connect时获取
+};
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+// 多生产者单消费者的无锁任务队列（侵入式链表，Vyukov MPSC）
+// 任意线程都可以Push，只有所属的工作线程Pop；Push只做一次原子交换，不会被其他生产者阻塞。
+// 某个生产者交换后尚未链接时，Pop会暂时看不到它及其后的任务，该生产者随后的唤醒保证它们会被取走
+class Mailbox {
+public:
+  using Task = std::function<void()>;
+
+  Mailbox()
+      : head_(new Node)
+      , tail_(head_.load(std::memory_order_relaxed)) {}
+
+  ~Mailbox() {
+    Task task;
+    while (Pop(task)) {
+    }
+    delete tail_;
+  }
+
+  void Push(Task task) {
+    Node* node = new Node;
+    node->task = std::move(task);
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  // 只能在消费者线程上调用
+  bool Pop(Task& task) {
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      return false;
+    }
+    // next成为新的哨兵，取走其中的任务后释放旧哨兵
+    task  = std::move(next->task);
+    tail_ = next;
+    delete tail;
+    return true;
+  }
+
+private:
+  struct Node {
+    std::atomic<Node*> next{nullptr};
+    Task task;
+  };
+
+  Mailbox(const Mailbox&)            = delete;
+  Mailbox& operator=(const Mailbox&) = delete;
+
+  std::atomic<Node*> head_; // 生产者在此追加
+  Node* tail_;              // 当前哨兵，只由消费者访问
+};
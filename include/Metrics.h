@@ -0,0 +1,184 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+  #include <intrin.h>
+#endif
+
+// 运行指标
+// 每个工作线程拥有一组独立的计数，按缓存行对齐，只由该线程写入：热路径上既不加锁，
+// 也没有原子读改写，只是一次普通的load/store。读取方（快照、导出）可以在任意线程上随时汇总
+
+// 计数只由所属线程写入，其他线程仅在汇总时读取
+inline void bumpCounter(std::atomic<std::uint64_t>& counter, std::uint64_t n = 1) {
+  counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// 以2的幂为桶边界的直方图：0单独一桶，第i桶（i>=1）收纳[2^(i-1), 2^i)，覆盖整个uint64范围
+class Histogram {
+public:
+  static constexpr size_t kBuckets = 65;
+
+  // 汇总后的直方图
+  struct Snapshot {
+    std::uint64_t buckets[kBuckets] = {};
+    std::uint64_t count             = 0;
+    std::uint64_t sum               = 0;
+
+    void Merge(const Snapshot& other);
+
+    // 分位数q（0~1）所在桶的上界，没有样本时返回0
+    std::uint64_t Percentile(double q) const;
+  };
+
+  // 第i桶的上界（含）
+  static std::uint64_t UpperBound(size_t bucket) {
+    return bucket >= 64 ? UINT64_MAX : (std::uint64_t(1) << bucket) - 1;
+  }
+
+  // 只能由所属线程调用
+  void Record(std::uint64_t value) {
+    bumpCounter(buckets_[BucketOf(value)]);
+    bumpCounter(sum_, value);
+  }
+
+  // 累加到out中，任意线程均可调用
+  void Collect(Snapshot& out) const;
+
+private:
+  static size_t BucketOf(std::uint64_t value) {
+    if (value == 0) {
+      return 0;
+    }
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<size_t>(index) + 1;
+#else
+    return 64 - static_cast<size_t>(__builtin_clzll(value));
+#endif
+  }
+
+  std::atomic<std::uint64_t> buckets_[kBuckets] = {};
+  std::atomic<std::uint64_t> sum_{0};
+};
+
+// 消息处理各阶段的耗时，单位纳秒
+struct LatencyMetrics {
+  Histogram queueDelay; // 接收完成事件从取出到开始处理（在同一批中排在前面的事件之后等待）
+  Histogram handler;    // onMessage/onFrame回调的执行时间
+  Histogram response;   // 一批发送从投递到全部完成
+
+  struct Snapshot {
+    Histogram::Snapshot queueDelay;
+    Histogram::Snapshot handler;
+    Histogram::Snapshot response;
+
+    void Merge(const Snapshot& other);
+  };
+
+  // 累加到out中，任意线程均可调用
+  void Collect(Snapshot& out) const;
+};
+
+// 一个工作线程的指标，由WorkerThread在处理完成事件时写入
+struct alignas(64) WorkerMetrics {
+  std::atomic<std::uint64_t> batches{0};     // 取到完成事件的Dequeue次数
+  std::atomic<std::uint64_t> accepts{0};     // 成功的Accept完成
+  std::atomic<std::uint64_t> connects{0};    // 成功的Connect完成
+  std::atomic<std::uint64_t> recvs{0};       // 成功的接收完成
+  std::atomic<std::uint64_t> recvReadies{0}; // 零字节读完成
+  std::atomic<std::uint64_t> sends{0};       // 成功的发送完成
+  std::atomic<std::uint64_t> bytesIn{0};     // 接收的字节数
+  std::atomic<std::uint64_t> bytesOut{0};    // 发送的字节数
+  std::atomic<std::uint64_t> eofs{0};        // 对端关闭（零字节完成）
+  std::atomic<std::uint64_t> errors{0};      // 以错误完成的I/O
+
+  Histogram batchSize;      // 每批完成事件数
+  Histogram sendQueueBytes; // 每次发送完成后session仍待发送的字节数
+  LatencyMetrics latency;   // 开启延迟统计的session在本线程上的各阶段耗时
+
+  // 按错误码计数；不同的错误码超过kErrorSlots个时，其余的只计入errors
+  static constexpr size_t kErrorSlots = 16;
+  struct ErrorSlot {
+    std::atomic<DWORD> code{0};
+    std::atomic<std::uint64_t> count{0};
+  };
+  ErrorSlot errorCodes[kErrorSlots];
+
+  // 记录一次以错误完成的I/O，只能由所属线程调用
+  void RecordError(DWORD code);
+};
+
+// Accept深度的运行状况，各监听套接字之和
+struct AcceptStats {
+  size_t depth           = 0; // 在途的Accept数
+  size_t target          = 0; // 目标深度
+  std::uint64_t accepted = 0; // 接受的连接数
+  std::uint64_t failed   = 0; // 以错误完成或投递失败的Accept数
+  std::uint64_t grows    = 0; // 调高目标深度的次数
+  std::uint64_t shrinks  = 0; // 调低目标深度的次数
+  std::uint64_t rate     = 0; // 最近一个调整周期的接受速率（个/秒）
+};
+
+// 计算线程池的运行状况
+struct ComputeStats {
+  struct Thread {
+    size_t depth         = 0; // 队列中有待执行任务的session数
+    std::uint64_t tasks  = 0; // 执行的任务数
+    std::uint64_t steals = 0; // 从其他线程窃取的session数
+  };
+
+  std::vector<Thread> threads; // 按计算线程编号，未启用线程池时为空
+  size_t queuedTasks = 0;      // 已提交尚未执行的任务数
+};
+
+// 某一时刻的服务器指标，由IOCPServer::getMetrics汇总
+struct MetricsSnapshot {
+  // 一个工作线程的计数
+  struct Worker {
+    std::uint64_t batches     = 0;
+    std::uint64_t accepts     = 0;
+    std::uint64_t connects    = 0;
+    std::uint64_t recvs       = 0;
+    std::uint64_t recvReadies = 0;
+    std::uint64_t sends       = 0;
+    std::uint64_t bytesIn     = 0;
+    std::uint64_t bytesOut    = 0;
+    std::uint64_t eofs        = 0;
+    std::uint64_t errors      = 0;
+    LatencyMetrics::Snapshot latency;
+
+    // 处理的完成事件总数
+    std::uint64_t completions() const {
+      return accepts + connects + recvs + recvReadies + sends + eofs + errors;
+    }
+  };
+
+  std::vector<Worker> workers;                         // 按工作线程编号
+  std::vector<std::pair<DWORD, std::uint64_t>> errors; // 各错误码的次数，按错误码排序
+  Histogram::Snapshot batchSize;                       // 所有工作线程合并
+  Histogram::Snapshot sendQueueBytes;                  // 所有工作线程合并
+  LatencyMetrics::Snapshot latency;                    // 所有工作线程合并
+  size_t sessions         = 0;                         // 当前连接数
+  size_t pendingSendBytes = 0;                         // 所有连接待发送字节数之和
+  AcceptStats accept;                                  // 各监听套接字的Accept深度
+  ComputeStats compute;                                // 计算线程池
+
+  // 把一个工作线程的计数追加到workers，并合并其直方图与错误码
+  void Collect(const WorkerMetrics& metrics);
+
+  // 所有工作线程之和
+  Worker Total() const;
+
+  // Prometheus文本格式（0.0.4）
+  std::string ToPrometheus() const;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+// 供Prometheus抓取指标的最小HTTP服务
+// 在独立线程上以阻塞套接字逐个处理请求，不经过完成端口，工作线程繁忙时也能访问：
+// GET /metrics返回render生成的文本，其他路径返回404，每个请求处理完即关闭连接
+class MetricsListener {
+public:
+  using Render = std::function<std::string()>;
+
+  MetricsListener(std::string address, unsigned short port, Render render);
+  ~MetricsListener();
+
+  // 绑定地址并启动服务线程
+  bool Start();
+
+  // 停止服务线程并关闭监听套接字
+  void Stop();
+
+private:
+  MetricsListener(const MetricsListener&)            = delete;
+  MetricsListener& operator=(const MetricsListener&) = delete;
+
+  // 线程主函数
+  void ThreadProc();
+
+  // 读取一个请求并应答
+  void Serve(SOCKET client);
+
+  std::string address_;
+  unsigned short port_;
+  Render render_;
+  SOCKET listenSocket_ = INVALID_SOCKET;
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class File;
+
+// 待发送的一段只读数据，位于内存中或文件中
+// 只保存指针与长度，并持有底层内存所有者的引用计数，数据本身从不拷贝；
+// 多个Payload（例如同一缓存内容发给多个连接，或同一缓冲区的不同切片）可以共享同一块内存，
+// 最后一个引用在发送完成后释放
+class Payload {
+  using size_t = std::size_t;
+
+public:
+  Payload() = default;
+
+  // 接管vector的内存
+  explicit Payload(std::vector<char>&& data) {
+    auto owner = std::make_shared<const std::vector<char>>(std::move(data));
+    data_      = owner->data();
+    size_      = owner->size();
+    owner_     = std::move(owner);
+  }
+
+  // 接管string的内存
+  explicit Payload(std::string&& data) {
+    auto owner = std::make_shared<const std::string>(std::move(data));
+    data_      = owner->data();
+    size_      = owner->size();
+    owner_     = std::move(owner);
+  }
+
+  // 共享一块不可变的缓冲区，调用方在此之后不得再修改其内容
+  explicit Payload(std::shared_ptr<const std::vector<char>> data)
+      : data_(data ? data->data() : nullptr)
+      , size_(data ? data->size() : 0)
+      , owner_(std::move(data)) {}
+
+  explicit Payload(std::shared_ptr<const std::string> data)
+      : data_(data ? data->data() : nullptr)
+      , size_(data ? data->size() : 0)
+      , owner_(std::move(data)) {}
+
+  // 由owner保证[data, data + len)在其存活期间有效，例如mmap的只读文件
+  Payload(std::shared_ptr<const void> owner, const char* data, size_t len)
+      : data_(data)
+      , size_(len)
+      , owner_(std::move(owner)) {}
+
+  // 文件中从offset开始的len字节，由sendFile使用，发送时交给内核直接从文件传输
+  static Payload fromFile(std::shared_ptr<const File> file, std::uint64_t offset, size_t len) {
+    Payload payload;
+    payload.file_       = file.get();
+    payload.fileOffset_ = offset;
+    payload.size_       = len;
+    payload.owner_      = std::move(file);
+    return payload;
+  }
+
+  // 同一块内存（或同一文件）中的[offset, offset + len)，与原Payload共享所有者
+  Payload slice(size_t offset, size_t len) const {
+    assert(offset <= size_ && len <= size_ - offset);
+    if (file_ != nullptr) {
+      Payload payload(*this);
+      payload.fileOffset_ += offset;
+      payload.size_ = len;
+      return payload;
+    }
+    return Payload(owner_, data_ + offset, len);
+  }
+
+  // 内存数据的起始地址，文件数据段为nullptr
+  const char* data() const { return data_; }
+
+  // 文件数据段所在的文件，内存数据为nullptr
+  const File* file() const { return file_; }
+
+  std::uint64_t fileOffset() const { return fileOffset_; }
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+private:
+  const char* data_         = nullptr;
+  size_t size_              = 0;
+  const File* file_         = nullptr;
+  std::uint64_t fileOffset_ = 0;
+  std::shared_ptr<const void> owner_;
+};
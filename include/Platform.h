@@ -0,0 +1,53 @@
+#pragma once
+
+// 平台适配层：Windows下直接使用Winsock，Linux下提供同名的最小类型/函数，
+// 让上层代码保持Winsock风格的写法
+#ifdef _WIN32
+  #include <WinSock2.h>
+  #include <Windows.h>
+  #include <mswsock.h>
+  #include <ws2tcpip.h>
+
+  #include <cinttypes>
+
+  // SOCKET的printf格式，用法同PRIu64："socket %" PRIsock
+  #define PRIsock PRIuPTR
+#else
+  #include <arpa/inet.h>
+  #include <cerrno>
+  #include <cstddef>
+  #include <cstdint>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <sys/socket.h>
+  #include <sys/uio.h>
+  #include <unistd.h>
+
+using SOCKET    = int;
+using DWORD     = std::uint32_t;
+using ULONG     = std::uint32_t;
+using ULONG_PTR = std::uintptr_t;
+using BOOL      = int;
+
+  #ifndef TRUE
+    #define TRUE 1
+  #endif
+  #ifndef FALSE
+    #define FALSE 0
+  #endif
+
+  #define INVALID_SOCKET (-1)
+  #define SOCKET_ERROR   (-1)
+  #define PRIsock        "d"
+
+// 与iovec布局一致，WSABUF数组可以直接交给readv/writev/sendmsg
+struct WSABUF {
+  char* buf;
+  std::size_t len;
+};
+static_assert(sizeof(WSABUF) == sizeof(iovec), "WSABUF must be layout-compatible with iovec");
+
+inline int closesocket(SOCKET sock) { return ::close(sock); }
+
+inline int WSAGetLastError() { return errno; }
+#endif
@@ -1,18 +1,107 @@
 #pragma once
 
+#include "Codec.h"
+#include "File.h"
 #include "IOContext.h"
+#include "Metrics.h"
+#include "TimerWheel.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+
+class CompletionPort;
+class ComputePool;
+class WorkerThread;
+class SessionAwaiter;
+class ReadSomeAwaiter;
+class ReadExactlyAwaiter;
+class WriteAwaiter;
+
+// 会话id，由SessionRegistry分配，进程内不会复用；0表示尚未登记
+using SessionId = std::uint64_t;
 
 class Session : public std::enable_shared_from_this<Session> {
   friend class IOCPServer;
+  friend class SessionRegistry;
+  friend class SessionAwaiter;
+  friend class ComputePool;
 
 public:
-  Session(SOCKET sock, sockaddr_in* localAddr, sockaddr_in* remoteAddr);
+  // session共同持有完成端口：服务器Stop之后仍存活的session（在途I/O或调用方持有的引用）
+  // 析构时关闭套接字仍需要它
+  Session(std::shared_ptr<CompletionPort> port,
+          SOCKET sock,
+          sockaddr_in* localAddr,
+          sockaddr_in* remoteAddr);
+
+  ~Session();
+
+  SessionId getId() const { return id_; }
 
   std::string getLocalAddr() const { return localAddr_; }
 
   std::string getRemoteAddr() const { return remoteAddr_; }
 
-  void send(const void* data, size_t len);
+  // 以下send在连接已关闭，或进程内待发送的总字节数将超过setGlobalSendLimit的上限时
+  // 丢弃数据并返回false
+
+  // 拷贝data后发送
+  bool send(const void* data, size_t len);
+
+  // 接管data的内存发送，不拷贝
+  bool send(std::vector<char>&& data);
+  bool send(std::string&& data);
+
+  // 发送共享的只读数据（或其切片），不拷贝；引用在这段数据发送完成后释放
+  bool send(Payload payload);
+
+  // 发送文件中从offset开始的length字节，length为0表示直到文件末尾；与send()的数据保持先后顺序。
+  // 数据由内核直接从文件传输到套接字（sendfile/TransmitFile），大文件分块发送，
+  // 全部发出后回调onSendCompletedCallback。文件无法打开、范围为空或超出文件末尾，
+  // 以及send()拒绝时（连接已关闭、超出全局上限）返回false
+  bool sendFile(const std::string& path, std::uint64_t offset = 0, std::uint64_t length = 0);
+  bool sendFile(std::shared_ptr<const File> file, std::uint64_t offset = 0, std::uint64_t length = 0);
+
+  // 按setCodec设置的编解码器把body编码为一帧发送，帧头、内容和分隔符一次入队，不会与其他发送交错；
+  // 未设置编解码器或长度不符合要求时返回false
+  bool sendFrame(Payload body);
+
+  // 在delay后于工作线程上执行fn，session已断开时不再执行；返回的定时器可交给cancelTimer。
+  // 取消与到期同时发生时fn仍可能执行一次；session尚未接入时返回nullptr
+  TimerPtr runAfter(std::chrono::milliseconds delay, std::function<void(shared_session_ptr)> fn);
+
+  void cancelTimer(const TimerPtr& timer);
+
+  // 把fn交给计算线程池（IOCPServer::setComputeThreads）执行，不占用I/O工作线程；同一session的任务
+  // 按提交顺序依次执行，结果经send发回。未启用线程池或连接已关闭时返回false
+  bool post(ComputeTask fn);
+
+  // 中止该连接上挂起的I/O，套接字在session析构时关闭；可重复调用
+  void shutdown();
+
+  bool isClosed() const { return closed_.load(std::memory_order_acquire); }
+
+  // 已交给send但尚未发出的内存数据字节数（含正在发送的部分）；sendFile的文件段不占用内存，不计入，
+  // 因而也不触发水位与进程内上限
+  size_t getPendingSendBytes() const { return pendingBytes_.load(std::memory_order_relaxed); }
+
+  // 发送队列水位，high为0表示不启用：待发送字节数（getPendingSendBytes）达到high时回调onHighWatermark，
+  // 之后回落到low以下时回调onWriteDrained；两者都只在越过边界时触发一次
+  void setWriteWatermarks(size_t high, size_t low) {
+    highWatermark_ = high;
+    lowWatermark_  = low < high ? low : high;
+  }
+
+  // 进程内所有session待发送字节数之和的上限，0表示不限制
+  static void setGlobalSendLimit(size_t bytes) {
+    globalSendLimit_.store(bytes, std::memory_order_relaxed);
+  }
+
+  static size_t getGlobalPendingSendBytes() {
+    return globalPendingBytes_.load(std::memory_order_relaxed);
+  }
 
   std::unique_ptr<SockCtx>& getSockCtx() { return sockCtx_; }
 
@@ -20,37 +109,157 @@ public:
 
   void setConnectedCallback(onConnectedCallback cb) { onConnected_ = cb; }
   void setMessageCallback(onMessageCallback cb) { onMessage_ = cb; }
+  void setMessageCallback(onMessageNoTimeCallback cb) {
+    onMessage_ = [cb = std::move(cb)](shared_session_ptr session, Buffer* buffer, Timestamp) {
+      cb(std::move(session), buffer);
+    };
+  }
   void setSendCompletedCallback(onSendCompletedCallback cb) { onSendComp_ = cb; }
+  void setHighWatermarkCallback(onHighWatermarkCallback cb) { onHighWatermark_ = cb; }
+  void setWriteDrainedCallback(onWriteDrainedCallback cb) { onWriteDrained_ = cb; }
+
+  // 设置分帧编解码器后，收到的数据按帧交给cb，不再回调onMessageCallback；应在接入时设置
+  void setCodec(std::shared_ptr<const Codec> codec, onFrameCallback cb) {
+    codec_   = std::move(codec);
+    onFrame_ = std::move(cb);
+  }
+
+  // 协程接口，定义在Coroutine.h中（需以C++20编译）；只能在IOCPServer::setSessionHandler为该连接
+  // 启动的协程中co_await，协程在完成事件所在的工作线程上就地恢复，连接关闭时在调用shutdown的线程上恢复。
+  // readSome：等到至少有1字节可读，返回协程的输入缓冲区，由协程自行取出数据；连接已关闭且没有剩余数据时为nullptr
+  ReadSomeAwaiter readSome();
+
+  // readExactly：等到至少有n字节可读，返回这n字节的连续视图，下一次读取时丢弃；
+  // 连接在数据足够之前关闭时返回空视图
+  ReadExactlyAwaiter readExactly(size_t n);
+
+  // write：发送payload并等到它全部交给内核，期间不阻塞工作线程；连接已关闭或发送被丢弃时返回false
+  WriteAwaiter write(Payload payload);
+
+  // 开始记录该session各阶段的耗时（同时计入所在工作线程的指标），应在接入时调用
+  void enableLatencyTracing() { latency_ = std::make_unique<LatencyMetrics>(); }
+
+  // 该session各阶段的耗时，未开启延迟统计时为空
+  LatencyMetrics::Snapshot getLatency() const;
 
 private:
   Session(const Session&) = delete;
 
   Session operator=(const Session&) = delete;
 
-  void handleRecv(const void* data, size_t len /*, timestamp */);
+  // 为ctx准备接收：在inputBuf_尾部预留可写空间并导出到ctx->recvBufs
+  void prepareRecv(IoCtx* ctx);
+
+  // 接收完成，len字节已由内核直接写入inputBuf_；receiveTime为取出完成事件的时间
+  void handleRecv(size_t len, Timestamp receiveTime);
+
+  // 按codec_从inputBuf_中依次取出完整的帧交给onFrame_
+  void handleFrames();
 
   void handleConnected();
 
-  void handleSendUncompleted(IoCtx* ctx, size_t writtenBytes);
+  // 发送完成了len字节，fromFile表示这些字节来自文件段；越过高水位后回落到低水位时回调onWriteDrained，
+  // 并返回暂停中的接收IoCtx（没有则为nullptr），由调用方重新投递
+  IoCtx* handleSendProgress(size_t len, bool fromFile);
+
+  // 待发送字节数（及进程内总量）减少len，用于发出或丢弃的内存数据；需持有sendMtx_，返回剩余的待发送字节数
+  size_t releasePendingLocked(size_t len);
+
+  // 处于高水位之上时暂存接收IoCtx（连同其持有的session引用），返回是否已暂存
+  bool pauseRecvIfHighWatermark(IoCtx* ctx);
+
+  // 把parts中的数据作为一个整体加入发送队列；queuedEnd非空时返回这些数据全部发出时的累计发送字节数
+  bool enqueue(Payload* parts, size_t count, std::uint64_t* queuedEnd = nullptr);
 
-  void handleSendCompleted(IoCtx* ctx);
+  // 协程等待者：挂起的协程帧及恢复它的函数，在C++17下也能保存与恢复
+  struct Waiter {
+    void (*resume)(void* frame) = nullptr;
+    void* frame                 = nullptr;
+  };
+
+  // 在coMtx_内启动协程，此后收到的数据转入coInput_
+  void startCoroutine(const onSessionCallback& handler);
+
+  // 以下由SessionAwaiter在协程中（已持有coMtx_）调用
+  // 先丢弃上一次readExactly的数据，返回是否已有need字节可读或连接已关闭
+  bool readReady(size_t need);
+  void suspendRead(size_t need, Waiter waiter);
+  // 把payload加入发送队列，target为它全部发出时的累计发送字节数
+  bool queueWrite(Payload payload, std::uint64_t& target);
+  bool writeDone(std::uint64_t target);
+  void suspendWrite(std::uint64_t target, Waiter waiter);
+
+  // 条件满足或连接已关闭时恢复等待中的协程，调用方持有coMtx_
+  void wakeReader();
+  void wakeWriter();
+
+  void handleSendUncompleted(IoCtx* ctx);
+
+  // 一批发送全部完成，completedAt为取出完成事件的时间
+  void handleSendCompleted(IoCtx* ctx, Timestamp completedAt);
 
   void doSendNext(IoCtx* ioCtx);
 
   void trySendNext(IoCtx* ioCtx = nullptr);
 
+  // 按ctx中是内存数据还是文件投递发送，失败时结束本次发送并回收ctx
+  void postSend(IoCtx* ctx);
+
 private:
+  std::shared_ptr<CompletionPort> port_;
+  SessionId id_ = 0;
   std::unique_ptr<SockCtx> sockCtx_;
   std::string localAddr_;
   std::string remoteAddr_;
 
   Buffer inputBuf_;
-  // std::mutex inputMtx_; 链式post read，无需mtx
-  std::deque<std::vector<char>> sendQueue_;
-  std::mutex sendMtx_;
+  // std::mutex inputMtx_; 链式post read，无需mtx；同一时刻只有一个接收挂起，它直接写入inputBuf_
+  std::shared_ptr<const Codec> codec_;
+  size_t codecScanned_ = 0; // 编解码器在当前不完整帧上的解析进度
+  std::deque<Payload> sendQueue_;
+  std::mutex sendMtx_;                  // 同时保护下面的水位状态
+  std::atomic<size_t> pendingBytes_{0}; // 在sendMtx_内修改，读取可不加锁
+  size_t highWatermark_      = 0;
+  size_t lowWatermark_       = 0;
+  bool aboveHighWatermark_   = false;
+  IoCtx* pausedRecv_         = nullptr; // 因高水位暂停的接收
+  std::uint64_t sentBytes_   = 0;       // 累计发出的字节数（含文件段），协程的write据此判断完成
+  std::uint64_t queuedBytes_ = 0;       // 累计入队的字节数（含文件段）
+
+  static std::atomic<size_t> globalPendingBytes_;
+  static std::atomic<size_t> globalSendLimit_;
   std::atomic<bool> isSending_ = {false};
+  std::atomic<bool> closed_    = {false};
+
+  // 最近一次收到数据、发送开始或取得进展的时间（TimerWheel::NowMs），只用于超时判断
+  std::atomic<std::int64_t> lastRecvMs_{TimerWheel::NowMs()};
+  std::atomic<std::int64_t> lastSendMs_{TimerWheel::NowMs()};
+  std::shared_ptr<TimerWheel> timers_;      // 所属工作线程的时间轮，接入时设置
+  WorkerThread* loop_ = nullptr;            // 分片模式下所属的工作线程，其他线程的发送经它的邮箱转交
+  TimerPtr deadlineTimer_;                  // 空闲/写超时检查，由IOCPServer设定
+  std::unique_ptr<LatencyMetrics> latency_; // 各阶段耗时，未开启延迟统计时为空
+
+  // 协程模式：协程总是在持有coMtx_时执行，与接收、发送完成和关闭时的唤醒互斥；
+  // 接收完成后数据从inputBuf_转入coInput_，协程读取时不会与在途接收写入的inputBuf_冲突
+  bool coroutine_ = false;
+  std::recursive_mutex coMtx_;
+  Buffer coInput_;
+  size_t readNeed_           = 0;
+  size_t readConsume_        = 0; // readExactly交出、下一次读取时丢弃的字节数
+  std::uint64_t writeTarget_ = 0;
+  Waiter reader_;
+  Waiter writer_;
+
+  // 计算任务：computeScheduled_期间本session位于某个计算线程的队列中或正在执行，其他线程不会再放入
+  std::shared_ptr<ComputePool> compute_; // 接入时由IOCPServer设置，未启用时为空
+  std::mutex computeMtx_;
+  std::vector<ComputeTask> computeTasks_;
+  bool computeScheduled_ = false;
 
   onConnectedCallback onConnected_;
   onMessageCallback onMessage_;
   onSendCompletedCallback onSendComp_;
+  onHighWatermarkCallback onHighWatermark_;
+  onWriteDrainedCallback onWriteDrained_;
+  onFrameCallback onFrame_;
 };
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "IOContext.h"
+#include "Session.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+// 分片的会话表
+// 会话以64位id为键，低位为分片下标，高位为单调递增的序号，id永不复用，
+// 因此不会像SOCKET值那样被操作系统回收后指向新的连接。
+// 每个分片独立的读写锁，查找与遍历只加共享锁，遍历时先拷贝快照再在锁外回调。
+class SessionRegistry {
+public:
+  // shards为0时按硬件并发数自动选择，结果向上取整为2的幂
+  explicit SessionRegistry(size_t shards = 0);
+
+  // 登记session并返回分配给它的id
+  SessionId Add(std::shared_ptr<Session> session);
+
+  // 按id查找，不存在时返回nullptr
+  std::shared_ptr<Session> Find(SessionId id) const;
+
+  // 移除并返回被移除的session，不存在时返回nullptr
+  std::shared_ptr<Session> Remove(SessionId id);
+
+  // 当前所有session的快照
+  std::vector<std::shared_ptr<Session>> Snapshot() const;
+
+  // 依次对每个session调用fn(const std::shared_ptr<Session>&)，回调时不持有分片锁
+  template <typename Fn>
+  void ForEach(Fn&& fn) const {
+    std::vector<std::shared_ptr<Session>> batch;
+    for (const auto& shard : shards_) {
+      batch.clear();
+      shard->CopyTo(batch);
+      for (const auto& session : batch) {
+        fn(session);
+      }
+    }
+  }
+
+  // 当前session数量
+  size_t Size() const;
+
+  // 移除全部session并返回它们
+  std::vector<std::shared_ptr<Session>> Clear();
+
+  size_t ShardCount() const { return shards_.size(); }
+
+private:
+  struct alignas(CACHE_LINE_SIZE) Shard {
+    mutable std::shared_mutex mtx;
+    std::unordered_map<SessionId, std::shared_ptr<Session>> sessions;
+    std::uint64_t nextSeq = 0; // 在写锁内递增
+
+    void CopyTo(std::vector<std::shared_ptr<Session>>& out) const;
+  };
+
+  Shard& ShardOf(SessionId id) const { return *shards_[id & shardMask_]; }
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  SessionId shardMask_;
+  unsigned shardBits_;
+  std::atomic<size_t> nextShard_{0}; // 新session轮询分配分片
+};
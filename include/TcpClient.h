@@ -0,0 +1,87 @@
+#pragma once
+
+#include "callback.h"
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class IOCPServer;
+
+// 连向同一个对端的主动连接，以及这些连接的保活池
+// 连接经IOCPServer::Connect建立，与接入连接一样是Session，由服务器的工作线程处理I/O。
+// Acquire优先取出最近归还的空闲连接（最热的连接），没有可用连接时新建；用完后Release归还，
+// 池满、连接已关闭或空闲超过idleTimeout的连接被关闭。失效的空闲连接在下次访问池时才清理。
+// 与其他session一样，池中的连接不能活过服务器：应在服务器Stop之前析构TcpClient或调用Clear；
+// 析构之后才完成的预热连接直接关闭
+class TcpClient {
+public:
+  TcpClient(IOCPServer& server, std::string address, unsigned short port);
+  ~TcpClient();
+
+  // 以下设置在每条新连接建立时、投递首个接收之前应用于它，应在发起连接之前设置
+  void setConnectedCallback(onConnectedCallback cb) { onConnected_ = std::move(cb); }
+  void setMessageCallback(onMessageCallback cb) { onMessage_ = std::move(cb); }
+
+  // 池中最多保留的空闲连接数，0表示不保留
+  void setMaxIdle(size_t count);
+
+  // 空闲连接的最长保留时间，0表示不限制
+  void setIdleTimeout(std::chrono::milliseconds timeout);
+
+  // 新建一条连接，不经过池；done的含义同IOCPServer::Connect
+  bool Connect(onConnectCallback done);
+
+  // 取一条连接：有可用的空闲连接时在调用线程上立即回调done，否则新建连接
+  bool Acquire(onConnectCallback done);
+
+  // 归还Acquire得到的连接，调用方此后不应再使用它
+  void Release(const shared_session_ptr& session);
+
+  // 预先建立连接，使空闲连接（含正在建立的）达到count条，不超过maxIdle；返回发起的连接数
+  size_t Prewarm(size_t count);
+
+  // 当前空闲的连接数
+  size_t getIdleCount();
+
+  // 关闭所有空闲连接
+  void Clear();
+
+private:
+  TcpClient(const TcpClient&)            = delete;
+  TcpClient& operator=(const TcpClient&) = delete;
+
+  using Clock = std::chrono::steady_clock;
+
+  struct IdleEntry {
+    shared_session_ptr session;
+    Clock::time_point since; // 归还的时间
+  };
+
+  // 空闲连接池，由仍在建立中的预热连接共同持有
+  struct Pool {
+    std::mutex mtx;
+    std::vector<IdleEntry> idle; // 按归还时间排列，末尾最热
+    size_t maxIdle = 16;
+    size_t warming = 0;          // 正在建立、建立后放入池中的连接数
+    std::chrono::milliseconds idleTimeout{0};
+
+    // 放回一条连接，不能保留时关闭它
+    void Put(const shared_session_ptr& session);
+
+    // 清理已关闭或已超时的空闲连接，需持有mtx；被清理的连接追加到expired，由调用方在锁外关闭
+    void PruneLocked(Clock::time_point now, std::vector<shared_session_ptr>& expired);
+  };
+
+  IOCPServer& server_;
+  std::string address_;
+  unsigned short port_;
+
+  onConnectedCallback onConnected_{};
+  onMessageCallback onMessage_{};
+
+  std::shared_ptr<Pool> pool_;
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// 线程缓存对象池的公共部分，IoCtxPool与ChunkPool各实例化一份
+// 对象释放后放回当前线程的空闲链表，线程本地缓存过多时成批归还全局链表，缓存为空时再成批取回，
+// 热路径上不加锁；全局链表超过kMaxGlobalFree时，多出的对象交给Source真正释放。
+// Source是对象的来源，作为全局链表的成员随之析构：
+//   T* Create();          缓存与全局链表都为空时新建一个对象，可能由多个线程同时调用
+//   void Destroy(T* obj); 释放一个不再缓存的对象，在全局链表的锁内调用
+template <typename T, typename Source, std::size_t kMaxGlobalFree = SIZE_MAX>
+class ThreadCachePool {
+public:
+  static constexpr std::size_t kBatch     = 32;         // 线程缓存与全局链表之间一次搬运的数量
+  static constexpr std::size_t kMaxCached = kBatch * 2; // 线程缓存上限，超过后归还一批
+
+  struct Counters {
+    std::uint64_t acquired = 0; // Acquire总次数
+    std::uint64_t reused   = 0; // 由空闲链表复用的次数
+    std::uint64_t created  = 0; // 由Source新建的次数
+    std::uint64_t released = 0; // Release总次数
+    std::uint64_t freed    = 0; // 超出全局链表上限而交给Source释放的次数
+  };
+
+  // 取出一个缓存的对象，没有时由Source新建
+  static T* Acquire() {
+    ThreadCache& cache = localCache();
+    bump(cache.counters.acquired);
+
+    if (cache.freeList.empty()) {
+      refill(cache);
+    }
+
+    if (!cache.freeList.empty()) {
+      T* obj = cache.freeList.back();
+      cache.freeList.pop_back();
+      bump(cache.counters.reused);
+      return obj;
+    }
+
+    bump(cache.counters.created);
+    return global().source.Create();
+  }
+
+  // 归还对象，调用后不得再访问obj
+  static void Release(T* obj) {
+    ThreadCache& cache = localCache();
+    bump(cache.counters.released);
+    cache.freeList.push_back(obj);
+
+    if (cache.freeList.size() > kMaxCached) {
+      // 保留最近释放的（缓存中较热的）对象，把较早的一批还给全局链表
+      GlobalPool& pool = global();
+      std::size_t freed;
+      {
+        std::lock_guard<std::mutex> guard(pool.mtx);
+        freed = giveBack(pool, cache.freeList.data(), kBatch);
+      }
+      bump(cache.counters.freed, freed);
+      cache.freeList.erase(cache.freeList.begin(), cache.freeList.begin() + kBatch);
+    }
+  }
+
+  // 汇总所有线程的计数
+  static Counters GetCounters() {
+    GlobalPool& pool = global();
+    std::lock_guard<std::mutex> guard(pool.mtx);
+
+    Counters total = pool.retired;
+    for (ThreadCache* cache : pool.caches) {
+      cache->counters.AddTo(total);
+    }
+    return total;
+  }
+
+  static Source& GetSource() { return global().source; }
+
+private:
+  // 计数只由所属线程写入，其他线程仅在GetCounters时读取
+  struct AtomicCounters {
+    std::atomic<std::uint64_t> acquired{0};
+    std::atomic<std::uint64_t> reused{0};
+    std::atomic<std::uint64_t> created{0};
+    std::atomic<std::uint64_t> released{0};
+    std::atomic<std::uint64_t> freed{0};
+
+    void AddTo(Counters& out) const {
+      out.acquired += acquired.load(std::memory_order_relaxed);
+      out.reused += reused.load(std::memory_order_relaxed);
+      out.created += created.load(std::memory_order_relaxed);
+      out.released += released.load(std::memory_order_relaxed);
+      out.freed += freed.load(std::memory_order_relaxed);
+    }
+  };
+
+  struct ThreadCache;
+
+  struct GlobalPool {
+    std::mutex mtx;
+    std::vector<T*> freeList;
+    std::vector<ThreadCache*> caches;
+    Counters retired; // 已退出线程的计数
+    Source source;
+
+    ~GlobalPool() {
+      for (T* obj : freeList) {
+        source.Destroy(obj);
+      }
+    }
+  };
+
+  struct ThreadCache {
+    std::vector<T*> freeList;
+    AtomicCounters counters;
+
+    ThreadCache() {
+      freeList.reserve(kMaxCached + 1);
+      GlobalPool& pool = global(); // 保证GlobalPool先于线程缓存构造、后于其析构
+      std::lock_guard<std::mutex> guard(pool.mtx);
+      pool.caches.push_back(this);
+    }
+
+    ~ThreadCache() {
+      GlobalPool& pool = global();
+      std::lock_guard<std::mutex> guard(pool.mtx);
+      pool.retired.freed += giveBack(pool, freeList.data(), freeList.size());
+      counters.AddTo(pool.retired);
+      pool.caches.erase(std::find(pool.caches.begin(), pool.caches.end(), this));
+    }
+  };
+
+  static GlobalPool& global() {
+    static GlobalPool pool;
+    return pool;
+  }
+
+  static ThreadCache& localCache() {
+    thread_local ThreadCache cache;
+    return cache;
+  }
+
+  static void bump(std::atomic<std::uint64_t>& counter, std::uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  // 从全局链表取回一批对象
+  static void refill(ThreadCache& cache) {
+    GlobalPool& pool = global();
+    std::lock_guard<std::mutex> guard(pool.mtx);
+    std::size_t n = std::min(kBatch, pool.freeList.size());
+    cache.freeList.insert(cache.freeList.end(), pool.freeList.end() - n, pool.freeList.end());
+    pool.freeList.resize(pool.freeList.size() - n);
+  }
+
+  // 把objs归还全局链表，超过上限的部分交给Source释放，返回释放的个数；需持有pool.mtx
+  static std::size_t giveBack(GlobalPool& pool, T* const* objs, std::size_t n) {
+    std::size_t room = kMaxGlobalFree - std::min(kMaxGlobalFree, pool.freeList.size());
+    std::size_t keep = std::min(n, room);
+    pool.freeList.insert(pool.freeList.end(), objs, objs + keep);
+    for (std::size_t i = keep; i < n; ++i) {
+      pool.source.Destroy(objs[i]);
+    }
+    return n - keep;
+  }
+};
+
+// 从按alignof(T)对齐的slab中依次切出对象，对象只随slab一起析构，不单独释放；
+// 用作ThreadCachePool的Source时全局链表不应设上限
+template <typename T, std::size_t kSlabObjects = 64>
+class SlabSource {
+public:
+  SlabSource() = default;
+
+  ~SlabSource() {
+    for (std::size_t i = 0; i < slabs_.size(); ++i) {
+      std::size_t constructed = (i + 1 == slabs_.size()) ? slabUsed_ : kSlabObjects;
+      for (std::size_t j = 0; j < constructed; ++j) {
+        slabs_[i][j].~T();
+      }
+      ::operator delete(slabs_[i], std::align_val_t(alignof(T)));
+    }
+  }
+
+  T* Create() {
+    void* slot;
+    {
+      std::lock_guard<std::mutex> guard(mtx_);
+      if (slabUsed_ == kSlabObjects) {
+        void* slab = ::operator new(sizeof(T) * kSlabObjects, std::align_val_t(alignof(T)));
+        slabs_.push_back(static_cast<T*>(slab));
+        slabUsed_ = 0;
+      }
+      slot = slabs_.back() + slabUsed_++;
+    }
+    return new (slot) T();
+  }
+
+  void Destroy(T* /* obj */) {} // 随slab一起析构
+
+  std::size_t SlabCount() {
+    std::lock_guard<std::mutex> guard(mtx_);
+    return slabs_.size();
+  }
+
+private:
+  SlabSource(const SlabSource&)            = delete;
+  SlabSource& operator=(const SlabSource&) = delete;
+
+  std::mutex mtx_;
+  std::vector<T*> slabs_;
+  std::size_t slabUsed_ = kSlabObjects; // 最后一个slab中已分出的对象数
+};
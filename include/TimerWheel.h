@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+class TimerWheel;
+
+// 时间轮槽位双向链表的节点
+struct TimerLink {
+  TimerLink* prev = nullptr;
+  TimerLink* next = nullptr;
+};
+
+// 定时器，由TimerWheel::Create创建；同一个定时器可以反复Arm/Cancel，不再分配内存
+class Timer : private TimerLink {
+public:
+  using Callback = std::function<void()>;
+
+  explicit Timer(Callback cb)
+      : callback_(std::move(cb)) {}
+
+  // 是否已设定且尚未触发
+  bool armed() const { return prev != nullptr; }
+
+private:
+  friend class TimerWheel;
+
+  Timer(const Timer&)            = delete;
+  Timer& operator=(const Timer&) = delete;
+
+  std::uint64_t expire_ = 0;    // 到期的tick
+  std::shared_ptr<Timer> self_; // 设定期间由时间轮持有，保证触发时对象存活
+  Callback callback_;
+};
+
+using TimerPtr = std::shared_ptr<Timer>;
+
+// 分层时间轮，4层×256槽，第0层每槽一个tick
+// 设定/取消/重设都是O(1)的链表操作；推进时每个tick只处理第0层的一个槽，
+// 第0层转满一圈时才把上一层对应槽里的定时器下放一层，不随定时器总数做逐个扫描
+// 可以在任意线程设定/取消，回调在调用Advance的线程上、不持有锁时执行；
+// 回调执行前定时器可能刚被其他线程重设，因此回调应自行确认条件是否真正满足
+class TimerWheel {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(10));
+  ~TimerWheel();
+
+  // 单调时钟的当前毫秒数，用于记录活动时间
+  static std::int64_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch())
+        .count();
+  }
+
+  // 创建一个未设定的定时器
+  static TimerPtr Create(Timer::Callback cb) { return std::make_shared<Timer>(std::move(cb)); }
+
+  // 在delay后触发timer，已设定的定时器按新的时间重设
+  void Arm(const TimerPtr& timer, std::chrono::milliseconds delay);
+
+  // 取消timer，未设定时什么也不做
+  void Cancel(const TimerPtr& timer);
+
+  // 推进到当前时间并执行到期的回调，返回触发的个数；还没有定时器到期时不加锁直接返回
+  size_t Advance();
+
+  // 距最早的定时器到期还有多少毫秒，不超过maxMs；没有定时器时返回maxMs
+  int NextTimeoutMs(int maxMs) const;
+
+  size_t Size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr size_t kLevels   = 4;
+  static constexpr size_t kSlotBits = 8;
+  static constexpr size_t kSlots    = size_t(1) << kSlotBits;
+  static constexpr size_t kSlotMask = kSlots - 1;
+
+  TimerWheel(const TimerWheel&)            = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // 以下均需持有mtx_
+  void Insert(Timer* timer);
+  static void Unlink(TimerLink* link);
+  void Cascade(size_t level, size_t slot);
+  void UpdateNextExpire();
+
+  std::uint64_t NowTick() const;
+
+  const std::chrono::milliseconds tick_;
+  const Clock::time_point start_;
+
+  std::mutex mtx_;
+  std::uint64_t current_ = 0;             // 下一个待处理的tick
+  TimerLink slots_[kLevels][kSlots];      // 各槽链表的哨兵，next指向自身表示空
+  std::atomic<std::uint64_t> nextExpire_; // 最早到期tick的下界，Advance据此跳过加锁
+  std::atomic<size_t> size_{0};           // 已设定的定时器数
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#ifdef __linux__
+
+  #include "CompletionPort.h"
+
+  #include <linux/io_uring.h>
+  #include <mutex>
+
+// 基于io_uring的完成端口，直接使用系统调用，不依赖liburing
+// 提交队列与完成队列各用一把锁保护，多个工作线程可以同时等待完成事件
+class UringPort : public CompletionPort {
+public:
+  explicit UringPort(unsigned entries = 4096);
+  ~UringPort() override;
+
+  // 创建io_uring实例并映射SQ/CQ环，失败时errno保留内核返回的错误
+  bool Init();
+
+  bool Listen(SOCKET listenSock) override;
+
+  bool Associate(SOCKET sock, ULONG_PTR key) override;
+
+  bool PostAccept(SOCKET listenSock, IoCtx* ctx) override;
+
+  void GetAcceptAddrs(IoCtx* ctx, sockaddr_in* localAddr, sockaddr_in* remoteAddr) override;
+
+  bool PostConnect(IoCtx* ctx) override;
+
+  bool PostRecv(IoCtx* ctx) override;
+
+  bool PostRecvReady(IoCtx* ctx) override;
+
+  bool PostSend(IoCtx* ctx) override;
+
+  bool PostSendFile(IoCtx* ctx) override;
+
+  void Shutdown(SOCKET sock) override;
+
+  void Close(SOCKET sock) override;
+
+  bool Dequeue(size_t worker, Completion* out, size_t maxCount, size_t& count, int timeoutMs) override;
+
+  void Wakeup() override;
+
+private:
+  UringPort(const UringPort&)            = delete;
+  UringPort& operator=(const UringPort&) = delete;
+
+  // 按顺序填写若干个SQE并一起提交，每个sqe由对应的fill回调初始化；
+  // 在本端口的工作线程上调用时只填写，到该线程下一次Dequeue时再提交
+  template <typename... Fill>
+  bool Submit(Fill&&... fill);
+
+  // 提交SQ中所有尚未提交的请求，需持有sqMtx_。CQ溢出（EBUSY）或内核暂时无法分配（EAGAIN）时
+  // 不在锁内重试：剩余请求留在SQ中并置busy，由Dequeue先取走完成事件再提交；其他错误返回false
+  bool SubmitPending(bool& busy);
+
+  // 把一个CQE转换为完成事件，不需要上报的（sendFile中读入管道的一环）返回false；需持有cqMtx_
+  bool Reap(const io_uring_cqe& cqe, Completion& out);
+
+  // 确保ctx拥有用于splice的管道，返回管道容量，失败返回0
+  size_t PreparePipe(IoCtx* ctx);
+
+  // 把sendFile读入管道的ctx->pipeBytes字节发往套接字
+  bool PostSpliceOut(IoCtx* ctx);
+
+  unsigned entries_;
+  int ringFd_         = -1;
+  unsigned features_  = 0; // io_uring_params.features
+  unsigned sqEntries_ = 0; // SQ的实际容量
+
+  // SQ环
+  void* sqRing_       = nullptr;
+  size_t sqRingSize_  = 0;
+  unsigned* sqHead_   = nullptr;
+  unsigned* sqTail_   = nullptr;
+  unsigned* sqMask_   = nullptr;
+  unsigned* sqArray_  = nullptr;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqesSize_    = 0;
+  std::mutex sqMtx_;
+
+  // CQ环
+  void* cqRing_       = nullptr;
+  size_t cqRingSize_  = 0;
+  unsigned* cqHead_   = nullptr;
+  unsigned* cqTail_   = nullptr;
+  unsigned* cqMask_   = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+  std::mutex cqMtx_;
+};
+
+#endif
@@ -1,16 +1,27 @@
 #pragma once
 
-#include <WinSock2.h>
-#include <Windows.h>
+#include "CompletionPort.h"
+#include "Mailbox.h"
+#include "Metrics.h"
+#include "TimerWheel.h"
+
 #include <atomic>
 #include <functional>
 #include <thread>
+#include <vector>
 
 class IOCPServer;
-// 工作线程类，用于处理IOCP的异步I/O操作
+// 工作线程类，用于处理完成端口的异步I/O操作
 class WorkerThread {
 public:
-  WorkerThread(IOCPServer& srv, HANDLE completionPort);
+  // index为线程在completionPort上的编号，shard为completionPort所属分片的编号，
+  // batchSize为每次从completionPort取出的最多事件数，metrics为本线程写入的指标
+  WorkerThread(IOCPServer& srv,
+               CompletionPort& completionPort,
+               size_t index,
+               size_t shard,
+               size_t batchSize,
+               WorkerMetrics& metrics);
   ~WorkerThread();
 
   // 启动工作线程
@@ -22,19 +33,39 @@ public:
   // 获取线程ID
   DWORD GetThreadId() const { return threadId_; }
 
+  // 该线程推进的时间轮，可以在任意线程上设定定时器
+  const std::shared_ptr<TimerWheel>& GetTimerWheel() const { return timers_; }
+
+  // 当前是否在本线程上
+  bool IsInLoopThread() const;
+
+  // 当前工作线程的指标，不在工作线程上时返回nullptr
+  static WorkerMetrics* CurrentMetrics();
+
+  // 在本线程上执行fn：已在本线程上时直接执行，否则放入邮箱并唤醒本线程；
+  // 线程停止后仍未执行的任务随本对象一起释放
+  void RunInLoop(Mailbox::Task fn);
+
 private:
   // 线程主函数
   void ThreadProc();
 
-  // 处理完成端口事件
-  void HandleCompletion(DWORD bytesTransferred,
-                        ULONG_PTR completionKey,
-                        LPOVERLAPPED overlapped,
-                        BOOL result);
+  // 处理完成端口事件，dequeuedAt为这一批事件取出的时间
+  void HandleCompletion(const Completion& completion, Timestamp dequeuedAt);
+
+  // 执行邮箱中的任务
+  void RunPending();
 
-  HANDLE completionPort_;     // 完成端口句柄
-  std::thread thread_;        // 工作线程
-  DWORD threadId_;            // 线程ID
-  std::atomic<bool> running_; // 线程运行标志
+  CompletionPort& completionPort_;     // 完成端口
+  size_t index_;                       // 线程编号，用于选择epoll后端中该线程的事件循环
+  size_t shard_;                       // 所属分片，Accept完成时交给IOCPServer
+  std::thread thread_;                 // 工作线程
+  DWORD threadId_;                     // 线程ID
+  std::atomic<bool> running_;          // 线程运行标志
+  std::vector<Completion> batch_;      // 一次取出的完成事件
+  std::shared_ptr<TimerWheel> timers_; // 时间轮，每处理完一批完成事件后推进
+  Mailbox mailbox_;                    // 其他线程交给本线程执行的任务
+  WorkerMetrics& metrics_;             // 本线程的指标，由IOCPServer持有
+  std::atomic<bool> wakePending_{false}; // 已为邮箱中的任务唤醒过本线程，合并多次唤醒
   IOCPServer& srv_;
-};
\ No newline at end of file
+};
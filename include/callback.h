@@ -1,13 +1,55 @@
 #pragma once
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <string_view>
 
 class Session;
 class Buffer;
 
 // todo: onDisConnectedCallback
 
+// 单调时钟上的时间点，用于接收时间戳与延迟统计
+using Timestamp = std::chrono::steady_clock::time_point;
+
 using shared_session_ptr      = std::shared_ptr<Session>;
 using onConnectedCallback     = std::function<void(shared_session_ptr)>;
-using onMessageCallback       = std::function<void(shared_session_ptr, Buffer* buffer)>;
-using onSendCompletedCallback = std::function<void(shared_session_ptr)>;
\ No newline at end of file
+using onSendCompletedCallback = std::function<void(shared_session_ptr)>;
+
+// receiveTime为工作线程取出这次接收完成事件的时间，同一批取出的事件相同
+using onMessageCallback = std::function<void(shared_session_ptr, Buffer* buffer, Timestamp receiveTime)>;
+
+// 不需要接收时间的形式，setMessageCallback同样接受
+using onMessageNoTimeCallback = std::function<void(shared_session_ptr, Buffer* buffer)>;
+
+// 连接接入后在其所属工作线程上调用一次，通常是返回SessionTask的协程（见Coroutine.h）；
+// 设置后该连接收到的数据只交给协程读取，不再回调onMessageCallback/onFrameCallback
+using onSessionCallback = std::function<void(shared_session_ptr)>;
+
+// 设置编解码器后，每收到完整的一帧回调一次；frame指向接收缓冲区，只在回调期间有效
+using onFrameCallback = std::function<void(shared_session_ptr, std::string_view frame)>;
+
+// 待发送字节数达到高水位时回调，pendingBytes为当前待发送的字节数
+using onHighWatermarkCallback = std::function<void(shared_session_ptr, size_t pendingBytes)>;
+
+// 越过高水位后待发送字节数回落到低水位时回调
+using onWriteDrainedCallback = std::function<void(shared_session_ptr)>;
+
+// 超时类型
+enum class TimeoutType {
+  Idle,       // 一段时间内既没有收到数据，发送也没有进展
+  WriteStall, // 有数据待发送，但一段时间内发送没有进展（对端不读取）
+};
+
+// 主动连接的结果：成功时session为新连接、error为0，在其所属工作线程上、投递首个接收之前回调，
+// 可以在这里为它设置回调；失败时session为空，error为平台错误码
+using onConnectCallback = std::function<void(shared_session_ptr session, int error)>;
+
+// 交给计算线程池执行的任务（见Session::post），在计算线程上调用，结果通常经session->send发回
+using ComputeTask = std::function<void(shared_session_ptr)>;
+
+// 工作线程处理完一批完成事件后回调，completions为这一批的事件数；在该工作线程上执行
+using onBatchCallback = std::function<void(size_t completions)>;
+
+// 连接因超时即将被关闭时回调
+using onTimeoutCallback = std::function<void(shared_session_ptr, TimeoutType)>;
\ No newline at end of file
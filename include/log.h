@@ -1,124 +1,234 @@
-#include <chrono>
-#include <codecvt>
+#pragma once
+
+#include "Platform.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
 #include <ctime>
-#include <fstream>
-#include <iomanip>
-#include <iostream>
-#include <locale>
+#include <cwchar>
 #include <memory>
 #include <mutex>
-#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
+
+// 日志级别，数值供预处理器比较，LOG_COMPILE_LEVEL以下的级别在编译期被消除
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_WARN  3
+#define LOG_LEVEL_ERROR 4
+
+#ifndef LOG_COMPILE_LEVEL
+  #define LOG_COMPILE_LEVEL LOG_LEVEL_TRACE
+#endif
+
+// 让编译器按printf检查格式串与参数，fmtIdx/argIdx从1开始计数（成员函数的this为1）
+#if defined(__GNUC__) || defined(__clang__)
+  #define LOG_PRINTF_FORMAT(fmtIdx, argIdx) __attribute__((format(printf, fmtIdx, argIdx)))
+#else
+  #define LOG_PRINTF_FORMAT(fmtIdx, argIdx)
+#endif
 
+enum class LogLevel {
+  Trace = LOG_LEVEL_TRACE,
+  Debug = LOG_LEVEL_DEBUG,
+  Info  = LOG_LEVEL_INFO,
+  Warn  = LOG_LEVEL_WARN,
+  Error = LOG_LEVEL_ERROR,
+};
+
+class LogRateLimiter;
+
+// 异步日志
+// 调用线程只把格式化后的消息写入自己的环形缓冲区（单生产者单消费者，无锁），
+// 由后台写线程统一收集、加时间戳并批量写入appLog.log，I/O线程不会因写文件而互相阻塞。
+// 同一线程的日志保持先后顺序，不同线程之间按收集的批次交错
 class SimpleLogger {
 public:
+  // 环形缓冲区写满时的处理方式
+  enum class OverflowPolicy {
+    Drop,  // 丢弃这条日志并计数，写线程随后记录丢弃的条数
+    Block, // 等待写线程腾出空间
+  };
+
+  static constexpr size_t kRecordSize = 512; // 单条日志的上限（含结尾），超出部分截断
+  static constexpr size_t kRingSize   = 256; // 每个线程缓冲的日志条数，须为2的幂
+
   // 获取单例
   static SimpleLogger& getInstance() {
     static SimpleLogger instance;
     return instance;
   }
 
-  // 记录窄字符日志（std::string 或 const char*）
-  template <typename... Args>
-  void log(const std::string& format, Args&&... args) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    ensureLogFileOpen();
-
-    std::string message = formatMessage(format.c_str(), std::forward<Args>(args)...);
-    logFile << "[" << currentTime() << "]" << message << std::endl;
-    logFile.flush();
-  }
+  // 记录窄字符日志，一般通过LOG_*宏调用
+  void log(LogLevel level, const char* format, ...) LOG_PRINTF_FORMAT(3, 4);
 
   // 记录宽字符日志（std::wstring 或 const wchar_t*）
   template <typename... Args>
-  void log(const std::wstring& format, Args&&... args) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    ensureLogFileOpen();
-
-    std::wstring message    = formatMessage(format.c_str(), std::forward<Args>(args)...);
-    std::string utf8Message = wstringToUtf8(message);
-    logFile << "[" << currentTime() << "]" << utf8Message << std::endl;
-    logFile.flush();
-  }
-
-private:
-  std::ofstream logFile;
-  std::mutex logMutex;
-
-  SimpleLogger() { ensureLogFileOpen(); }
+  void log(LogLevel level, const std::wstring& format, Args&&... args) {
+    wchar_t buf[kRecordSize];
+    int n = std::swprintf(buf, kRecordSize, format.c_str(), args...);
+    if (n < 0) {
+      // swprintf在截断时也返回负值，保留已写入的部分
+      buf[kRecordSize - 1] = L'\0';
+      n                    = static_cast<int>(std::wcslen(buf));
+    }
+    std::string message = wstringToUtf8(std::wstring(buf, static_cast<size_t>(n)));
 
-  void ensureLogFileOpen() {
-    if (!logFile.is_open()) {
-      logFile.open("appLog.log", std::ios::out | std::ios::app);
-      if (!logFile.is_open()) {
-        std::cerr << "无法打开日志文件 appLog.log" << std::endl;
-      }
+    Record* record = beginRecord(level);
+    if (record == nullptr) {
+      return;
     }
+    size_t len = std::min(message.size(), sizeof(record->text) - 1);
+    message.copy(record->text, len);
+    commitRecord(record, static_cast<int>(len));
   }
 
-  // 时间戳
-  std::string currentTime() {
-    auto now            = std::chrono::system_clock::now();
-    std::time_t timeNow = std::chrono::system_clock::to_time_t(now);
-    std::tm tmNow{};
-#ifdef _WIN32
-    localtime_s(&tmNow, &timeNow);
-#else
-    localtime_r(&timeNow, &tmNow);
-#endif
-    std::ostringstream oss;
-    oss << std::put_time(&tmNow, "%Y-%m-%d %H:%M:%S");
-    return oss.str();
+  // 运行期级别阈值，低于该级别的日志不做格式化，默认Info
+  void setLevel(LogLevel level) { level_.store(level, std::memory_order_relaxed); }
+
+  bool isEnabled(LogLevel level) const {
+    return level >= level_.load(std::memory_order_relaxed);
   }
 
-  // 格式化多字节字符串
-  template <typename... Args>
-  std::string formatMessage(const char* format, Args&&... args) {
-    int size = std::snprintf(nullptr, 0, format, std::forward<Args>(args)...) + 1;
-    if (size <= 0)
-      return "格式化失败";
-    std::unique_ptr<char[]> buf(new char[size]);
-    std::snprintf(buf.get(), size, format, std::forward<Args>(args)...);
-    return std::string(buf.get());
+  // 每个调用点每秒最多写入的条数，超出的被丢弃并在下一秒汇总记录，0表示不限制
+  void setRateLimit(std::uint32_t perSecond) {
+    rateLimit_.store(perSecond, std::memory_order_relaxed);
   }
 
-  // 格式化宽字符字符串
-  template <typename... Args>
-  std::wstring formatMessage(const wchar_t* format, Args&&... args) {
-    int size = std::swprintf(nullptr, 0, format, std::forward<Args>(args)...) + 1;
-    if (size <= 0)
-      return L"格式化失败";
-    std::unique_ptr<wchar_t[]> buf(new wchar_t[size]);
-    std::swprintf(buf.get(), size, format, std::forward<Args>(args)...);
-    return std::wstring(buf.get());
+  std::uint32_t rateLimit() const { return rateLimit_.load(std::memory_order_relaxed); }
+
+  void setOverflowPolicy(OverflowPolicy policy) {
+    policy_.store(policy, std::memory_order_relaxed);
   }
 
+  // 阻塞直到此前提交的日志全部写入文件
+  void flush();
+
+  // 因缓冲区写满而丢弃的日志条数
+  std::uint64_t droppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+  ~SimpleLogger();
+
+private:
+  friend class LogRateLimiter;
+
+  struct Record {
+    std::time_t time;
+    LogLevel level;
+    std::uint32_t len;
+    char text[kRecordSize];
+  };
+
+  // 单个线程的日志环，tail只由所属线程写，head只由写线程写
+  struct Ring {
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    std::atomic<bool> retired{false}; // 所属线程已退出，取空后移除
+    Record records[kRingSize];
+  };
+
+  SimpleLogger();
+
+  // 取得当前线程日志环中的下一个空槽，写满且策略为Drop时返回nullptr
+  Record* beginRecord(LogLevel level);
+
+  // 提交beginRecord取得的槽，n为snprintf的返回值
+  void commitRecord(Record* record, int n);
+
+  // 当前线程的日志环，首次使用时登记到写线程
+  Ring& localRing();
+
+  // 写线程主循环
+  void writerLoop();
+
+  // 取空所有日志环并写入文件，返回写入的条数
+  size_t drain();
+
+  // 汇总各调用点上一秒因限流丢弃的条数
+  void reportSuppressed();
+
+  // 时间戳，同一秒内复用上次格式化的结果
+  const char* timestamp(std::time_t time);
+
   // 宽字符转 UTF-8
-  std::string wstringToUtf8(const std::wstring& wstr) {
-    int size_needed = WideCharToMultiByte(CP_UTF8,
-                                          0,
-                                          wstr.c_str(),
-                                          (int)wstr.size(),
-                                          nullptr,
-                                          0,
-                                          nullptr,
-                                          nullptr);
-    std::string strTo(size_needed, 0);
-    WideCharToMultiByte(CP_UTF8,
-                        0,
-                        wstr.c_str(),
-                        (int)wstr.size(),
-                        &strTo[0],
-                        size_needed,
-                        nullptr,
-                        nullptr);
-    return strTo;
-  }
+  static std::string wstringToUtf8(const std::wstring& wstr);
+
+  std::FILE* logFile_ = nullptr;
+  std::vector<std::shared_ptr<Ring>> rings_; // 写线程遍历的全部日志环
+  std::mutex ringsMtx_;
+
+  std::vector<LogRateLimiter*> limiters_; // 已创建的调用点限流器
+  std::mutex limitersMtx_;
+  std::time_t limitersReported_ = 0; // 仅写线程访问
+
+  std::atomic<LogLevel> level_{LogLevel::Info};
+  std::atomic<std::uint32_t> rateLimit_{100};
+  std::atomic<OverflowPolicy> policy_{OverflowPolicy::Drop};
+  std::atomic<std::uint64_t> dropped_{0};
+  std::uint64_t droppedReported_ = 0; // 仅写线程访问
+
+  std::mutex wakeMtx_;
+  std::condition_variable wakeCv_;  // 唤醒写线程
+  std::condition_variable flushCv_; // 通知flush的调用方
+  std::uint64_t flushRequested_ = 0;
+  std::uint64_t flushDone_      = 0;
+  bool running_                 = true;
+
+  std::time_t cachedTime_ = 0;
+  char cachedStamp_[32]   = {};
+  std::string writeBuf_; // 写线程的批量输出缓冲
+
+  std::thread writer_;
 
   // 禁用拷贝与赋值
   SimpleLogger(const SimpleLogger&)            = delete;
   SimpleLogger& operator=(const SimpleLogger&) = delete;
 };
 
-// 简化宏
-#define LOG(format, ...) SimpleLogger::getInstance().log(format, ##__VA_ARGS__)
+// 单个调用点的限流状态，由LOG_AT宏在每个调用点定义一个静态实例；
+// 被丢弃的条数由写线程每秒汇总记录一次
+class LogRateLimiter {
+public:
+  LogRateLimiter(const char* file, int line);
+  ~LogRateLimiter();
+
+  // 判断本次是否允许写入
+  bool allow();
+
+private:
+  friend class SimpleLogger;
+
+  const char* file_;
+  int line_;
+  std::atomic<std::time_t> window_{0};
+  std::atomic<std::uint32_t> count_{0};
+  std::atomic<std::uint32_t> suppressed_{0};
+};
+
+// 按级别记录日志：编译期级别不足时整个分支被优化掉（格式串仍参与检查），
+// 其次检查运行期阈值，最后按调用点限流
+#define LOG_AT(level, format, ...)                                                                 \
+  do {                                                                                             \
+    if (static_cast<int>(level) >= LOG_COMPILE_LEVEL &&                                            \
+        SimpleLogger::getInstance().isEnabled(level)) {                                            \
+      static LogRateLimiter logRateLimiter(__FILE__, __LINE__);                                    \
+      if (logRateLimiter.allow()) {                                                                \
+        SimpleLogger::getInstance().log(level, format, ##__VA_ARGS__);                             \
+      }                                                                                            \
+    }                                                                                              \
+  } while (0)
+
+#define LOG_TRACE(format, ...) LOG_AT(LogLevel::Trace, format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...) LOG_AT(LogLevel::Debug, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...)  LOG_AT(LogLevel::Info, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...)  LOG_AT(LogLevel::Warn, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_AT(LogLevel::Error, format, ##__VA_ARGS__)
+
+// 兼容旧代码，等同于LOG_INFO
+#define LOG(format, ...) LOG_INFO(format, ##__VA_ARGS__)
@@ -0,0 +1,333 @@
+#include "Buffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+Buffer::Buffer(size_t /* initialSize */) {}
+
+Buffer::~Buffer() { clear(); }
+
+Buffer::Buffer(Buffer&& other) noexcept
+    : segs_(std::move(other.segs_))
+    , writeIdx_(other.writeIdx_)
+    , readable_(other.readable_)
+    , capacity_(other.capacity_) {
+  other.segs_.clear();
+  other.writeIdx_ = other.readable_ = other.capacity_ = 0;
+}
+
+Buffer& Buffer::operator=(Buffer&& other) noexcept {
+  if (this != &other) {
+    clear();
+    segs_.swap(other.segs_);
+    std::swap(writeIdx_, other.writeIdx_);
+    std::swap(readable_, other.readable_);
+    std::swap(capacity_, other.capacity_);
+  }
+  return *this;
+}
+
+void Buffer::write(const void* data, size_t length) {
+  const char* src = static_cast<const char*>(data);
+  while (length > 0) {
+    Segment& seg = writeSegment();
+    size_t n     = std::min(length, seg.cap - seg.end);
+    std::memcpy(seg.data + seg.end, src, n);
+    seg.end += n;
+    readable_ += n;
+    src += n;
+    length -= n;
+  }
+}
+
+void Buffer::append(Buffer&& other) {
+  if (this == &other) {
+    return;
+  }
+  if (readable_ == 0) {
+    *this = std::move(other);
+    return;
+  }
+  for (const Segment& seg : other.segs_) {
+    if (seg.end > seg.begin) {
+      write(seg.data + seg.begin, seg.end - seg.begin);
+    }
+  }
+  other.clear();
+}
+
+size_t Buffer::read(void* output, size_t length) {
+  length = copyOut(output, length);
+  if (length > 0) {
+    retrieve(length);
+  }
+  return length;
+}
+
+size_t Buffer::writableBytes() const {
+  for (size_t i = writeIdx_; i < segs_.size(); ++i) {
+    if (segs_[i].end < segs_[i].cap) {
+      return segs_[i].cap - segs_[i].end;
+    }
+  }
+  return 0;
+}
+
+void Buffer::clear() {
+  for (const Segment& seg : segs_) {
+    releaseSegment(seg);
+  }
+  segs_.clear();
+  writeIdx_ = readable_ = capacity_ = 0;
+}
+
+const char* Buffer::peek() const {
+  static const char kEmpty[1] = {};
+  if (readable_ == 0) {
+    return kEmpty;
+  }
+  if (contiguousBytes() < readable_) {
+    linearize();
+  }
+  return segs_.front().data + segs_.front().begin;
+}
+
+const char* Buffer::peek(size_t len) const {
+  len = std::min(len, readable_);
+  if (len <= contiguousBytes()) {
+    return peekContiguous() != nullptr ? peekContiguous() : peek();
+  }
+  if (len == readable_) {
+    return peek();
+  }
+
+  // 只把前len字节合并为新的首段，被完全合并的段归还，部分合并的段前移起点
+  Segment merged;
+  if (len <= ChunkPool::kChunkSize) {
+    merged = Segment{ChunkPool::Acquire(), ChunkPool::kChunkSize, 0, len};
+  } else {
+    merged = Segment{new char[len], len, 0, len};
+  }
+  copyOut(merged.data, len);
+
+  size_t remaining = len;
+  while (remaining > 0) {
+    Segment& seg = segs_.front();
+    size_t n     = std::min(remaining, seg.end - seg.begin);
+    seg.begin += n;
+    remaining -= n;
+    if (seg.begin == seg.end) {
+      // 还有数据未合并，读完的段必然位于写入位置之前
+      releaseSegment(seg);
+      segs_.pop_front();
+      --writeIdx_;
+    }
+  }
+  segs_.push_front(merged);
+  capacity_ += merged.cap;
+  ++writeIdx_; // merged中即使有空闲也不再写入，新数据必须排在未合并的数据之后
+  return merged.data;
+}
+
+void Buffer::retrieve(size_t len) {
+  if (len > readableBytes()) {
+    throw std::out_of_range("Buffer::retrieve");
+  }
+
+  readable_ -= len;
+  if (readable_ == 0) {
+    // 读空后归还全部内存块，空闲连接不占用缓冲区
+    clear();
+    return;
+  }
+
+  while (len > 0) {
+    Segment& seg = segs_.front();
+    size_t n     = std::min(len, seg.end - seg.begin);
+    seg.begin += n;
+    len -= n;
+    if (seg.begin == seg.end) {
+      // 此时还有可读数据，读完的段必然已写满，位于写入位置之前
+      releaseSegment(seg);
+      segs_.pop_front();
+      --writeIdx_;
+    }
+  }
+}
+
+size_t Buffer::contiguousBytes() const {
+  return segs_.empty() ? 0 : segs_.front().end - segs_.front().begin;
+}
+
+const char* Buffer::peekContiguous() const {
+  return readable_ == 0 ? nullptr : segs_.front().data + segs_.front().begin;
+}
+
+size_t Buffer::find(const char* pattern, size_t patternLen, size_t from) const {
+  if (patternLen == 0 || from >= readable_ || patternLen > readable_ - from) {
+    return npos;
+  }
+
+  size_t base = 0; // 当前段首字节的偏移
+  for (const Segment& seg : segs_) {
+    size_t size = seg.end - seg.begin;
+    if (from < base + size) {
+      const char* begin = seg.data + seg.begin;
+      const char* p     = begin + (from - base);
+      const char* end   = begin + size;
+      while ((p = static_cast<const char*>(std::memchr(p, pattern[0], end - p))) != nullptr) {
+        size_t pos = base + (p - begin);
+        if (patternLen > readable_ - pos) {
+          return npos;
+        }
+        if (equalsAt(pos, pattern, patternLen)) {
+          return pos;
+        }
+        ++p;
+      }
+      from = base + size;
+    }
+    base += size;
+  }
+  return npos;
+}
+
+bool Buffer::equalsAt(size_t pos, const char* data, size_t len) const {
+  size_t base = 0;
+  for (const Segment& seg : segs_) {
+    if (len == 0) {
+      break;
+    }
+    size_t size = seg.end - seg.begin;
+    if (pos < base + size) {
+      size_t offset = pos - base;
+      size_t n      = std::min(len, size - offset);
+      if (std::memcmp(seg.data + seg.begin + offset, data, n) != 0) {
+        return false;
+      }
+      data += n;
+      pos += n;
+      len -= n;
+    }
+    base += size;
+  }
+  return len == 0;
+}
+
+size_t Buffer::copyOut(void* output, size_t length, size_t offset) const {
+  if (offset >= readable_) {
+    return 0;
+  }
+  length = std::min(length, readable_ - offset);
+
+  char* dst     = static_cast<char*>(output);
+  size_t copied = 0;
+  for (const Segment& seg : segs_) {
+    if (copied == length) {
+      break;
+    }
+    size_t size = seg.end - seg.begin;
+    if (offset >= size) {
+      offset -= size;
+      continue;
+    }
+    size_t n = std::min(length - copied, size - offset);
+    std::memcpy(dst + copied, seg.data + seg.begin + offset, n);
+    copied += n;
+    offset = 0;
+  }
+  return copied;
+}
+
+size_t Buffer::readableBufs(WSABUF* bufs, size_t maxBufs) const {
+  size_t count = 0;
+  for (const Segment& seg : segs_) {
+    if (count == maxBufs || seg.begin == seg.end) {
+      break;
+    }
+    bufs[count].buf = seg.data + seg.begin;
+    bufs[count].len = static_cast<ULONG>(seg.end - seg.begin);
+    ++count;
+  }
+  return count;
+}
+
+size_t Buffer::prepareWrite(size_t length, WSABUF* bufs, size_t maxBufs) {
+  size_t available = 0;
+  for (size_t i = writeIdx_; i < segs_.size(); ++i) {
+    available += segs_[i].cap - segs_[i].end;
+  }
+  while (available < length) {
+    appendChunk();
+    available += ChunkPool::kChunkSize;
+  }
+
+  size_t count = 0;
+  for (size_t i = writeIdx_; i < segs_.size() && count < maxBufs; ++i) {
+    Segment& seg = segs_[i];
+    if (seg.end == seg.cap) {
+      continue;
+    }
+    bufs[count].buf = seg.data + seg.end;
+    bufs[count].len = static_cast<ULONG>(seg.cap - seg.end);
+    ++count;
+  }
+  return count;
+}
+
+void Buffer::commitWrite(size_t length) {
+  while (length > 0) {
+    Segment& seg = writeSegment();
+    size_t n     = std::min(length, seg.cap - seg.end);
+    seg.end += n;
+    readable_ += n;
+    length -= n;
+  }
+}
+
+void Buffer::appendChunk() {
+  segs_.push_back(Segment{ChunkPool::Acquire(), ChunkPool::kChunkSize, 0, 0});
+  capacity_ += ChunkPool::kChunkSize;
+}
+
+Buffer::Segment& Buffer::writeSegment() {
+  while (writeIdx_ < segs_.size() && segs_[writeIdx_].end == segs_[writeIdx_].cap) {
+    ++writeIdx_;
+  }
+  if (writeIdx_ == segs_.size()) {
+    appendChunk();
+  }
+  return segs_[writeIdx_];
+}
+
+void Buffer::linearize() const {
+  // 超过一块时按两倍分配，之后的写入继续追加在这一段中，反复peek不会反复合并
+  Segment merged;
+  if (readable_ <= ChunkPool::kChunkSize) {
+    merged = Segment{ChunkPool::Acquire(), ChunkPool::kChunkSize, 0, readable_};
+  } else {
+    size_t cap = readable_ * 2;
+    merged     = Segment{new char[cap], cap, 0, readable_};
+  }
+  copyOut(merged.data, readable_);
+
+  // 写入位置及其之前的段都已并入merged，之后的段是prepareWrite预留的空块，保留
+  size_t dataSegs = std::min(writeIdx_ + 1, segs_.size());
+  for (size_t i = 0; i < dataSegs; ++i) {
+    releaseSegment(segs_[i]);
+  }
+  segs_.erase(segs_.begin(), segs_.begin() + dataSegs);
+  segs_.push_front(merged);
+  capacity_ += merged.cap;
+  writeIdx_ = 0;
+}
+
+void Buffer::releaseSegment(const Segment& seg) const {
+  capacity_ -= seg.cap;
+  if (seg.pooled()) {
+    ChunkPool::Release(seg.data);
+  } else {
+    delete[] seg.data;
+  }
+}
@@ -0,0 +1,45 @@
+#include "ChunkPool.h"
+
+#include "ThreadCachePool.h"
+
+#include <new>
+
+namespace {
+
+constexpr size_t kAlign         = 64;   // 按缓存行对齐
+constexpr size_t kMaxGlobalFree = 1024; // 全局链表上限，超过的块直接释放
+
+// 逐块分配和释放按缓存行对齐的内存
+struct ChunkSource {
+  char* Create() {
+    return static_cast<char*>(::operator new(ChunkPool::kChunkSize, std::align_val_t(kAlign)));
+  }
+
+  void Destroy(char* chunk) { ::operator delete(chunk, std::align_val_t(kAlign)); }
+};
+
+using Pool = ThreadCachePool<char, ChunkSource, kMaxGlobalFree>;
+
+} // namespace
+
+char* ChunkPool::Acquire() { return Pool::Acquire(); }
+
+void ChunkPool::Release(char* chunk) {
+  if (chunk == nullptr) {
+    return;
+  }
+
+  Pool::Release(chunk);
+}
+
+ChunkPool::Stats ChunkPool::GetStats() {
+  Pool::Counters counters = Pool::GetCounters();
+
+  Stats stats;
+  stats.acquired  = counters.acquired;
+  stats.reused    = counters.reused;
+  stats.allocated = counters.created;
+  stats.released  = counters.released;
+  stats.freed     = counters.freed;
+  return stats;
+}
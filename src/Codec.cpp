@@ -0,0 +1,110 @@
+#include "Codec.h"
+
+#include <stdexcept>
+
+const std::string& Codec::trailer() const {
+  static const std::string kEmpty;
+  return kEmpty;
+}
+
+LengthFieldCodec::LengthFieldCodec(size_t headerSize, ByteOrder order, size_t maxFrameSize)
+    : Codec(maxFrameSize)
+    , headerSize_(headerSize)
+    , order_(order) {
+  if (headerSize != 1 && headerSize != 2 && headerSize != 4 && headerSize != 8) {
+    throw std::invalid_argument("LengthFieldCodec: header size must be 1, 2, 4 or 8");
+  }
+}
+
+Codec::Status LengthFieldCodec::decode(const Buffer& buf, size_t& /* scanned */, Frame& frame) const {
+  unsigned char header[kMaxHeaderSize];
+  if (buf.copyOut(header, headerSize_) < headerSize_) {
+    return Status::Incomplete;
+  }
+
+  std::uint64_t length = 0;
+  for (size_t i = 0; i < headerSize_; ++i) {
+    size_t index = order_ == ByteOrder::BigEndian ? i : headerSize_ - 1 - i;
+    length       = (length << 8) | header[index];
+  }
+
+  // 长度字段在整帧到达之前就能判断是否超限，不必等待数据积累
+  if (length > maxFrameSize()) {
+    return Status::Invalid;
+  }
+  if (buf.readableBytes() - headerSize_ < length) {
+    return Status::Incomplete;
+  }
+
+  frame.offset  = headerSize_;
+  frame.length  = static_cast<size_t>(length);
+  frame.consume = headerSize_ + frame.length;
+  return Status::Complete;
+}
+
+size_t LengthFieldCodec::encodeHeader(size_t length, char* header) const {
+  if (length > maxFrameSize() ||
+      (headerSize_ < 8 && static_cast<std::uint64_t>(length) >> (headerSize_ * 8) != 0)) {
+    return npos;
+  }
+
+  std::uint64_t value = length;
+  for (size_t i = 0; i < headerSize_; ++i) {
+    size_t index  = order_ == ByteOrder::BigEndian ? headerSize_ - 1 - i : i;
+    header[index] = static_cast<char>(value & 0xFF);
+    value >>= 8;
+  }
+  return headerSize_;
+}
+
+DelimiterCodec::DelimiterCodec(std::string delimiter, size_t maxFrameSize)
+    : Codec(maxFrameSize)
+    , delimiter_(std::move(delimiter)) {
+  if (delimiter_.empty()) {
+    throw std::invalid_argument("DelimiterCodec: delimiter must not be empty");
+  }
+}
+
+Codec::Status DelimiterCodec::decode(const Buffer& buf, size_t& scanned, Frame& frame) const {
+  // 上次已确认不含分隔符的部分不再扫描，但分隔符可能跨越上次的末尾，回退delimiter长度-1
+  size_t from = scanned >= delimiter_.size() ? scanned - (delimiter_.size() - 1) : 0;
+  size_t pos  = buf.find(delimiter_.data(), delimiter_.size(), from);
+  if (pos == Buffer::npos) {
+    scanned = buf.readableBytes();
+    // 已积累的数据中连分隔符都还没有出现，整帧必然超限
+    return scanned > maxFrameSize() + delimiter_.size() - 1 ? Status::Invalid : Status::Incomplete;
+  }
+  if (pos > maxFrameSize()) {
+    return Status::Invalid;
+  }
+
+  frame.offset  = 0;
+  frame.length  = pos;
+  frame.consume = pos + delimiter_.size();
+  return Status::Complete;
+}
+
+size_t DelimiterCodec::encodeHeader(size_t length, char* /* header */) const {
+  return length > maxFrameSize() ? npos : 0;
+}
+
+FixedLengthCodec::FixedLengthCodec(size_t frameSize)
+    : Codec(frameSize) {
+  if (frameSize == 0) {
+    throw std::invalid_argument("FixedLengthCodec: frame size must not be 0");
+  }
+}
+
+Codec::Status FixedLengthCodec::decode(const Buffer& buf, size_t& /* scanned */, Frame& frame) const {
+  if (buf.readableBytes() < maxFrameSize()) {
+    return Status::Incomplete;
+  }
+  frame.offset  = 0;
+  frame.length  = maxFrameSize();
+  frame.consume = maxFrameSize();
+  return Status::Complete;
+}
+
+size_t FixedLengthCodec::encodeHeader(size_t length, char* /* header */) const {
+  return length == maxFrameSize() ? 0 : npos;
+}
@@ -0,0 +1,41 @@
+#include "CompletionPort.h"
+
+#ifdef _WIN32
+  #include "IocpPort.h"
+#else
+  #include "EpollPort.h"
+  #include "UringPort.h"
+  #include "log.h"
+
+  #include <cstdlib>
+  #include <cstring>
+#endif
+
+std::unique_ptr<CompletionPort> CompletionPort::Create(size_t workers) {
+#ifdef _WIN32
+  (void)workers;
+  auto port = std::make_unique<IocpPort>();
+  if (!port->Init()) {
+    return nullptr;
+  }
+  return port;
+#else
+  const char* backend = std::getenv("IOCP_BACKEND");
+  bool forceEpoll     = backend != nullptr && std::strcmp(backend, "epoll") == 0;
+
+  if (!forceEpoll) {
+    auto uring = std::make_unique<UringPort>();
+    if (uring->Init()) {
+      return uring;
+    }
+    // 内核未开启io_uring或被安全策略禁用（ENOSYS/EPERM），退化为epoll
+    LOG_WARN("io_uring unavailable, fall back to epoll backend");
+  }
+
+  auto epoll = std::make_unique<EpollPort>(workers);
+  if (!epoll->Init()) {
+    return nullptr;
+  }
+  return epoll;
+#endif
+}
@@ -0,0 +1,216 @@
+#include "ComputePool.h"
+
+#include "Session.h"
+
+#include <algorithm>
+
+namespace {
+
+// 当前线程所属的线程池及其中的编号，不在计算线程上时为空
+thread_local const ComputePool* currentPool = nullptr;
+thread_local size_t currentIndex            = 0;
+
+} // namespace
+
+ComputePool::ComputePool(size_t threads) {
+  for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+}
+
+ComputePool::~ComputePool() { Stop(); }
+
+void ComputePool::Start() {
+  running_.store(true, std::memory_order_release);
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i]->thread = std::thread(&ComputePool::ThreadProc, this, i);
+  }
+}
+
+void ComputePool::Stop() {
+  running_.store(false, std::memory_order_seq_cst);
+  {
+    std::lock_guard<std::mutex> lock(sleepMtx_);
+  }
+  wake_.notify_all();
+  for (auto& worker : workers_) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+
+  // 此后Schedule在队列锁内能看到running_为false，不会再放入队列
+  for (auto& worker : workers_) {
+    std::deque<shared_session_ptr> ready;
+    {
+      std::lock_guard<std::mutex> lock(worker->mtx);
+      ready.swap(worker->ready);
+    }
+    readySessions_.fetch_sub(ready.size(), std::memory_order_relaxed);
+    for (auto& session : ready) {
+      Discard(session);
+    }
+  }
+}
+
+bool ComputePool::Submit(const shared_session_ptr& session, ComputeTask task) {
+  if (!running_.load(std::memory_order_acquire) || session->isClosed()) {
+    return false;
+  }
+
+  bool schedule;
+  {
+    std::lock_guard<std::mutex> lock(session->computeMtx_);
+    session->computeTasks_.push_back(std::move(task));
+    schedule                   = !session->computeScheduled_;
+    session->computeScheduled_ = true;
+  }
+  queuedTasks_.fetch_add(1, std::memory_order_relaxed);
+  if (schedule) {
+    Schedule(session);
+  }
+  return true;
+}
+
+void ComputePool::Schedule(const shared_session_ptr& session, bool front) {
+  size_t index = currentPool == this ? currentIndex : session->getId() % workers_.size();
+  Worker& worker = *workers_[index];
+  {
+    std::lock_guard<std::mutex> lock(worker.mtx);
+    if (!running_.load(std::memory_order_acquire)) {
+      Discard(session);
+      return;
+    }
+    if (front) {
+      worker.ready.push_front(session);
+    } else {
+      worker.ready.push_back(session);
+    }
+    // 与取出时的减少在同一把锁内，计数不会短暂为负
+    readySessions_.fetch_add(1, std::memory_order_seq_cst);
+  }
+
+  // 与ThreadProc中先登记等待再检查readySessions_相对：两边都是顺序一致的原子操作，
+  // 要么这里看到等待者并唤醒，要么等待者看到新放入的session
+  if (sleeping_.load(std::memory_order_seq_cst) > 0) {
+    {
+      std::lock_guard<std::mutex> lock(sleepMtx_);
+    }
+    wake_.notify_one();
+  }
+}
+
+bool ComputePool::Pop(size_t index, shared_session_ptr& session) {
+  Worker& self = *workers_[index];
+  std::lock_guard<std::mutex> lock(self.mtx);
+  if (self.ready.empty()) {
+    return false;
+  }
+  session = std::move(self.ready.back());
+  self.ready.pop_back();
+  readySessions_.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool ComputePool::Steal(size_t index, shared_session_ptr& session) {
+  for (size_t i = 1; i < workers_.size(); ++i) {
+    Worker& victim = *workers_[(index + i) % workers_.size()];
+    std::lock_guard<std::mutex> lock(victim.mtx);
+    if (victim.ready.empty()) {
+      continue;
+    }
+    // 从头部窃取：那里是最早放入、所属线程最晚才会处理的session
+    session = std::move(victim.ready.front());
+    victim.ready.pop_front();
+    readySessions_.fetch_sub(1, std::memory_order_relaxed);
+    bumpCounter(workers_[index]->steals);
+    return true;
+  }
+  return false;
+}
+
+void ComputePool::ThreadProc(size_t index) {
+  currentPool  = this;
+  currentIndex = index;
+  Worker& self = *workers_[index];
+
+  while (running_.load(std::memory_order_acquire)) {
+    shared_session_ptr session;
+    if (Pop(index, session) || Steal(index, session)) {
+      Run(self, session);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMtx_);
+    sleeping_.fetch_add(1, std::memory_order_seq_cst);
+    wake_.wait(lock, [this] {
+      return !running_.load(std::memory_order_acquire) ||
+             readySessions_.load(std::memory_order_seq_cst) > 0;
+    });
+    sleeping_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  currentPool = nullptr;
+}
+
+void ComputePool::Run(Worker& self, const shared_session_ptr& session) {
+  std::vector<ComputeTask> batch;
+  {
+    std::lock_guard<std::mutex> lock(session->computeMtx_);
+    batch.swap(session->computeTasks_);
+  }
+
+  size_t executed = 0;
+  for (ComputeTask& task : batch) {
+    if (session->isClosed() || !running_.load(std::memory_order_acquire)) {
+      break;
+    }
+    task(session);
+    ++executed;
+  }
+  queuedTasks_.fetch_sub(batch.size(), std::memory_order_relaxed);
+  bumpCounter(self.tasks, executed);
+  batch.clear(); // 在锁外释放任务捕获的对象
+
+  bool more;
+  {
+    std::lock_guard<std::mutex> lock(session->computeMtx_);
+    more = !session->computeTasks_.empty();
+    if (!more) {
+      session->computeScheduled_ = false;
+      // 把容量还给session，下次提交不必重新分配
+      if (session->computeTasks_.capacity() == 0) {
+        session->computeTasks_.swap(batch);
+      }
+    }
+  }
+  if (more) {
+    Schedule(session, true);
+  }
+}
+
+void ComputePool::Discard(const shared_session_ptr& session) {
+  std::vector<ComputeTask> tasks;
+  {
+    std::lock_guard<std::mutex> lock(session->computeMtx_);
+    tasks.swap(session->computeTasks_);
+    session->computeScheduled_ = false;
+  }
+  queuedTasks_.fetch_sub(tasks.size(), std::memory_order_relaxed);
+}
+
+ComputeStats ComputePool::getStats() const {
+  ComputeStats stats;
+  for (const auto& worker : workers_) {
+    ComputeStats::Thread thread;
+    {
+      std::lock_guard<std::mutex> lock(worker->mtx);
+      thread.depth = worker->ready.size();
+    }
+    thread.tasks  = worker->tasks.load(std::memory_order_relaxed);
+    thread.steals = worker->steals.load(std::memory_order_relaxed);
+    stats.threads.push_back(thread);
+  }
+  stats.queuedTasks = queuedTasks_.load(std::memory_order_relaxed);
+  return stats;
+}
@@ -0,0 +1,518 @@
+#ifdef __linux__
+
+  #include "EpollPort.h"
+
+  #include "File.h"
+  #include "log.h"
+
+  #include <algorithm>
+  #include <chrono>
+  #include <cstring>
+  #include <fcntl.h>
+  #include <sys/epoll.h>
+  #include <sys/eventfd.h>
+  #include <sys/resource.h>
+  #include <sys/sendfile.h>
+
+namespace {
+
+constexpr std::uint64_t kWakeupData = ~std::uint64_t(0);
+constexpr int kMaxEvents            = 128;
+
+// 当前线程正在等待的事件循环，用于判断投递完成事件时是否需要eventfd唤醒
+thread_local void* currentLoop = nullptr;
+
+std::uint64_t makeEventData(SOCKET sock, std::uint32_t gen) {
+  return (static_cast<std::uint64_t>(gen) << 32) | static_cast<std::uint32_t>(sock);
+}
+
+bool setNonBlocking(SOCKET sock) {
+  int flags = ::fcntl(sock, F_GETFL, 0);
+  return flags >= 0 && ::fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+bool wouldBlock(int err) { return err == EAGAIN || err == EWOULDBLOCK; }
+
+} // namespace
+
+EpollPort::EpollPort(size_t workers) {
+  for (size_t i = 0; i < std::max<size_t>(workers, 1); ++i) {
+    loops_.push_back(std::make_unique<Loop>());
+  }
+}
+
+EpollPort::~EpollPort() {
+  for (auto& loop : loops_) {
+    if (loop->epollFd >= 0) {
+      ::close(loop->epollFd);
+    }
+    if (loop->wakeFd >= 0) {
+      ::close(loop->wakeFd);
+    }
+  }
+  for (size_t i = 0; slots_ && i < maxSlots_; ++i) {
+    delete slots_[i].load(std::memory_order_relaxed);
+  }
+}
+
+bool EpollPort::Init() {
+  rlimit limit{};
+  rlim_t maxFds = 65536;
+  if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+    maxFds = limit.rlim_cur;
+  }
+  maxSlots_ = std::clamp<size_t>(static_cast<size_t>(maxFds), 1024, 1 << 20);
+  slots_    = std::make_unique<std::atomic<SockSlot*>[]>(maxSlots_);
+
+  for (auto& loop : loops_) {
+    loop->epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epollFd < 0) {
+      LOG_ERROR("epoll_create1 failed with error: %d", errno);
+      return false;
+    }
+
+    loop->wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->wakeFd < 0) {
+      LOG_ERROR("eventfd failed with error: %d", errno);
+      return false;
+    }
+
+    epoll_event ev{};
+    ev.events   = EPOLLIN;
+    ev.data.u64 = kWakeupData;
+    if (::epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &ev) != 0) {
+      LOG_ERROR("epoll_ctl add eventfd failed with error: %d", errno);
+      return false;
+    }
+  }
+  return true;
+}
+
+EpollPort::SockSlot* EpollPort::GetSlot(SOCKET sock) {
+  if (sock < 0 || static_cast<size_t>(sock) >= maxSlots_) {
+    return nullptr;
+  }
+
+  SockSlot* slot = slots_[sock].load(std::memory_order_acquire);
+  if (slot == nullptr) {
+    SockSlot* fresh = new SockSlot();
+    if (slots_[sock].compare_exchange_strong(slot, fresh, std::memory_order_acq_rel)) {
+      slot = fresh;
+    } else {
+      delete fresh;
+    }
+  }
+  return slot;
+}
+
+bool EpollPort::Listen(SOCKET listenSock) {
+  SockSlot* slot = GetSlot(listenSock);
+  if (slot == nullptr || !setNonBlocking(listenSock)) {
+    LOG_ERROR("failed to prepare listen socket %" PRIsock, listenSock);
+    return false;
+  }
+
+  std::uint32_t gen;
+  {
+    std::lock_guard<std::mutex> guard(slot->mtx);
+    gen        = ++slot->gen;
+    slot->loop = nullptr;
+    slot->key  = 0;
+  }
+
+  // 每个线程都监听该套接字，EPOLLEXCLUSIVE保证一个新连接只唤醒其中一个
+  for (auto& loop : loops_) {
+    epoll_event ev{};
+    ev.events   = EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
+    ev.data.u64 = makeEventData(listenSock, gen);
+    if (::epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, listenSock, &ev) != 0) {
+      LOG_ERROR("epoll_ctl add listen socket failed with error: %d", errno);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool EpollPort::Associate(SOCKET sock, ULONG_PTR key) {
+  SockSlot* slot = GetSlot(sock);
+  if (slot == nullptr || !setNonBlocking(sock)) {
+    return false;
+  }
+
+  Loop* loop = loops_[nextLoop_.fetch_add(1, std::memory_order_relaxed) % loops_.size()].get();
+  std::uint32_t gen;
+  {
+    std::lock_guard<std::mutex> guard(slot->mtx);
+    gen           = ++slot->gen;
+    slot->loop    = loop;
+    slot->key     = key;
+    slot->recvCtx = nullptr;
+    slot->sendCtx = nullptr;
+  }
+
+  epoll_event ev{};
+  ev.events   = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.u64 = makeEventData(sock, gen);
+  return ::epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, sock, &ev) == 0;
+}
+
+bool EpollPort::TryAccept(SockSlot* slot, SOCKET listenSock, IoCtx* ctx, Completion& out) {
+  for (;;) {
+    SOCKET sock = ::accept4(listenSock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (sock >= 0) {
+      ctx->sock = sock;
+      out       = Completion{ctx, slot->key, 0, 0};
+      return true;
+    }
+    if (errno == EINTR || errno == ECONNABORTED) {
+      continue;
+    }
+    if (wouldBlock(errno)) {
+      return false;
+    }
+    out = Completion{ctx, slot->key, 0, static_cast<DWORD>(errno)};
+    return true;
+  }
+}
+
+bool EpollPort::TryRecv(IoCtx* ctx, Completion& out) {
+  for (;;) {
+    ssize_t n;
+    if (ctx->op == OpType::RECV_READY) {
+      // 零字节读只探测是否可读（包括对端已关闭），不取走数据
+      char probe;
+      n = ::recv(ctx->sock, &probe, 1, MSG_PEEK) >= 0 ? 0 : -1;
+    } else {
+      n = ::readv(ctx->sock, reinterpret_cast<iovec*>(ctx->recvBufs), ctx->recvBufCount);
+    }
+    if (n >= 0) {
+      out.ctx              = ctx;
+      out.bytesTransferred = static_cast<DWORD>(n);
+      return true;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (wouldBlock(errno)) {
+      return false;
+    }
+    out.ctx   = ctx;
+    out.error = static_cast<DWORD>(errno);
+    return true;
+  }
+}
+
+bool EpollPort::TrySend(IoCtx* ctx, Completion& out) {
+  if (ctx->op == OpType::CONNECT) {
+    return TryConnect(ctx, out);
+  }
+
+  msghdr msg{};
+  msg.msg_iov    = reinterpret_cast<iovec*>(ctx->sendBufs);
+  msg.msg_iovlen = ctx->sendBufCount;
+  for (;;) {
+    ssize_t n;
+    if (ctx->sendFile != nullptr) {
+      off_t offset = static_cast<off_t>(ctx->fileOffset);
+      size_t count = static_cast<size_t>(
+          std::min<std::uint64_t>(ctx->fileRemaining, SENDFILE_CHUNK_SIZE));
+      n            = ::sendfile(ctx->sock, ctx->sendFile->handle(), &offset, count);
+    } else {
+      n = ::sendmsg(ctx->sock, &msg, MSG_NOSIGNAL);
+    }
+    if (n >= 0) {
+      out.ctx              = ctx;
+      out.bytesTransferred = static_cast<DWORD>(n);
+      return true;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (wouldBlock(errno)) {
+      return false;
+    }
+    out.ctx   = ctx;
+    out.error = static_cast<DWORD>(errno);
+    return true;
+  }
+}
+
+bool EpollPort::TryConnect(IoCtx* ctx, Completion& out) {
+  int err       = 0;
+  socklen_t len = sizeof(err);
+  if (::getsockopt(ctx->sock, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+    err = errno;
+  }
+  if (err == 0) {
+    // 关联时产生的初始事件可能先于连接建立到达，此时还没有对端，继续等待
+    sockaddr_in peer{};
+    socklen_t peerLen = sizeof(peer);
+    if (::getpeername(ctx->sock, reinterpret_cast<sockaddr*>(&peer), &peerLen) != 0) {
+      return false;
+    }
+  }
+  out.ctx   = ctx;
+  out.error = static_cast<DWORD>(err);
+  return true;
+}
+
+bool EpollPort::PostAccept(SOCKET listenSock, IoCtx* ctx) {
+  SockSlot* slot = GetSlot(listenSock);
+  if (slot == nullptr) {
+    return false;
+  }
+
+  ctx->sock = INVALID_SOCKET;
+  ctx->op   = OpType::ACCEPT;
+
+  std::lock_guard<std::mutex> guard(slot->mtx);
+  Completion completion;
+  // 已有排队的Accept时保持先后顺序，否则先尝试直接完成
+  if (slot->acceptCtxs.empty() && TryAccept(slot, listenSock, ctx, completion)) {
+    Loop* loop = static_cast<Loop*>(currentLoop);
+    Complete(loop ? loop : loops_[0].get(), completion);
+  } else {
+    slot->acceptCtxs.push_back(ctx);
+  }
+  return true;
+}
+
+void EpollPort::GetAcceptAddrs(IoCtx* ctx, sockaddr_in* localAddr, sockaddr_in* remoteAddr) {
+  socklen_t localLen = sizeof(sockaddr_in), remoteLen = sizeof(sockaddr_in);
+  std::memset(localAddr, 0, sizeof(sockaddr_in));
+  std::memset(remoteAddr, 0, sizeof(sockaddr_in));
+  ::getsockname(ctx->sock, reinterpret_cast<sockaddr*>(localAddr), &localLen);
+  ::getpeername(ctx->sock, reinterpret_cast<sockaddr*>(remoteAddr), &remoteLen);
+}
+
+bool EpollPort::PostConnect(IoCtx* ctx) {
+  SockSlot* slot = GetSlot(ctx->sock);
+  if (slot == nullptr) {
+    return false;
+  }
+
+  ctx->op = OpType::CONNECT;
+
+  std::lock_guard<std::mutex> guard(slot->mtx);
+  if (slot->loop == nullptr || slot->sendCtx != nullptr) {
+    return false;
+  }
+
+  // 非阻塞connect：立即成功或失败时直接合成完成事件，否则等到套接字可写
+  Completion completion{ctx, slot->key, 0, 0};
+  if (::connect(ctx->sock, reinterpret_cast<sockaddr*>(&ctx->peerAddr), sizeof(ctx->peerAddr)) != 0) {
+    if (errno == EINPROGRESS || errno == EINTR) {
+      slot->sendCtx = ctx;
+      return true;
+    }
+    completion.error = static_cast<DWORD>(errno);
+  }
+  Complete(slot->loop, completion);
+  return true;
+}
+
+bool EpollPort::PostRecv(IoCtx* ctx) {
+  ctx->op = OpType::RECV;
+  return PostRead(ctx);
+}
+
+bool EpollPort::PostRecvReady(IoCtx* ctx) {
+  ctx->op = OpType::RECV_READY;
+  return PostRead(ctx);
+}
+
+bool EpollPort::PostRead(IoCtx* ctx) {
+  SockSlot* slot = GetSlot(ctx->sock);
+  if (slot == nullptr) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(slot->mtx);
+  if (slot->loop == nullptr || slot->recvCtx != nullptr) {
+    LOG_ERROR("failed to post recv on socket %" PRIsock, ctx->sock);
+    return false;
+  }
+
+  Completion completion{nullptr, slot->key, 0, 0};
+  if (TryRecv(ctx, completion)) {
+    Complete(slot->loop, completion);
+  } else {
+    slot->recvCtx = ctx;
+  }
+  return true;
+}
+
+bool EpollPort::PostSend(IoCtx* ctx) {
+  SockSlot* slot = GetSlot(ctx->sock);
+  if (slot == nullptr) {
+    return false;
+  }
+
+  ctx->op = OpType::SEND;
+
+  std::lock_guard<std::mutex> guard(slot->mtx);
+  if (slot->loop == nullptr || slot->sendCtx != nullptr) {
+    return false;
+  }
+
+  Completion completion{nullptr, slot->key, 0, 0};
+  if (TrySend(ctx, completion)) {
+    Complete(slot->loop, completion);
+  } else {
+    slot->sendCtx = ctx;
+  }
+  return true;
+}
+
+bool EpollPort::PostSendFile(IoCtx* ctx) {
+  return PostSend(ctx); // TrySend按ctx->sendFile选择sendfile
+}
+
+void EpollPort::Shutdown(SOCKET sock) {
+  ::shutdown(sock, SHUT_RDWR);
+
+  SockSlot* slot = GetSlot(sock);
+  if (slot == nullptr) {
+    return;
+  }
+
+  // 挂起的操作直接以ECANCELED完成，不依赖shutdown之后是否还有就绪事件
+  std::lock_guard<std::mutex> guard(slot->mtx);
+  if (slot->loop == nullptr) {
+    return;
+  }
+  if (slot->recvCtx != nullptr) {
+    Complete(slot->loop, Completion{slot->recvCtx, slot->key, 0, ECANCELED});
+    slot->recvCtx = nullptr;
+  }
+  if (slot->sendCtx != nullptr) {
+    Complete(slot->loop, Completion{slot->sendCtx, slot->key, 0, ECANCELED});
+    slot->sendCtx = nullptr;
+  }
+}
+
+void EpollPort::Close(SOCKET sock) {
+  SockSlot* slot = GetSlot(sock);
+  if (slot != nullptr) {
+    std::lock_guard<std::mutex> guard(slot->mtx);
+    ++slot->gen; // 之后到达的就绪事件都视为过期
+    slot->loop    = nullptr;
+    slot->recvCtx = nullptr;
+    slot->sendCtx = nullptr;
+    slot->acceptCtxs.clear();
+  }
+  // close会把fd从epoll中移除
+  ::close(sock);
+}
+
+void EpollPort::HandleEvent(Loop* loop, std::uint64_t data, std::uint32_t events) {
+  if (data == kWakeupData) {
+    std::uint64_t count;
+    while (::read(loop->wakeFd, &count, sizeof(count)) > 0) {
+    }
+    return;
+  }
+
+  SOCKET sock       = static_cast<SOCKET>(data & 0xFFFFFFFFu);
+  std::uint32_t gen = static_cast<std::uint32_t>(data >> 32);
+  SockSlot* slot    = GetSlot(sock);
+  if (slot == nullptr) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(slot->mtx);
+  if (slot->gen != gen) {
+    return; // fd已关闭或被复用
+  }
+
+  Completion completion{nullptr, slot->key, 0, 0};
+  if (slot->loop == nullptr) {
+    // 监听套接字：用排队的Accept尽量取完已到达的连接
+    while (!slot->acceptCtxs.empty() &&
+           TryAccept(slot, sock, slot->acceptCtxs.front(), completion)) {
+      slot->acceptCtxs.pop_front();
+      Complete(loop, completion);
+    }
+    return;
+  }
+
+  if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && slot->recvCtx != nullptr &&
+      TryRecv(slot->recvCtx, completion)) {
+    slot->recvCtx = nullptr;
+    Complete(slot->loop, completion);
+  }
+
+  completion = Completion{nullptr, slot->key, 0, 0};
+  if ((events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && slot->sendCtx != nullptr &&
+      TrySend(slot->sendCtx, completion)) {
+    slot->sendCtx = nullptr;
+    Complete(slot->loop, completion);
+  }
+}
+
+void EpollPort::Complete(Loop* loop, const Completion& completion) {
+  {
+    std::lock_guard<std::mutex> guard(loop->mtx);
+    loop->ready.push_back(completion);
+  }
+
+  // 目标线程就是当前线程时，它会在下一次Dequeue时取到，无需唤醒
+  if (loop != currentLoop) {
+    std::uint64_t one = 1;
+    ssize_t ret       = ::write(loop->wakeFd, &one, sizeof(one));
+    (void)ret;
+  }
+}
+
+bool EpollPort::Dequeue(size_t worker, Completion* out, size_t maxCount, size_t& count, int timeoutMs) {
+  Loop* loop  = loops_[worker % loops_.size()].get();
+  currentLoop = loop;
+  count       = 0;
+
+  // 就绪事件未必合成出完成事件，按截止时间计算每次等待的剩余时长
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+  epoll_event events[kMaxEvents];
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> guard(loop->mtx);
+      while (!loop->ready.empty() && count < maxCount) {
+        out[count++] = loop->ready.front();
+        loop->ready.pop_front();
+      }
+      if (count > 0) {
+        return true;
+      }
+    }
+
+    int wait = -1;
+    if (timeoutMs >= 0) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      wait = static_cast<int>(std::max<std::int64_t>(remaining.count(), 0));
+    }
+
+    int n = ::epoll_wait(loop->epollFd, events, kMaxEvents, wait);
+    if (n == 0 && wait >= 0) {
+      return true; // 超时
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG_ERROR("epoll_wait failed with error: %d", errno);
+      return false;
+    }
+
+    for (int i = 0; i < n; ++i) {
+      HandleEvent(loop, events[i].data.u64, events[i].events);
+    }
+  }
+}
+
+void EpollPort::Wakeup() {
+  Loop* loop = loops_[nextLoop_.fetch_add(1, std::memory_order_relaxed) % loops_.size()].get();
+  Complete(loop, Completion{});
+}
+
+#endif
@@ -0,0 +1,56 @@
+#include "File.h"
+
+#include "log.h"
+
+#ifndef _WIN32
+  #include <fcntl.h>
+  #include <sys/stat.h>
+#endif
+
+std::shared_ptr<File> File::open(const std::string& path) {
+#ifdef _WIN32
+  // TransmitFile以重叠方式读取文件
+  FileHandle handle = ::CreateFileA(path.c_str(),
+                                    GENERIC_READ,
+                                    FILE_SHARE_READ,
+                                    NULL,
+                                    OPEN_EXISTING,
+                                    FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN,
+                                    NULL);
+  DWORD error       = ::GetLastError();
+#else
+  FileHandle handle = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  int error         = errno;
+#endif
+  if (handle == INVALID_FILE_HANDLE) {
+    LOG_ERROR("failed to open file %s, error: %d", path.c_str(), static_cast<int>(error));
+    return nullptr;
+  }
+  return std::make_shared<File>(handle);
+}
+
+File::~File() {
+  if (handle_ != INVALID_FILE_HANDLE) {
+#ifdef _WIN32
+    ::CloseHandle(handle_);
+#else
+    ::close(handle_);
+#endif
+  }
+}
+
+std::uint64_t File::size() const {
+#ifdef _WIN32
+  LARGE_INTEGER size;
+  if (!::GetFileSizeEx(handle_, &size)) {
+    return 0;
+  }
+  return static_cast<std::uint64_t>(size.QuadPart);
+#else
+  struct stat st;
+  if (::fstat(handle_, &st) != 0) {
+    return 0;
+  }
+  return static_cast<std::uint64_t>(st.st_size);
+#endif
+}
@@ -0,0 +1,66 @@
+#include "FramePool.h"
+
+#include <new>
+#include <vector>
+
+namespace {
+
+constexpr size_t kClasses   = FramePool::kMaxPooledSize / FramePool::kGranularity;
+constexpr size_t kMaxCached = 64; // 每个级别在线程缓存中的上限
+
+// 大小为size的帧所在的级别，级别k的块大小为(k + 1) * kGranularity
+size_t classOf(size_t size) { return (size + FramePool::kGranularity - 1) / FramePool::kGranularity - 1; }
+
+struct ThreadCache {
+  std::vector<void*> freeLists[kClasses];
+
+  ~ThreadCache() {
+    for (auto& freeList : freeLists) {
+      for (void* frame : freeList) {
+        ::operator delete(frame);
+      }
+    }
+  }
+};
+
+ThreadCache& localCache() {
+  thread_local ThreadCache cache;
+  return cache;
+}
+
+} // namespace
+
+void* FramePool::Allocate(size_t size) {
+  if (size == 0 || size > kMaxPooledSize) {
+    return ::operator new(size);
+  }
+
+  size_t cls                  = classOf(size);
+  std::vector<void*>& freeList = localCache().freeLists[cls];
+  if (!freeList.empty()) {
+    void* frame = freeList.back();
+    freeList.pop_back();
+    return frame;
+  }
+  return ::operator new((cls + 1) * kGranularity);
+}
+
+void FramePool::Release(void* frame, size_t size) noexcept {
+  if (frame == nullptr) {
+    return;
+  }
+  if (size == 0 || size > kMaxPooledSize) {
+    ::operator delete(frame);
+    return;
+  }
+
+  std::vector<void*>& freeList = localCache().freeLists[classOf(size)];
+  if (freeList.size() >= kMaxCached) {
+    ::operator delete(frame);
+    return;
+  }
+  if (freeList.capacity() == 0) {
+    freeList.reserve(kMaxCached);
+  }
+  freeList.push_back(frame);
+}
@@ -1,22 +1,43 @@
 #include "IOCPServer.h"
+#include "ComputePool.h"
+#include "MetricsListener.h"
 #include "WorkerThread.h"
 
-#include <Mswsock.h> // 添加Mswsock.h头文件
 #include <algorithm>
+#include <chrono>
+#include <limits>
+#include <csignal>
 #include <exception>
 #include <iostream>
 #include <log.h>
 
+namespace {
+
+// Accept深度的调整周期
+constexpr std::chrono::milliseconds kAcceptTuneInterval(100);
+
+// 目标深度足以容纳这段时间内按当前速率到达的连接
+constexpr std::chrono::milliseconds kAcceptHorizon(20);
+
+} // namespace
+
 // 定义SIO_KEEPALIVE_VALS
-#ifndef SIO_KEEPALIVE_VALS
+#if defined(_WIN32) && !defined(SIO_KEEPALIVE_VALS)
   #define SIO_KEEPALIVE_VALS _WSAIOW(IOC_VENDOR, 4)
 #endif
 
+#ifdef _WIN32
+// SIO_KEEPALIVE_VALS的参数，与mstcpip.h中的tcp_keepalive相同
+struct KeepAliveVals {
+  ULONG onoff;
+  ULONG keepalivetime;     // 毫秒
+  ULONG keepaliveinterval; // 毫秒
+};
+#endif
+
 IOCPServer::IOCPServer(const std::string& address, unsigned short port)
     : address_(address)
     , port_(port)
-    , listenSocket_(INVALID_SOCKET)
-    , completionPort_(NULL)
     , running_(false) {}
 
 IOCPServer::~IOCPServer() { Stop(); }
@@ -41,20 +62,41 @@ bool IOCPServer::Start() {
     // 启动工作线程
     StartWorkerThreads();
 
-    // 创建监听套接字
-    if (!CreateListenSocket()) {
-      throw std::runtime_error("failed to CreateListenSocket");
+    compute_.reset();
+    if (computeThreads_ > 0) {
+      compute_ = std::make_shared<ComputePool>(computeThreads_);
+      compute_->Start();
     }
 
-    if (!InitializeExtraFunc()) {
-      throw std::runtime_error("failed to InitializeExtraFunc");
+    // 创建监听套接字并投递初始Accept请求；分片模式下各分片以SO_REUSEPORT分别监听，
+    // Windows没有对应的负载均衡，只由第0个分片监听
+#ifdef _WIN32
+    size_t listeners = 1;
+#else
+    size_t listeners = shards_.size();
+#endif
+    for (size_t i = 0; i < listeners; ++i) {
+      if (!CreateListenSocket(*shards_[i], listeners > 1)) {
+        throw std::runtime_error("failed to CreateListenSocket");
+      }
+      PreparePostAccept(i);
     }
 
-    // 投递初始Accept请求
-    PreparePostAccept();
+    // 开启指标导出
+    if (metricsPort_ != 0) {
+      metricsListener_ = std::make_unique<MetricsListener>(
+          metricsAddress_, metricsPort_, [this]() { return getMetrics().ToPrometheus(); });
+      if (!metricsListener_->Start()) {
+        metricsListener_.reset();
+        throw std::runtime_error("failed to start the metrics listener");
+      }
+    }
 
   } catch (const std::exception& e) {
-    LOG("failed to start IOCP server, detail: %s", e.what());
+    LOG_ERROR("failed to start IOCP server, detail: %s", e.what());
+    if (compute_) {
+      compute_->Stop();
+    }
     running_.store(false, std::memory_order_release);
     return false;
   }
@@ -69,104 +111,118 @@ void IOCPServer::Stop() {
     return; // 服务器已停止
   }
 
+  // 先停止指标导出，它读取的分片与工作线程随后会被销毁
+  metricsListener_.reset();
+
+  // 停止计算线程，丢弃未执行的任务，释放它们持有的session引用
+  if (compute_) {
+    compute_->Stop();
+  }
+
+  // 中止所有连接的挂起I/O，并等待工作线程取走这些I/O的完成事件，session随最后一个在途IoCtx释放。
+  // 超时后仍存活的session（I/O未能中止，或调用方仍持有引用）与分片共同持有完成端口，
+  // 端口在它们都析构之后才销毁，析构时关闭套接字不会访问已释放的端口
+  std::vector<std::weak_ptr<Session>> closing;
+  for (auto& session : sessions_.Clear()) {
+    session->shutdown();
+    closing.push_back(session);
+  }
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (std::chrono::steady_clock::now() < deadline &&
+         std::any_of(closing.begin(), closing.end(), [](const std::weak_ptr<Session>& session) {
+           return !session.expired();
+         })) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
   // 停止所有工作线程
   for (auto& thread : workerThreads_) {
     thread->Stop();
   }
 
-  for (size_t i = 0; i < workerThreads_.size(); ++i) {
-    ::PostQueuedCompletionStatus(completionPort_, 0, NULL, NULL);
+  size_t workersPerShard = shards_.empty() ? 0 : workerThreads_.size() / shards_.size();
+  for (auto& shard : shards_) {
+    for (size_t i = 0; i < workersPerShard; ++i) {
+      shard->port->Wakeup();
+    }
   }
 
   workerThreads_.clear();
 
-  // 关闭监听套接字
-  if (listenSocket_ != INVALID_SOCKET) {
-    closesocket(listenSocket_);
-    listenSocket_ = INVALID_SOCKET;
+  for (auto& shard : shards_) {
+    // 关闭监听套接字；完成端口可能仍被存活的session持有，先shutdown结束其上挂起的Accept
+    if (shard->listenSocket != INVALID_SOCKET) {
+      shard->port->Shutdown(shard->listenSocket);
+      closesocket(shard->listenSocket);
+      shard->listenSocket = INVALID_SOCKET;
+    }
+
+    // 释放分片对完成端口的引用，没有session持有时端口随之关闭
+    shard->port.reset();
   }
+  shards_.clear();
 
-  // 关闭完成端口
-  if (completionPort_) {
-    CloseHandle(completionPort_);
-    completionPort_ = NULL;
+  // 尚未完成的主动连接的套接字已随分片的Connect上下文池关闭，不再回调
+  {
+    std::lock_guard<std::mutex> guard(connectMtx_);
+    connects_.clear();
   }
 
+#ifdef _WIN32
   // 清理Windows Socket
   WSACleanup();
+#endif
 }
 
-void IOCPServer::RemoveSession(SOCKET target) {
-  std::lock_guard<std::mutex> guard(sessionsMtx_);
-  sessions_.erase(target);
+void IOCPServer::RemoveSession(const std::shared_ptr<Session>& session) {
+  sessions_.Remove(session->getId());
+  session->shutdown();
 }
 
 bool IOCPServer::InitializeWinsock() {
+#ifdef _WIN32
   WSADATA wsaData;
   int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
   if (result != 0) {
     std::cerr << "WSAStartup failed with error: " << result << std::endl;
     return false;
   }
+#else
+  // sendfile/splice写入已断开的连接时没有MSG_NOSIGNAL可用，忽略SIGPIPE，改由返回的EPIPE处理
+  ::signal(SIGPIPE, SIG_IGN);
+#endif
   return true;
 }
 
-void IOCPServer::PreparePostAccept() {
-  for (size_t i = 0; i < MAX_POST_ACCEPT; ++i) {
-    auto ctx = listenerCxt_->newIoCtx();
-    auto ok  = this->PostAccept(ctx);
-    if (!ok) {
-      listenerCxt_->removeIoCtx(ctx);
-    }
-  }
-}
-
-bool IOCPServer::InitializeExtraFunc() { // 获取AcceptEx函数指针
-  GUID GuidAcceptEx             = WSAID_ACCEPTEX;
-  GUID GuidGetAcceptExSockAddrs = WSAID_GETACCEPTEXSOCKADDRS;
-  DWORD dwBytes                 = 0;
-
-  if (SOCKET_ERROR == WSAIoctl(listenSocket_,
-                               SIO_GET_EXTENSION_FUNCTION_POINTER,
-                               &GuidAcceptEx,
-                               sizeof(GuidAcceptEx),
-                               &lpfnAcceptEx_,
-                               sizeof(lpfnAcceptEx_),
-                               &dwBytes,
-                               NULL,
-                               NULL)) {
-    LOG("failed to get the pointer to AcceptEx, error: %d", WSAGetLastError());
-    return false;
-  }
-
-  // 获取GetAcceptExSockAddrs函数指针，也是同理
-  if (SOCKET_ERROR == WSAIoctl(listenSocket_,
-                               SIO_GET_EXTENSION_FUNCTION_POINTER,
-                               &GuidGetAcceptExSockAddrs,
-                               sizeof(GuidGetAcceptExSockAddrs),
-                               &lpfnGetAcceptExSockAddrs_,
-                               sizeof(lpfnGetAcceptExSockAddrs_),
-                               &dwBytes,
-                               NULL,
-                               NULL)) {
-    LOG("failed to get the pointer to GuidGetAcceptExSockAddrs, error: %d", WSAGetLastError());
-    return false;
-  }
+void IOCPServer::PreparePostAccept(size_t index) {
+  Shard& shard = *shards_[index];
+  shard.acceptTarget.store(minAccepts_, std::memory_order_relaxed);
+  shard.port->ReserveAcceptSockets(minAccepts_);
+  TopUpAccepts(shard);
 
-  return true;
+  // 调整定时器在该分片的第一个工作线程上执行
+  shard.tuneWheel = workerThreads_[index * (workerThreads_.size() / shards_.size())]->GetTimerWheel();
+  shard.tuneTimer = TimerWheel::Create([this, &shard] { TuneAcceptDepth(shard); });
+  shard.tuneWheel->Arm(shard.tuneTimer, kAcceptTuneInterval);
 }
 
-bool IOCPServer::CreateListenSocket() {
+bool IOCPServer::CreateListenSocket(Shard& shard, bool reusePort) {
   // 创建TCP套接字
-  listenSocket_ = WSASocket(AF_INET, SOCK_STREAM, 0, NULL, 0, WSA_FLAG_OVERLAPPED);
-  if (listenSocket_ == INVALID_SOCKET) {
+#ifdef _WIN32
+  SOCKET listenSocket = WSASocket(AF_INET, SOCK_STREAM, 0, NULL, 0, WSA_FLAG_OVERLAPPED);
+#else
+  SOCKET listenSocket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#endif
+  if (listenSocket == INVALID_SOCKET) {
     std::cerr << "WSASocket failed with error: " << WSAGetLastError() << std::endl;
     return false;
   }
 
+  shard.listenSocket = listenSocket;
+
   // 设置地址重用选项
   BOOL reuseAddr = TRUE;
-  if (setsockopt(listenSocket_,
+  if (setsockopt(listenSocket,
                  SOL_SOCKET,
                  SO_REUSEADDR,
                  reinterpret_cast<char*>(&reuseAddr),
@@ -175,176 +231,548 @@ bool IOCPServer::CreateListenSocket() {
     return false;
   }
 
+#ifndef _WIN32
+  // 各分片的监听套接字绑定同一地址，内核按连接的四元组哈希分给其中之一
+  int reuse = 1;
+  if (reusePort &&
+      ::setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) != 0) {
+    LOG_ERROR("setsockopt SO_REUSEPORT failed with error: %d", WSAGetLastError());
+    return false;
+  }
+#else
+  (void)reusePort;
+#endif
+
   // u_long mode = 1;
-  // if (ioctlsocket(listenSocket_, FIONBIO, &mode) == SOCKET_ERROR) {
+  // if (ioctlsocket(listenSocket, FIONBIO, &mode) == SOCKET_ERROR) {
   //   std::cerr << "ioctlsocket failed with error: " << WSAGetLastError() << std::endl;
   //   return false;
   // }
 
-  if (!AssociateWithIOCP(this->listenSocket_, NULL)) {
-    LOG("AssociateWithIOCP failed with error: %d", GetLastError());
-    return false;
-  }
-
   // 绑定地址和端口
   sockaddr_in serverAddr;
   serverAddr.sin_family      = AF_INET;
   serverAddr.sin_addr.s_addr = inet_addr(address_.c_str());
   serverAddr.sin_port        = htons(port_);
 
-  if (bind(listenSocket_, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) ==
+  if (bind(listenSocket, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) ==
       SOCKET_ERROR) {
-    LOG("bind failed with error: %d", GetLastError());
+    LOG_ERROR("bind failed with error: %d", WSAGetLastError());
     return false;
   }
 
   // 开始监听
-  if (listen(listenSocket_, SOMAXCONN) == SOCKET_ERROR) {
-    LOG("listen failed with error: %d", GetLastError());
+  if (listen(listenSocket, SOMAXCONN) == SOCKET_ERROR) {
+    LOG_ERROR("listen failed with error: %d", WSAGetLastError());
     return false;
   }
 
-  listenerCxt_ = std::make_unique<SockCtx>(listenSocket_);
+  if (!shard.port->Listen(listenSocket)) {
+    return false;
+  }
+
+  shard.listenerCtx = std::make_unique<SockCtx>(listenSocket);
 
   return true;
 }
 
 bool IOCPServer::CreateCompletionPort() {
-  // 创建完成端口
-  completionPort_ = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
-  if (completionPort_ == NULL) {
-    std::cerr << "CreateIoCompletionPort failed with error: " << GetLastError() << std::endl;
-    return false;
+  // 创建完成端口：分片模式下每个工作线程一个，否则由所有工作线程共享一个
+  shards_.clear();
+  for (size_t i = 0; i < (shardedLoops_ ? WorkerCount() : 1); ++i) {
+    shards_.push_back(std::make_unique<Shard>());
+  }
+  for (auto& shard : shards_) {
+    shard->port = CompletionPort::Create(WorkerCount() / shards_.size());
+    if (shard->port == nullptr) {
+      std::cerr << "failed to create completion port" << std::endl;
+      return false;
+    }
+    shard->connectorCtx = std::make_unique<SockCtx>(INVALID_SOCKET);
   }
 
   return true;
 }
 
-bool IOCPServer::AssociateWithIOCP(SOCKET sock, ULONG_PTR key) {
-  HANDLE hTemp = ::CreateIoCompletionPort((HANDLE)sock, this->completionPort_, key, 0);
-  if (hTemp == NULL) {
-    return false;
-  }
-  return true;
+bool IOCPServer::AssociateWithIOCP(CompletionPort& port, SOCKET sock, ULONG_PTR key) {
+  return port.Associate(sock, key);
 }
 
 void IOCPServer::StartWorkerThreads() {
-  // 创建工作线程
-  for (size_t i = 0; i < MAX_WORKER_THREADS; ++i) {
-    auto thread = std::make_unique<WorkerThread>(*this, completionPort_);
-    thread->Start();
-    workerThreads_.push_back(std::move(thread));
+  // 创建工作线程，分片模式下第i个线程独占第i个分片
+  size_t workersPerShard = WorkerCount() / shards_.size();
+  workerMetrics_.clear();
+  for (size_t shard = 0; shard < shards_.size(); ++shard) {
+    for (size_t i = 0; i < workersPerShard; ++i) {
+      workerMetrics_.push_back(std::make_unique<WorkerMetrics>());
+      auto thread = std::make_unique<WorkerThread>(
+          *this, *shards_[shard]->port, i, shard, completionBatchSize_, *workerMetrics_.back());
+      thread->Start();
+      workerThreads_.push_back(std::move(thread));
+    }
   }
 }
 
-bool IOCPServer::PostAccept(IoCtx* ctx) {
-  // 为以后新连入的客户端先准备好Socket
-  ctx->sock = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
-  if (INVALID_SOCKET == ctx->sock) {
-    LOG("WSASocket failed with error: %d", GetLastError());
-    return false;
+bool IOCPServer::PostAccept(Shard& shard, IoCtx* ctx) {
+  return shard.port->PostAccept(shard.listenSocket, ctx);
+}
+
+void IOCPServer::TopUpAccepts(Shard& shard, IoCtx* reuse) {
+  // 先占用名额再投递，多个工作线程同时补充时不会超出目标深度
+  size_t pending = shard.acceptsPending.load(std::memory_order_relaxed);
+  while (pending < shard.acceptTarget.load(std::memory_order_relaxed)) {
+    if (!shard.acceptsPending.compare_exchange_weak(pending, pending + 1, std::memory_order_relaxed)) {
+      continue;
+    }
+
+    IoCtx* ctx = reuse != nullptr ? reuse : shard.listenerCtx->newIoCtx();
+    reuse      = nullptr;
+    if (!PostAccept(shard, ctx)) {
+      LOG_ERROR("PostAccept failed");
+      shard.acceptsPending.fetch_sub(1, std::memory_order_relaxed);
+      shard.acceptFailed.fetch_add(1, std::memory_order_relaxed);
+      shard.listenerCtx->removeIoCtx(ctx);
+      break;
+    }
+    pending = shard.acceptsPending.load(std::memory_order_relaxed);
   }
 
-  DWORD bytes;
-  WSABUF* pWsaBuf = &ctx->wsaBuf;
-  OVERLAPPED* pOl = &ctx->overlapped;
-  ctx->op         = OpType::ACCEPT;
-  BOOL ret        = this->lpfnAcceptEx_(listenerCxt_->getSocket(),
-                                 ctx->sock,
-                                 pWsaBuf->buf,
-                                 0,
-                                 sizeof(sockaddr_in) + 16,
-                                 sizeof(sockaddr_in) + 16,
-                                 &bytes,
-                                 pOl);
-  if (ret == FALSE) {
-    if (WSA_IO_PENDING != WSAGetLastError()) {
-      LOG("AcceptEx failed with error: %d", WSAGetLastError());
-      return false;
+  if (reuse != nullptr) {
+    shard.listenerCtx->removeIoCtx(reuse); // 目标深度已降低，多出的Accept不再投递
+  }
+}
+
+void IOCPServer::SetAcceptTarget(Shard& shard, size_t target, std::uint64_t rate) {
+  target          = std::clamp(target, minAccepts_, maxAccepts_);
+  size_t previous = shard.acceptTarget.exchange(target, std::memory_order_relaxed);
+  if (target == previous) {
+    return;
+  }
+
+  (target > previous ? shard.depthGrows : shard.depthShrinks).fetch_add(1, std::memory_order_relaxed);
+  LOG_DEBUG("socket %" PRIsock " Accept深度 %zu -> %zu，接受速率 %llu/s",
+            shard.listenSocket,
+            previous,
+            target,
+            static_cast<unsigned long long>(rate));
+}
+
+void IOCPServer::TuneAcceptDepth(Shard& shard) {
+  if (!running_.load(std::memory_order_acquire)) {
+    return;
+  }
+
+  std::uint64_t accepted = shard.accepted.load(std::memory_order_relaxed);
+  std::uint64_t rate     = (accepted - shard.acceptedAtTune) * 1000 / kAcceptTuneInterval.count();
+  shard.acceptedAtTune   = accepted;
+  shard.acceptRate.store(rate, std::memory_order_relaxed);
+
+  // 按速率估算所需的深度；降低时每个周期至多减半，避免速率抖动时反复回收、投递
+  size_t current = shard.acceptTarget.load(std::memory_order_relaxed);
+  size_t wanted  = static_cast<size_t>(rate * kAcceptHorizon.count() / 1000);
+  if (wanted < current) {
+    wanted = std::max(wanted, current / 2);
+  }
+  SetAcceptTarget(shard, wanted, rate);
+
+  // 在定时器上而不是每次Accept时预先创建套接字（仅IOCP需要），并补足出错后回收的Accept
+  shard.port->ReserveAcceptSockets(shard.acceptTarget.load(std::memory_order_relaxed));
+  TopUpAccepts(shard);
+
+  shard.tuneWheel->Arm(shard.tuneTimer, kAcceptTuneInterval);
+}
+
+IOCPServer::AcceptStats IOCPServer::getAcceptStats() const {
+  AcceptStats stats;
+  for (const auto& shard : shards_) {
+    if (shard->listenSocket == INVALID_SOCKET) {
+      continue;
     }
+    stats.depth += shard->acceptsPending.load(std::memory_order_relaxed);
+    stats.target += shard->acceptTarget.load(std::memory_order_relaxed);
+    stats.accepted += shard->accepted.load(std::memory_order_relaxed);
+    stats.failed += shard->acceptFailed.load(std::memory_order_relaxed);
+    stats.grows += shard->depthGrows.load(std::memory_order_relaxed);
+    stats.shrinks += shard->depthShrinks.load(std::memory_order_relaxed);
+    stats.rate += shard->acceptRate.load(std::memory_order_relaxed);
   }
-  return true;
+  return stats;
+}
+
+MetricsSnapshot IOCPServer::getMetrics() const {
+  MetricsSnapshot snapshot;
+  for (const auto& metrics : workerMetrics_) {
+    snapshot.Collect(*metrics);
+  }
+  snapshot.sessions         = sessions_.Size();
+  snapshot.pendingSendBytes = Session::getGlobalPendingSendBytes();
+  snapshot.accept           = getAcceptStats();
+  if (compute_) {
+    snapshot.compute = compute_->getStats();
+  }
+  return snapshot;
 }
 
 bool IOCPServer::PostRecv(IoCtx* ctx) {
-  DWORD flags = 0, bytes = 0;
-  WSABUF* pWsaBuf = &ctx->wsaBuf;
-  OVERLAPPED* pOl = &ctx->overlapped;
+  // 接收直接写入session输入缓冲区的可写空间，不再经由IoCtx中转
+  ctx->session->prepareRecv(ctx);
+  return ctx->session->port_->PostRecv(ctx);
+}
 
-  ctx->ResetBuffer();
-  ctx->op        = OpType::RECV;
-  int nbytesRecv = ::WSARecv(ctx->sock, pWsaBuf, 1, &bytes, &flags, pOl, NULL);
+bool IOCPServer::PostRecvReady(IoCtx* ctx) {
+  ctx->recvBufCount = 0;
+  return ctx->session->port_->PostRecvReady(ctx);
+}
 
-  if ((nbytesRecv == SOCKET_ERROR) && (WSAGetLastError() != WSA_IO_PENDING)) {
-    LOG("failed to post recv on socket %d", ctx->sock);
-    return false;
-  }
-  return true;
+void IOCPServer::AbortRecv(IoCtx* ctx) {
+  std::shared_ptr<Session> session = std::move(ctx->session);
+  session->getSockCtx()->removeIoCtx(ctx);
+  RemoveSession(session);
 }
 
-void IOCPServer::HandleAccept(IoCtx* ctx) {
-  sockaddr_in* LocalAddr  = NULL;
-  sockaddr_in* ClientAddr = NULL;
-  int remoteLen = sizeof(sockaddr_in), localLen = sizeof(sockaddr_in);
-  this->lpfnGetAcceptExSockAddrs_(ctx->wsaBuf.buf,
-                                  0,
-                                  sizeof(sockaddr_in) + 16,
-                                  sizeof(sockaddr_in) + 16,
-                                  (LPSOCKADDR*)&LocalAddr,
-                                  &localLen,
-                                  (LPSOCKADDR*)&ClientAddr,
-                                  &remoteLen);
-  auto session = std::make_shared<Session>(ctx->sock, LocalAddr, ClientAddr);
+void IOCPServer::HandleAccept(IoCtx* ctx, size_t shard) {
+  Shard& acceptor = *shards_[shard];
+
+  sockaddr_in LocalAddr{};
+  sockaddr_in ClientAddr{};
+  acceptor.port->GetAcceptAddrs(ctx, &LocalAddr, &ClientAddr);
+
+  SOCKET sock = ctx->sock;
+  ctx->sock   = INVALID_SOCKET; // 套接字的所有权转交给Session
+  acceptor.accepted.fetch_add(1, std::memory_order_relaxed);
+
+  // 先补上这个Accept再处理新连接，新连接处理失败也不会减少在途的Accept；
+  // 在途的Accept全部用完说明连接到达得比补充快，立即加倍目标深度，不等下一次调整
+  if (acceptor.acceptsPending.fetch_sub(1, std::memory_order_relaxed) == 1) {
+    SetAcceptTarget(acceptor,
+                    acceptor.acceptTarget.load(std::memory_order_relaxed) * 2,
+                    acceptor.acceptRate.load(std::memory_order_relaxed));
+  }
+  TopUpAccepts(acceptor, ctx);
+
+  // 分片模式下连接留在接受它的分片；Windows下只有第0个分片监听，新连接轮流分给各分片
+  size_t target = shard;
+#ifdef _WIN32
+  if (shardedLoops_) {
+    target = nextShard_.fetch_add(1, std::memory_order_relaxed) % shards_.size();
+  }
+#endif
+  CompletionPort& port = *shards_[target]->port;
+
+  auto session = std::make_shared<Session>(shards_[target]->port, sock, &LocalAddr, &ClientAddr);
   session->setConnectedCallback(onConnected_);
   session->setMessageCallback(onMessage_);
   session->setSendCompletedCallback(onSendComp_);
+  session->setHighWatermarkCallback(onHighWatermark_);
+  session->setWriteDrainedCallback(onWriteDrained_);
+  session->setWriteWatermarks(highWatermark_, lowWatermark_);
+  session->compute_ = compute_;
+  if (codec_) {
+    session->setCodec(codec_, onFrame_);
+  }
+  if (latencyTracing_) {
+    session->enableLatencyTracing();
+  }
 
-  bool ok = this->AssociateWithIOCP(ctx->sock, 0);
+  bool ok = this->AssociateWithIOCP(port, sock, 0);
   if (!ok) {
-    LOG("AssociateWithIOCP failed with error: %d", GetLastError());
+    LOG_ERROR("AssociateWithIOCP failed with error: %d", WSAGetLastError());
     return;
   }
 
+  if (keepAliveIdle_.count() > 0) {
+    SetKeepAlive(sock);
+  }
+
+  // 先登记session再投递recv，recv可能在其他工作线程上立即完成；
+  // 登记时分配id，onConnected中即可通过getId()取得
+  sessions_.Add(session);
+  AssignOwner(session, target);
+  ArmDeadline(session);
+
+  if (session->loop_ != nullptr) {
+    session->loop_->RunInLoop([this, session] { StartSession(session); });
+  } else {
+    StartSession(session);
+  }
+}
+
+void IOCPServer::HandleAcceptError(IoCtx* ctx, size_t shard) {
+  Shard& acceptor = *shards_[shard];
+  acceptor.acceptsPending.fetch_sub(1, std::memory_order_relaxed);
+  acceptor.acceptFailed.fetch_add(1, std::memory_order_relaxed);
+  acceptor.listenerCtx->removeIoCtx(ctx);
+}
+
+void IOCPServer::AssignOwner(const std::shared_ptr<Session>& session, size_t shard) {
+  WorkerThread* owner =
+      workerThreads_[shardedLoops_ ? shard : session->getId() % workerThreads_.size()].get();
+  session->timers_ = owner->GetTimerWheel();
+  if (shardedLoops_) {
+    session->loop_ = owner; // 之后session上的I/O都由owner投递
+  }
+}
+
+void IOCPServer::StartSession(const std::shared_ptr<Session>& session) {
   session->handleConnected();
+  if (onSession_) {
+    // 协程先运行到第一次等待，之后才投递接收
+    session->startCoroutine(onSession_);
+  }
+  PostFirstRecv(session);
+}
 
-  auto newIoCtx = session->getSockCtx()->newIoCtx();
-  ok            = this->PostRecv(newIoCtx);
-  if (!ok) {
-    LOG("PostRecv failed with error: %d", GetLastError());
-    session->getSockCtx()->removeIoCtx(newIoCtx);
-    return;
+bool IOCPServer::Connect(const std::string& address, unsigned short port, onConnectCallback done) {
+  if (!IsRunning() || shards_.empty()) {
+    return false;
+  }
+
+  sockaddr_in remoteAddr{};
+  remoteAddr.sin_family = AF_INET;
+  remoteAddr.sin_port   = htons(port);
+  if (inet_pton(AF_INET, address.c_str(), &remoteAddr.sin_addr) != 1) {
+    LOG_ERROR("invalid address to connect: %s", address.c_str());
+    return false;
   }
 
+  // 分片模式下主动连接轮流分给各分片，此后它的I/O都在该分片上完成
+  size_t index =
+      shardedLoops_ ? nextShard_.fetch_add(1, std::memory_order_relaxed) % shards_.size() : 0;
+  Shard& shard = *shards_[index];
+
+#ifdef _WIN32
+  SOCKET sock = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+#else
+  SOCKET sock = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#endif
+  if (sock == INVALID_SOCKET) {
+    LOG_ERROR("socket failed with error: %d", WSAGetLastError());
+    return false;
+  }
+  if (!AssociateWithIOCP(*shard.port, sock, 0)) {
+    LOG_ERROR("AssociateWithIOCP failed with error: %d", WSAGetLastError());
+    shard.port->Close(sock);
+    return false;
+  }
+
+  IoCtx* ctx    = shard.connectorCtx->newIoCtx();
+  ctx->sock     = sock;
+  ctx->peerAddr = remoteAddr;
   {
-    std::lock_guard<std::mutex> guard(this->sessionsMtx_);
-    sessions_.insert({ctx->sock, std::move(session)});
+    // 先登记再投递，连接可能在其他工作线程上立即完成
+    std::lock_guard<std::mutex> guard(connectMtx_);
+    connects_[ctx] = PendingConnect{std::move(done), index};
   }
 
-  // post accept again
-  ctx->ResetBuffer();
-  ok = this->PostAccept(ctx);
-  if (!ok) {
-    LOG("PostAccept failed");
-    listenerCxt_->removeIoCtx(ctx);
+  if (!shard.port->PostConnect(ctx)) {
+    {
+      std::lock_guard<std::mutex> guard(connectMtx_);
+      connects_.erase(ctx);
+    }
+    ctx->sock = INVALID_SOCKET;
+    shard.connectorCtx->removeIoCtx(ctx);
+    shard.port->Close(sock);
+    return false;
+  }
+  return true;
+}
+
+void IOCPServer::HandleConnect(IoCtx* ctx, DWORD error) {
+  PendingConnect pending;
+  {
+    std::lock_guard<std::mutex> guard(connectMtx_);
+    auto it = connects_.find(ctx);
+    if (it == connects_.end()) {
+      return;
+    }
+    pending = std::move(it->second);
+    connects_.erase(it);
+  }
+
+  Shard& shard           = *shards_[pending.shard];
+  SOCKET sock            = ctx->sock;
+  sockaddr_in remoteAddr = ctx->peerAddr;
+  ctx->sock              = INVALID_SOCKET; // 套接字的所有权转交给Session，失败时在下面关闭
+  shard.connectorCtx->removeIoCtx(ctx);
+
+  if (error != 0) {
+    LOG_WARN("connect to %s:%u failed with error: %d",
+             ::inet_ntoa(remoteAddr.sin_addr),
+             static_cast<unsigned>(::ntohs(remoteAddr.sin_port)),
+             static_cast<int>(error));
+    shard.port->Close(sock);
+    if (pending.done) {
+      pending.done(nullptr, static_cast<int>(error));
+    }
     return;
   }
+
+#ifdef _WIN32
+  // ConnectEx建立的连接要先更新上下文，getsockname、shutdown等才能使用
+  ::setsockopt(sock, SOL_SOCKET, SO_UPDATE_CONNECT_CONTEXT, NULL, 0);
+#endif
+  sockaddr_in localAddr{};
+  socklen_t localLen = sizeof(localAddr);
+  ::getsockname(sock, reinterpret_cast<sockaddr*>(&localAddr), &localLen);
+
+  auto session = std::make_shared<Session>(shard.port, sock, &localAddr, &remoteAddr);
+  session->setWriteWatermarks(highWatermark_, lowWatermark_);
+  session->compute_ = compute_;
+  if (latencyTracing_) {
+    session->enableLatencyTracing();
+  }
+  if (keepAliveIdle_.count() > 0) {
+    SetKeepAlive(sock);
+  }
+
+  sessions_.Add(session);
+  AssignOwner(session, pending.shard);
+
+  auto start = [this, session, done = std::move(pending.done)] {
+    if (done) {
+      done(session, 0);
+    }
+    PostFirstRecv(session);
+  };
+  if (session->loop_ != nullptr) {
+    session->loop_->RunInLoop(std::move(start));
+  } else {
+    start();
+  }
 }
 
-void IOCPServer::HandleRecv(std::shared_ptr<Session> session, IoCtx* ctx, size_t recvBytes) {
-  session->handleRecv(ctx->buffer.data(), recvBytes);
-  PostRecv(ctx);
+void IOCPServer::PostFirstRecv(const std::shared_ptr<Session>& session) {
+  auto newIoCtx     = session->getSockCtx()->newIoCtx();
+  newIoCtx->session = session;
+
+  bool ok = leanIdleRecv_ ? this->PostRecvReady(newIoCtx) : this->PostRecv(newIoCtx);
+  if (!ok) {
+    LOG_ERROR("PostRecv failed with error: %d", WSAGetLastError());
+    newIoCtx->session.reset();
+    RemoveSession(session);
+  }
 }
 
-void IOCPServer::HandleSend(std::shared_ptr<Session> session, IoCtx* ctx, size_t writtenBytes) {
-  size_t needBytes = ctx->buffer.size();
-  if (writtenBytes < needBytes) {
-    session->handleSendUncompleted(ctx, writtenBytes);
+void IOCPServer::SetKeepAlive(SOCKET sock) {
+#ifdef _WIN32
+  KeepAliveVals vals{1,
+                     static_cast<ULONG>(keepAliveIdle_.count()),
+                     static_cast<ULONG>(keepAliveInterval_.count())};
+  DWORD bytes = 0;
+  if (WSAIoctl(sock, SIO_KEEPALIVE_VALS, &vals, sizeof(vals), nullptr, 0, &bytes, nullptr, nullptr) ==
+      SOCKET_ERROR) {
+    LOG_WARN("SIO_KEEPALIVE_VALS failed with error: %d", WSAGetLastError());
+  }
+#else
+  // TCP_KEEPIDLE/TCP_KEEPINTVL以秒为单位
+  int on       = 1;
+  int idle     = std::max(1, static_cast<int>(keepAliveIdle_.count() / 1000));
+  int interval = std::max(1, static_cast<int>(keepAliveInterval_.count() / 1000));
+  if (::setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) != 0 ||
+      ::setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) != 0 ||
+      ::setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) != 0) {
+    LOG_WARN("failed to enable keepalive, error: %d", WSAGetLastError());
+  }
+#endif
+}
+
+void IOCPServer::ArmDeadline(const std::shared_ptr<Session>& session) {
+  if (idleTimeout_.count() <= 0 && writeTimeout_.count() <= 0) {
     return;
   }
-  session->handleSendCompleted(ctx);
+
+  // 收发路径上只记录活动时间，不重设定时器；定时器到期时再按最近的活动时间判断
+  std::weak_ptr<Session> weak = session;
+  session->deadlineTimer_     = TimerWheel::Create([this, weak] {
+    if (auto session = weak.lock()) {
+      CheckDeadline(session);
+    }
+  });
+  session->timers_->Arm(session->deadlineTimer_,
+                        idleTimeout_.count() > 0 ? idleTimeout_ : writeTimeout_);
 }
 
-std::shared_ptr<Session> IOCPServer::getSession(SOCKET sock) const {
-  std::lock_guard<std::mutex> guard(sessionsMtx_);
-  return sessions_.at(sock);
+void IOCPServer::CheckDeadline(const std::shared_ptr<Session>& session) {
+  if (session->isClosed()) {
+    return;
+  }
+
+  std::int64_t now  = TimerWheel::NowMs();
+  std::int64_t next = std::numeric_limits<std::int64_t>::max();
+  bool timedOut     = false;
+  TimeoutType type  = TimeoutType::Idle;
+
+  if (idleTimeout_.count() > 0) {
+    std::int64_t last   = std::max(session->lastRecvMs_.load(std::memory_order_relaxed),
+                                 session->lastSendMs_.load(std::memory_order_relaxed));
+    std::int64_t remain = last + idleTimeout_.count() - now;
+    timedOut            = remain <= 0;
+    next                = remain;
+  }
+
+  if (!timedOut && writeTimeout_.count() > 0) {
+    std::int64_t remain = writeTimeout_.count();
+    if (session->isSending_.load(std::memory_order_acquire)) {
+      remain = session->lastSendMs_.load(std::memory_order_relaxed) + writeTimeout_.count() - now;
+    }
+    if (remain <= 0) {
+      timedOut = true;
+      type     = TimeoutType::WriteStall;
+    }
+    next = std::min(next, remain);
+  }
+
+  if (!timedOut) {
+    session->timers_->Arm(session->deadlineTimer_, std::chrono::milliseconds(next));
+    return;
+  }
+
+  LOG_INFO("socket %" PRIsock " %s超时，关闭连接",
+           session->getSockCtx()->getSocket(),
+           type == TimeoutType::Idle ? "空闲" : "写");
+  if (onTimeout_) {
+    onTimeout_(session, type);
+  }
+  RemoveSession(session);
+}
+
+void IOCPServer::HandleRecv(
+    std::shared_ptr<Session> session, IoCtx* ctx, size_t recvBytes, Timestamp receiveTime) {
+  // 没有填满准备的缓冲区，说明内核中的数据已被读空，连接接下来可能空闲
+  bool drained = recvBytes < ctx->RecvCapacity();
+
+  session->handleRecv(recvBytes, receiveTime);
+
+  // 引用随IoCtx再次投递，成功后不能再访问ctx，它可能已在其他线程完成
+  ctx->session = std::move(session);
+  if (pauseRecvOnHighWatermark_ && ctx->session->pauseRecvIfHighWatermark(ctx)) {
+    return; // 待发送数据回落到低水位时由HandleSend恢复
+  }
+  bool ok = (leanIdleRecv_ && drained) ? PostRecvReady(ctx) : PostRecv(ctx);
+  if (!ok) {
+    AbortRecv(ctx);
+  }
+}
+
+void IOCPServer::HandleRecvReady(std::shared_ptr<Session> session, IoCtx* ctx) {
+  ctx->session = std::move(session);
+  if (!PostRecv(ctx)) {
+    AbortRecv(ctx);
+  }
+}
+
+void IOCPServer::HandleSend(
+    std::shared_ptr<Session> session, IoCtx* ctx, size_t writtenBytes, Timestamp completedAt) {
+  if (IoCtx* paused = session->handleSendProgress(writtenBytes, ctx->sendFile != nullptr)) {
+    // 恢复因高水位暂停的接收，暂停的IoCtx仍持有session的引用
+    if (!PostRecv(paused)) {
+      AbortRecv(paused);
+    }
+  }
+
+  if (ctx->AdvanceSend(writtenBytes)) {
+    session->handleSendUncompleted(ctx);
+    return;
+  }
+  session->handleSendCompleted(ctx, completedAt);
 }
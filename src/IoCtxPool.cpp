@@ -0,0 +1,40 @@
+#include "IoCtxPool.h"
+
+#include "IOContext.h"
+#include "ThreadCachePool.h"
+
+namespace {
+
+constexpr size_t kSlabObjects = 64; // 每个slab容纳的IoCtx数量
+
+// IoCtx只随slab一起析构，全局链表不设上限
+using Pool = ThreadCachePool<IoCtx, SlabSource<IoCtx, kSlabObjects>>;
+
+} // namespace
+
+IoCtx* IoCtxPool::Acquire(SOCKET sock) {
+  IoCtx* ctx = Pool::Acquire();
+  ctx->sock  = sock;
+  return ctx;
+}
+
+void IoCtxPool::Release(IoCtx* ctx) {
+  if (ctx == nullptr) {
+    return;
+  }
+
+  ctx->Recycle();
+  Pool::Release(ctx);
+}
+
+IoCtxPool::Stats IoCtxPool::GetStats() {
+  Pool::Counters counters = Pool::GetCounters();
+
+  Stats stats;
+  stats.acquired = counters.acquired;
+  stats.reused   = counters.reused;
+  stats.created  = counters.created;
+  stats.released = counters.released;
+  stats.slabs    = Pool::GetSource().SlabCount();
+  return stats;
+}
@@ -0,0 +1,343 @@
+#ifdef _WIN32
+
+  #include "IocpPort.h"
+
+  #include "File.h"
+  #include "log.h"
+
+  #include <algorithm>
+  #include <cstring>
+
+IocpPort::~IocpPort() {
+  for (SOCKET sock : spareSockets_) {
+    ::closesocket(sock);
+  }
+  if (completionPort_) {
+    CloseHandle(completionPort_);
+    completionPort_ = NULL;
+  }
+}
+
+bool IocpPort::Init() {
+  completionPort_ = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+  if (completionPort_ == NULL) {
+    LOG_ERROR("CreateIoCompletionPort failed with error: %d", static_cast<int>(GetLastError()));
+    return false;
+  }
+  return true;
+}
+
+bool IocpPort::Listen(SOCKET listenSock) {
+  if (!Associate(listenSock, NULL)) {
+    LOG_ERROR("AssociateWithIOCP failed with error: %d", static_cast<int>(GetLastError()));
+    return false;
+  }
+  return InitializeExtraFunc(listenSock);
+}
+
+bool IocpPort::InitializeExtraFunc(SOCKET listenSock) { // 获取AcceptEx函数指针
+  GUID GuidAcceptEx             = WSAID_ACCEPTEX;
+  GUID GuidGetAcceptExSockAddrs = WSAID_GETACCEPTEXSOCKADDRS;
+  GUID GuidTransmitFile         = WSAID_TRANSMITFILE;
+  DWORD dwBytes                 = 0;
+
+  if (SOCKET_ERROR == WSAIoctl(listenSock,
+                               SIO_GET_EXTENSION_FUNCTION_POINTER,
+                               &GuidAcceptEx,
+                               sizeof(GuidAcceptEx),
+                               &lpfnAcceptEx_,
+                               sizeof(lpfnAcceptEx_),
+                               &dwBytes,
+                               NULL,
+                               NULL)) {
+    LOG_ERROR("failed to get the pointer to AcceptEx, error: %d", WSAGetLastError());
+    return false;
+  }
+
+  // 获取GetAcceptExSockAddrs函数指针，也是同理
+  if (SOCKET_ERROR == WSAIoctl(listenSock,
+                               SIO_GET_EXTENSION_FUNCTION_POINTER,
+                               &GuidGetAcceptExSockAddrs,
+                               sizeof(GuidGetAcceptExSockAddrs),
+                               &lpfnGetAcceptExSockAddrs_,
+                               sizeof(lpfnGetAcceptExSockAddrs_),
+                               &dwBytes,
+                               NULL,
+                               NULL)) {
+    LOG_ERROR("failed to get the pointer to GuidGetAcceptExSockAddrs, error: %d", WSAGetLastError());
+    return false;
+  }
+
+  // 获取TransmitFile函数指针，sendFile使用
+  if (SOCKET_ERROR == WSAIoctl(listenSock,
+                               SIO_GET_EXTENSION_FUNCTION_POINTER,
+                               &GuidTransmitFile,
+                               sizeof(GuidTransmitFile),
+                               &lpfnTransmitFile_,
+                               sizeof(lpfnTransmitFile_),
+                               &dwBytes,
+                               NULL,
+                               NULL)) {
+    LOG_ERROR("failed to get the pointer to TransmitFile, error: %d", WSAGetLastError());
+    return false;
+  }
+
+  return true;
+}
+
+bool IocpPort::Associate(SOCKET sock, ULONG_PTR key) {
+  HANDLE hTemp = ::CreateIoCompletionPort((HANDLE)sock, this->completionPort_, key, 0);
+  if (hTemp == NULL) {
+    return false;
+  }
+  return true;
+}
+
+SOCKET IocpPort::CreateAcceptSocket() {
+  SOCKET sock = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+  if (INVALID_SOCKET == sock) {
+    LOG_ERROR("WSASocket failed with error: %d", static_cast<int>(GetLastError()));
+  }
+  return sock;
+}
+
+void IocpPort::ReserveAcceptSockets(size_t count) {
+  size_t missing;
+  {
+    std::lock_guard<std::mutex> guard(spareMtx_);
+    missing = spareSockets_.size() < count ? count - spareSockets_.size() : 0;
+  }
+
+  // 在锁外创建，不阻塞同时投递Accept的线程
+  std::vector<SOCKET> created;
+  for (size_t i = 0; i < missing; ++i) {
+    SOCKET sock = CreateAcceptSocket();
+    if (sock == INVALID_SOCKET) {
+      break;
+    }
+    created.push_back(sock);
+  }
+
+  std::lock_guard<std::mutex> guard(spareMtx_);
+  spareSockets_.insert(spareSockets_.end(), created.begin(), created.end());
+}
+
+bool IocpPort::PostAccept(SOCKET listenSock, IoCtx* ctx) {
+  // 为以后新连入的客户端先准备好Socket，优先使用预先创建的
+  ctx->sock = INVALID_SOCKET;
+  {
+    std::lock_guard<std::mutex> guard(spareMtx_);
+    if (!spareSockets_.empty()) {
+      ctx->sock = spareSockets_.back();
+      spareSockets_.pop_back();
+    }
+  }
+  if (ctx->sock == INVALID_SOCKET) {
+    ctx->sock = CreateAcceptSocket();
+    if (ctx->sock == INVALID_SOCKET) {
+      return false;
+    }
+  }
+
+  DWORD bytes;
+  OVERLAPPED* pOl = &ctx->overlapped;
+  ctx->op         = OpType::ACCEPT;
+  BOOL ret        = this->lpfnAcceptEx_(listenSock,
+                                 ctx->sock,
+                                 ctx->acceptAddrs,
+                                 0,
+                                 sizeof(sockaddr_in) + 16,
+                                 sizeof(sockaddr_in) + 16,
+                                 &bytes,
+                                 pOl);
+  if (ret == FALSE) {
+    if (WSA_IO_PENDING != WSAGetLastError()) {
+      LOG_ERROR("AcceptEx failed with error: %d", WSAGetLastError());
+      return false;
+    }
+  }
+  return true;
+}
+
+void IocpPort::GetAcceptAddrs(IoCtx* ctx, sockaddr_in* localAddr, sockaddr_in* remoteAddr) {
+  sockaddr_in* LocalAddr  = NULL;
+  sockaddr_in* ClientAddr = NULL;
+  int remoteLen = sizeof(sockaddr_in), localLen = sizeof(sockaddr_in);
+  this->lpfnGetAcceptExSockAddrs_(ctx->acceptAddrs,
+                                  0,
+                                  sizeof(sockaddr_in) + 16,
+                                  sizeof(sockaddr_in) + 16,
+                                  (LPSOCKADDR*)&LocalAddr,
+                                  &localLen,
+                                  (LPSOCKADDR*)&ClientAddr,
+                                  &remoteLen);
+  std::memcpy(localAddr, LocalAddr, sizeof(sockaddr_in));
+  std::memcpy(remoteAddr, ClientAddr, sizeof(sockaddr_in));
+}
+
+bool IocpPort::PostConnect(IoCtx* ctx) {
+  ctx->op = OpType::CONNECT;
+
+  std::call_once(connectExOnce_, [&] {
+    GUID GuidConnectEx = WSAID_CONNECTEX;
+    DWORD dwBytes      = 0;
+    if (SOCKET_ERROR == WSAIoctl(ctx->sock,
+                                 SIO_GET_EXTENSION_FUNCTION_POINTER,
+                                 &GuidConnectEx,
+                                 sizeof(GuidConnectEx),
+                                 &lpfnConnectEx_,
+                                 sizeof(lpfnConnectEx_),
+                                 &dwBytes,
+                                 NULL,
+                                 NULL)) {
+      LOG_ERROR("failed to get the pointer to ConnectEx, error: %d", WSAGetLastError());
+    }
+  });
+  if (lpfnConnectEx_ == nullptr) {
+    return false;
+  }
+
+  // ConnectEx要求套接字已绑定，由系统选择本地地址与端口
+  sockaddr_in localAddr{};
+  localAddr.sin_family      = AF_INET;
+  localAddr.sin_addr.s_addr = INADDR_ANY;
+  if (::bind(ctx->sock, reinterpret_cast<sockaddr*>(&localAddr), sizeof(localAddr)) == SOCKET_ERROR) {
+    LOG_ERROR("bind before ConnectEx failed with error: %d", WSAGetLastError());
+    return false;
+  }
+
+  BOOL ret = this->lpfnConnectEx_(ctx->sock,
+                                  reinterpret_cast<sockaddr*>(&ctx->peerAddr),
+                                  sizeof(ctx->peerAddr),
+                                  NULL,
+                                  0,
+                                  NULL,
+                                  &ctx->overlapped);
+  if (ret == FALSE && WSAGetLastError() != WSA_IO_PENDING) {
+    LOG_ERROR("ConnectEx failed with error: %d", WSAGetLastError());
+    return false;
+  }
+  return true;
+}
+
+bool IocpPort::PostRecv(IoCtx* ctx) {
+  DWORD flags = 0, bytes = 0;
+  OVERLAPPED* pOl = &ctx->overlapped;
+
+  ctx->op        = OpType::RECV;
+  int nbytesRecv =
+      ::WSARecv(ctx->sock, ctx->recvBufs, ctx->recvBufCount, &bytes, &flags, pOl, NULL);
+
+  if ((nbytesRecv == SOCKET_ERROR) && (WSAGetLastError() != WSA_IO_PENDING)) {
+    LOG_ERROR("failed to post recv on socket %" PRIsock, ctx->sock);
+    return false;
+  }
+  return true;
+}
+
+bool IocpPort::PostRecvReady(IoCtx* ctx) {
+  DWORD flags = 0, bytes = 0;
+  WSABUF empty{0, nullptr}; // 长度为0的WSARecv在数据到达时完成，不锁定任何缓冲区
+
+  ctx->op    = OpType::RECV_READY;
+  int result = ::WSARecv(ctx->sock, &empty, 1, &bytes, &flags, &ctx->overlapped, NULL);
+
+  if ((result == SOCKET_ERROR) && (WSAGetLastError() != WSA_IO_PENDING)) {
+    LOG_ERROR("failed to post zero-byte recv on socket %" PRIsock, ctx->sock);
+    return false;
+  }
+  return true;
+}
+
+bool IocpPort::PostSend(IoCtx* ctx) {
+  DWORD bytesSent = 0;
+  DWORD flags     = 0;
+
+  ctx->op    = OpType::SEND;
+  int result = WSASend(ctx->sock,
+                       ctx->sendBufs,
+                       ctx->sendBufCount,
+                       &bytesSent,
+                       flags,
+                       &ctx->overlapped,
+                       nullptr);
+
+  if (result == SOCKET_ERROR && WSAGetLastError() != WSA_IO_PENDING) {
+    return false;
+  }
+  return true;
+}
+
+bool IocpPort::PostSendFile(IoCtx* ctx) {
+  DWORD bytes = static_cast<DWORD>(
+      std::min<std::uint64_t>(ctx->fileRemaining, SENDFILE_CHUNK_SIZE));
+
+  // 文件偏移通过OVERLAPPED传入
+  ctx->op                    = OpType::SEND;
+  ctx->overlapped.Offset     = static_cast<DWORD>(ctx->fileOffset);
+  ctx->overlapped.OffsetHigh = static_cast<DWORD>(ctx->fileOffset >> 32);
+  BOOL ret                   = this->lpfnTransmitFile_(
+      ctx->sock, ctx->sendFile->handle(), bytes, 0, &ctx->overlapped, NULL, 0);
+
+  if (ret == FALSE && WSAGetLastError() != WSA_IO_PENDING) {
+    LOG_ERROR("TransmitFile failed with error: %d", WSAGetLastError());
+    return false;
+  }
+  return true;
+}
+
+void IocpPort::Shutdown(SOCKET sock) {
+  // 挂起的重叠I/O将以ERROR_OPERATION_ABORTED完成
+  ::CancelIoEx(reinterpret_cast<HANDLE>(sock), NULL);
+  ::shutdown(sock, SD_BOTH);
+}
+
+void IocpPort::Close(SOCKET sock) { ::closesocket(sock); }
+
+bool IocpPort::Dequeue(
+    size_t /* worker */, Completion* out, size_t maxCount, size_t& count, int timeoutMs) {
+  OVERLAPPED_ENTRY entries[kMaxDequeueEntries];
+  ULONG removed = 0;
+  count         = 0;
+
+  // 等待完成端口事件，一次取出至多maxCount个
+  BOOL result = GetQueuedCompletionStatusEx(completionPort_,
+                                            entries,
+                                            static_cast<ULONG>(std::min(maxCount, kMaxDequeueEntries)),
+                                            &removed,
+                                            timeoutMs < 0 ? INFINITE : static_cast<DWORD>(timeoutMs),
+                                            FALSE);
+  if (!result) {
+    if (GetLastError() == WAIT_TIMEOUT) {
+      return true;
+    }
+    LOG_ERROR("GetQueuedCompletionStatusEx failed: %d", static_cast<int>(GetLastError()));
+    return false; // 完成端口已关闭
+  }
+
+  for (ULONG i = 0; i < removed; ++i) {
+    Completion& completion = out[count++];
+    completion             = Completion{};
+    OVERLAPPED* overlapped = entries[i].lpOverlapped;
+    if (overlapped == nullptr) {
+      continue; // PostQueuedCompletionStatus投递的唤醒事件
+    }
+
+    completion.ctx              = CONTAINING_RECORD(overlapped, IoCtx, overlapped);
+    completion.completionKey    = entries[i].lpCompletionKey;
+    completion.bytesTransferred = entries[i].dwNumberOfBytesTransferred;
+    // 批量取出的事件不带错误码，失败的I/O由重叠结构中的状态取得
+    if (overlapped->Internal != 0) {
+      DWORD bytes = 0;
+      DWORD flags = 0;
+      if (!WSAGetOverlappedResult(completion.ctx->sock, overlapped, &bytes, FALSE, &flags)) {
+        completion.error = static_cast<DWORD>(WSAGetLastError());
+      }
+    }
+  }
+  return true;
+}
+
+void IocpPort::Wakeup() { ::PostQueuedCompletionStatus(completionPort_, 0, NULL, NULL); }
+
+#endif
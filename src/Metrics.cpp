@@ -0,0 +1,295 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+
+void Histogram::Snapshot::Merge(const Snapshot& other) {
+  for (size_t i = 0; i < kBuckets; ++i) {
+    buckets[i] += other.buckets[i];
+  }
+  count += other.count;
+  sum += other.sum;
+}
+
+std::uint64_t Histogram::Snapshot::Percentile(double q) const {
+  if (count == 0) {
+    return 0;
+  }
+  auto rank = static_cast<std::uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * count));
+  rank      = std::max<std::uint64_t>(rank, 1);
+
+  std::uint64_t seen = 0;
+  for (size_t i = 0; i < kBuckets; ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      return UpperBound(i);
+    }
+  }
+  return UpperBound(kBuckets - 1);
+}
+
+void Histogram::Collect(Snapshot& out) const {
+  for (size_t i = 0; i < kBuckets; ++i) {
+    std::uint64_t n = buckets_[i].load(std::memory_order_relaxed);
+    out.buckets[i] += n;
+    out.count += n;
+  }
+  out.sum += sum_.load(std::memory_order_relaxed);
+}
+
+void LatencyMetrics::Snapshot::Merge(const Snapshot& other) {
+  queueDelay.Merge(other.queueDelay);
+  handler.Merge(other.handler);
+  response.Merge(other.response);
+}
+
+void LatencyMetrics::Collect(Snapshot& out) const {
+  queueDelay.Collect(out.queueDelay);
+  handler.Collect(out.handler);
+  response.Collect(out.response);
+}
+
+void WorkerMetrics::RecordError(DWORD code) {
+  bumpCounter(errors);
+  for (ErrorSlot& slot : errorCodes) {
+    DWORD current = slot.code.load(std::memory_order_relaxed);
+    if (current == 0) {
+      // 占用空位，先写入错误码再计数，读取方看到计数时一定能看到对应的错误码
+      slot.code.store(code, std::memory_order_release);
+      current = code;
+    }
+    if (current == code) {
+      bumpCounter(slot.count);
+      return;
+    }
+  }
+}
+
+void MetricsSnapshot::Collect(const WorkerMetrics& metrics) {
+  Worker worker;
+  worker.batches     = metrics.batches.load(std::memory_order_relaxed);
+  worker.accepts     = metrics.accepts.load(std::memory_order_relaxed);
+  worker.connects    = metrics.connects.load(std::memory_order_relaxed);
+  worker.recvs       = metrics.recvs.load(std::memory_order_relaxed);
+  worker.recvReadies = metrics.recvReadies.load(std::memory_order_relaxed);
+  worker.sends       = metrics.sends.load(std::memory_order_relaxed);
+  worker.bytesIn     = metrics.bytesIn.load(std::memory_order_relaxed);
+  worker.bytesOut    = metrics.bytesOut.load(std::memory_order_relaxed);
+  worker.eofs        = metrics.eofs.load(std::memory_order_relaxed);
+  worker.errors      = metrics.errors.load(std::memory_order_relaxed);
+  metrics.latency.Collect(worker.latency);
+  latency.Merge(worker.latency);
+  workers.push_back(worker);
+
+  metrics.batchSize.Collect(batchSize);
+  metrics.sendQueueBytes.Collect(sendQueueBytes);
+
+  for (const WorkerMetrics::ErrorSlot& slot : metrics.errorCodes) {
+    DWORD code = slot.code.load(std::memory_order_acquire);
+    if (code == 0) {
+      break; // 空位之后不会再有已占用的槽
+    }
+    std::uint64_t count = slot.count.load(std::memory_order_relaxed);
+    auto byCode         = [](const std::pair<DWORD, std::uint64_t>& entry, DWORD value) {
+      return entry.first < value;
+    };
+    auto it = std::lower_bound(errors.begin(), errors.end(), code, byCode);
+    if (it != errors.end() && it->first == code) {
+      it->second += count;
+    } else {
+      errors.insert(it, {code, count});
+    }
+  }
+}
+
+MetricsSnapshot::Worker MetricsSnapshot::Total() const {
+  Worker total;
+  for (const Worker& worker : workers) {
+    total.batches += worker.batches;
+    total.accepts += worker.accepts;
+    total.connects += worker.connects;
+    total.recvs += worker.recvs;
+    total.recvReadies += worker.recvReadies;
+    total.sends += worker.sends;
+    total.bytesIn += worker.bytesIn;
+    total.bytesOut += worker.bytesOut;
+    total.eofs += worker.eofs;
+    total.errors += worker.errors;
+    total.latency.Merge(worker.latency);
+  }
+  return total;
+}
+
+namespace {
+
+void appendf(std::string& out, const char* fmt, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+void appendf(std::string& out, const char* fmt, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, fmt);
+  int n = std::vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  if (n > 0) {
+    out.append(line, std::min(static_cast<size_t>(n), sizeof(line) - 1));
+  }
+}
+
+void appendHeader(std::string& out, const char* name, const char* type, const char* help) {
+  appendf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void appendHistogram(std::string& out, const char* name, const char* help, const Histogram::Snapshot& h) {
+  appendHeader(out, name, "histogram", help);
+
+  // 只输出到最后一个非空桶为止，其后的桶与+Inf相同
+  size_t last = 0;
+  for (size_t i = 0; i < Histogram::kBuckets; ++i) {
+    if (h.buckets[i] != 0) {
+      last = i;
+    }
+  }
+  std::uint64_t cumulative = 0;
+  for (size_t i = 0; i <= last && i < Histogram::kBuckets - 1; ++i) {
+    cumulative += h.buckets[i];
+    appendf(out,
+            "%s_bucket{le=\"%" PRIu64 "\"} %" PRIu64 "\n",
+            name,
+            Histogram::UpperBound(i),
+            cumulative);
+  }
+  appendf(out, "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", name, h.count);
+  appendf(out, "%s_sum %" PRIu64 "\n", name, h.sum);
+  appendf(out, "%s_count %" PRIu64 "\n", name, h.count);
+}
+
+} // namespace
+
+std::string MetricsSnapshot::ToPrometheus() const {
+  std::string out;
+  out.reserve(4096);
+
+  appendHeader(out, "iocp_completions_total", "counter", "I/O completions handled, by worker and operation.");
+  static const struct {
+    const char* op;
+    std::uint64_t Worker::*field;
+  } kOps[] = {
+      {"accept", &Worker::accepts},
+      {"connect", &Worker::connects},
+      {"recv", &Worker::recvs},
+      {"recv_ready", &Worker::recvReadies},
+      {"send", &Worker::sends},
+      {"eof", &Worker::eofs},
+      {"error", &Worker::errors},
+  };
+  for (size_t i = 0; i < workers.size(); ++i) {
+    for (const auto& op : kOps) {
+      appendf(out,
+              "iocp_completions_total{worker=\"%zu\",op=\"%s\"} %" PRIu64 "\n",
+              i,
+              op.op,
+              workers[i].*op.field);
+    }
+  }
+
+  appendHeader(out, "iocp_batches_total", "counter", "Non-empty completion batches dequeued, by worker.");
+  for (size_t i = 0; i < workers.size(); ++i) {
+    appendf(out, "iocp_batches_total{worker=\"%zu\"} %" PRIu64 "\n", i, workers[i].batches);
+  }
+
+  appendHeader(out, "iocp_received_bytes_total", "counter", "Bytes received, by worker.");
+  for (size_t i = 0; i < workers.size(); ++i) {
+    appendf(out, "iocp_received_bytes_total{worker=\"%zu\"} %" PRIu64 "\n", i, workers[i].bytesIn);
+  }
+
+  appendHeader(out, "iocp_sent_bytes_total", "counter", "Bytes sent, by worker.");
+  for (size_t i = 0; i < workers.size(); ++i) {
+    appendf(out, "iocp_sent_bytes_total{worker=\"%zu\"} %" PRIu64 "\n", i, workers[i].bytesOut);
+  }
+
+  appendHeader(out, "iocp_completion_errors_total", "counter", "Failed I/O completions, by error code.");
+  for (const auto& error : errors) {
+    appendf(out,
+            "iocp_completion_errors_total{code=\"%" PRIu64 "\"} %" PRIu64 "\n",
+            static_cast<std::uint64_t>(error.first),
+            error.second);
+  }
+
+  appendHistogram(out, "iocp_batch_size", "Completions per dequeued batch.", batchSize);
+  appendHistogram(out,
+                  "iocp_send_queue_bytes",
+                  "Bytes still queued on a session after one of its sends completes.",
+                  sendQueueBytes);
+  appendHistogram(out,
+                  "iocp_queue_delay_nanoseconds",
+                  "Time a dequeued receive completion waited before its handler ran.",
+                  latency.queueDelay);
+  appendHistogram(out,
+                  "iocp_handler_nanoseconds",
+                  "Time spent in message or frame callbacks per receive completion.",
+                  latency.handler);
+  appendHistogram(out,
+                  "iocp_response_nanoseconds",
+                  "Time from posting a send batch until all of it completed.",
+                  latency.response);
+
+  appendHeader(out, "iocp_sessions", "gauge", "Open sessions.");
+  appendf(out, "iocp_sessions %zu\n", sessions);
+
+  appendHeader(out, "iocp_pending_send_bytes", "gauge", "Bytes queued for sending across all sessions.");
+  appendf(out, "iocp_pending_send_bytes %zu\n", pendingSendBytes);
+
+  appendHeader(out, "iocp_accept_depth", "gauge", "Accepts currently posted.");
+  appendf(out, "iocp_accept_depth %zu\n", accept.depth);
+
+  appendHeader(out, "iocp_accept_target", "gauge", "Target number of posted accepts.");
+  appendf(out, "iocp_accept_target %zu\n", accept.target);
+
+  appendHeader(out, "iocp_accept_rate", "gauge", "Connections accepted per second over the last tuning period.");
+  appendf(out, "iocp_accept_rate %" PRIu64 "\n", accept.rate);
+
+  appendHeader(out, "iocp_accepted_total", "counter", "Connections accepted.");
+  appendf(out, "iocp_accepted_total %" PRIu64 "\n", accept.accepted);
+
+  appendHeader(out, "iocp_accept_failures_total", "counter", "Accepts that failed or could not be posted.");
+  appendf(out, "iocp_accept_failures_total %" PRIu64 "\n", accept.failed);
+
+  appendHeader(out, "iocp_accept_depth_changes_total", "counter", "Adjustments of the accept target.");
+  appendf(out, "iocp_accept_depth_changes_total{direction=\"grow\"} %" PRIu64 "\n", accept.grows);
+  appendf(out, "iocp_accept_depth_changes_total{direction=\"shrink\"} %" PRIu64 "\n", accept.shrinks);
+
+  if (!compute.threads.empty()) {
+    appendHeader(out, "iocp_compute_queued_tasks", "gauge", "Compute tasks submitted but not yet run.");
+    appendf(out, "iocp_compute_queued_tasks %zu\n", compute.queuedTasks);
+
+    appendHeader(out,
+                 "iocp_compute_queue_depth",
+                 "gauge",
+                 "Sessions with pending tasks queued on each compute thread.");
+    for (size_t i = 0; i < compute.threads.size(); ++i) {
+      appendf(out, "iocp_compute_queue_depth{thread=\"%zu\"} %zu\n", i, compute.threads[i].depth);
+    }
+
+    appendHeader(out, "iocp_compute_tasks_total", "counter", "Compute tasks run, by compute thread.");
+    for (size_t i = 0; i < compute.threads.size(); ++i) {
+      appendf(out, "iocp_compute_tasks_total{thread=\"%zu\"} %" PRIu64 "\n", i, compute.threads[i].tasks);
+    }
+
+    appendHeader(out,
+                 "iocp_compute_steals_total",
+                 "counter",
+                 "Sessions taken from another compute thread's queue, by stealing thread.");
+    for (size_t i = 0; i < compute.threads.size(); ++i) {
+      appendf(out, "iocp_compute_steals_total{thread=\"%zu\"} %" PRIu64 "\n", i, compute.threads[i].steals);
+    }
+  }
+
+  return out;
+}
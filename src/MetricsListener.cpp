@@ -0,0 +1,167 @@
+#include "MetricsListener.h"
+
+#include "log.h"
+
+#ifndef _WIN32
+  #include <poll.h>
+#endif
+
+namespace {
+
+// 等待新连接的最长时间，也是Stop的最大延迟
+constexpr int kPollIntervalMs = 200;
+
+// 读取请求的超时，防止不完整的请求占住服务线程
+constexpr int kRecvTimeoutMs = 1000;
+
+// 请求头的上限，只需要请求行
+constexpr size_t kMaxRequestSize = 4096;
+
+#ifdef _WIN32
+int pollSocket(SOCKET sock, int timeoutMs) {
+  WSAPOLLFD pfd{};
+  pfd.fd     = sock;
+  pfd.events = POLLRDNORM;
+  return WSAPoll(&pfd, 1, timeoutMs);
+}
+constexpr int kSendFlags = 0;
+#else
+int pollSocket(SOCKET sock, int timeoutMs) {
+  pollfd pfd{};
+  pfd.fd     = sock;
+  pfd.events = POLLIN;
+  return ::poll(&pfd, 1, timeoutMs);
+}
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#endif
+
+bool sendAll(SOCKET sock, const char* data, size_t len) {
+  while (len > 0) {
+    int n = ::send(sock, data, static_cast<int>(len), kSendFlags);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+} // namespace
+
+MetricsListener::MetricsListener(std::string address, unsigned short port, Render render)
+    : address_(std::move(address))
+    , port_(port)
+    , render_(std::move(render)) {}
+
+MetricsListener::~MetricsListener() { Stop(); }
+
+bool MetricsListener::Start() {
+#ifdef _WIN32
+  SOCKET sock = ::socket(AF_INET, SOCK_STREAM, 0);
+#else
+  SOCKET sock = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#endif
+  if (sock == INVALID_SOCKET) {
+    LOG_ERROR("metrics listener: socket failed with error: %d", WSAGetLastError());
+    return false;
+  }
+
+  BOOL reuseAddr = TRUE;
+  ::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char*>(&reuseAddr), sizeof(reuseAddr));
+
+  sockaddr_in addr{};
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = inet_addr(address_.c_str());
+  addr.sin_port        = htons(port_);
+  if (::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR ||
+      ::listen(sock, 16) == SOCKET_ERROR) {
+    LOG_ERROR("metrics listener: bind/listen on %s:%u failed with error: %d",
+              address_.c_str(),
+              static_cast<unsigned>(port_),
+              WSAGetLastError());
+    closesocket(sock);
+    return false;
+  }
+
+  listenSocket_ = sock;
+  running_.store(true, std::memory_order_release);
+  thread_ = std::thread(&MetricsListener::ThreadProc, this);
+  LOG_INFO("metrics listener started on %s:%u", address_.c_str(), static_cast<unsigned>(port_));
+  return true;
+}
+
+void MetricsListener::Stop() {
+  running_.store(false, std::memory_order_release);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  if (listenSocket_ != INVALID_SOCKET) {
+    closesocket(listenSocket_);
+    listenSocket_ = INVALID_SOCKET;
+  }
+}
+
+void MetricsListener::ThreadProc() {
+  while (running_.load(std::memory_order_acquire)) {
+    if (pollSocket(listenSocket_, kPollIntervalMs) <= 0) {
+      continue;
+    }
+    SOCKET client = ::accept(listenSocket_, nullptr, nullptr);
+    if (client == INVALID_SOCKET) {
+      continue;
+    }
+    Serve(client);
+    closesocket(client);
+  }
+}
+
+void MetricsListener::Serve(SOCKET client) {
+#ifdef _WIN32
+  DWORD timeout = kRecvTimeoutMs;
+#else
+  timeval timeout{kRecvTimeoutMs / 1000, (kRecvTimeoutMs % 1000) * 1000};
+#endif
+  ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<char*>(&timeout), sizeof(timeout));
+
+  // 读到请求头结束为止，只解析请求行
+  std::string request;
+  char buf[1024];
+  while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequestSize) {
+    int n = ::recv(client, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      return;
+    }
+    request.append(buf, static_cast<size_t>(n));
+  }
+
+  bool head  = request.compare(0, 5, "HEAD ") == 0;
+  bool get   = request.compare(0, 4, "GET ") == 0;
+  size_t pos = head ? 5 : 4;
+  char next  = request.size() > pos + 8 ? request[pos + 8] : ' '; // 路径之后的字符
+  bool found = (get || head) && request.compare(pos, 8, "/metrics") == 0 && (next == ' ' || next == '?');
+
+  std::string body;
+  const char* status;
+  const char* contentType;
+  if (found) {
+    body        = render_();
+    status      = "200 OK";
+    contentType = "text/plain; version=0.0.4; charset=utf-8";
+  } else {
+    body        = "not found\n";
+    status      = "404 Not Found";
+    contentType = "text/plain; charset=utf-8";
+  }
+
+  std::string response = "HTTP/1.1 ";
+  response += status;
+  response += "\r\nContent-Type: ";
+  response += contentType;
+  response += "\r\nContent-Length: " + std::to_string(body.size());
+  response += "\r\nConnection: close\r\n\r\n";
+  if (!head) {
+    response += body;
+  }
+  sendAll(client, response.data(), response.size());
+}
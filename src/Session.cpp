@@ -1,60 +1,412 @@
 #include "Session.h"
 
-Session::Session(SOCKET sock, sockaddr_in* localAddr, sockaddr_in* remoteAddr)
-    : sockCtx_(std::make_unique<SockCtx>(sock)) {
+#include "CompletionPort.h"
+#include "ComputePool.h"
+#include "WorkerThread.h"
+#include "log.h"
+
+#include <utility>
+
+std::atomic<size_t> Session::globalPendingBytes_{0};
+std::atomic<size_t> Session::globalSendLimit_{0};
+
+namespace {
+
+// from到to经过的纳秒数，时钟回退或未设置时为0
+std::uint64_t elapsedNs(Timestamp from, Timestamp to) {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+  return ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+}
+
+} // namespace
+
+Session::Session(std::shared_ptr<CompletionPort> port,
+                 SOCKET sock,
+                 sockaddr_in* localAddr,
+                 sockaddr_in* remoteAddr)
+    : port_(std::move(port))
+    , sockCtx_(std::make_unique<SockCtx>(sock)) {
   localAddr_ = std::string(::inet_ntoa(localAddr->sin_addr)) + ':' +
                std::to_string(::ntohs(localAddr->sin_port));
   remoteAddr_ = std::string(::inet_ntoa(remoteAddr->sin_addr)) + ':' +
                 std::to_string(::ntohs(remoteAddr->sin_port));
 }
 
-void Session::send(const void* data, size_t len) {
-  if (data == nullptr || len == 0)
-    return;
+Session::~Session() {
+  // 未发出的数据不再计入进程内的总量
+  globalPendingBytes_.fetch_sub(pendingBytes_.load(std::memory_order_relaxed),
+                                std::memory_order_relaxed);
+  port_->Close(sockCtx_->getSocket());
+}
+
+bool Session::send(const void* data, size_t len) {
+  if (data == nullptr || len == 0 || isClosed())
+    return false;
+
+  return send(Payload(std::vector<char>(reinterpret_cast<const char*>(data),
+                                        reinterpret_cast<const char*>(data) + len)));
+}
+
+bool Session::send(std::vector<char>&& data) { return send(Payload(std::move(data))); }
+
+bool Session::send(std::string&& data) { return send(Payload(std::move(data))); }
+
+bool Session::send(Payload payload) {
+  if (payload.empty() || isClosed())
+    return false;
+
+  return enqueue(&payload, 1);
+}
+
+bool Session::sendFrame(Payload body) {
+  if (codec_ == nullptr || isClosed())
+    return false;
+
+  char header[Codec::kMaxHeaderSize];
+  size_t headerLen = codec_->encodeHeader(body.size(), header);
+  if (headerLen == Codec::npos) {
+    LOG_WARN("socket %" PRIsock "上的帧长度%zu不符合编解码器的要求，丢弃",
+             sockCtx_->getSocket(),
+             body.size());
+    return false;
+  }
+
+  // 帧头很短，拷贝；分隔符由编解码器持有，与其共享所有者，不拷贝
+  Payload parts[3];
+  size_t count = 0;
+  if (headerLen != 0)
+    parts[count++] = Payload(std::string(header, headerLen));
+  if (!body.empty())
+    parts[count++] = std::move(body);
+  const std::string& trailer = codec_->trailer();
+  if (!trailer.empty())
+    parts[count++] = Payload(codec_, trailer.data(), trailer.size());
+  if (count == 0)
+    return false;
+
+  return enqueue(parts, count);
+}
+
+bool Session::enqueue(Payload* parts, size_t count, std::uint64_t* queuedEnd) {
+  // 只有内存数据计入待发送字节数，文件段由内核从文件读取，不占用内存
+  size_t len   = 0;
+  size_t total = 0;
+  for (size_t i = 0; i < count; ++i) {
+    total += parts[i].size();
+    if (parts[i].file() == nullptr)
+      len += parts[i].size();
+  }
 
-  std::vector<char> buffer(reinterpret_cast<const char*>(data),
-                           reinterpret_cast<const char*>(data) + len);
+  size_t limit = globalSendLimit_.load(std::memory_order_relaxed);
+  if (globalPendingBytes_.fetch_add(len, std::memory_order_relaxed) + len > limit && limit != 0) {
+    globalPendingBytes_.fetch_sub(len, std::memory_order_relaxed);
+    LOG_WARN("待发送数据已达进程上限%zu字节，丢弃socket %" PRIsock "上的%zu字节",
+             limit,
+             sockCtx_->getSocket(),
+             len);
+    return false;
+  }
 
+  size_t pending   = 0;
+  bool crossedHigh = false;
   {
     std::lock_guard<std::mutex> lock(sendMtx_);
-    sendQueue_.emplace_back(std::move(buffer));
+    for (size_t i = 0; i < count; ++i) {
+      if (!parts[i].empty())
+        sendQueue_.emplace_back(std::move(parts[i]));
+    }
+    pending = pendingBytes_.load(std::memory_order_relaxed) + len;
+    pendingBytes_.store(pending, std::memory_order_relaxed);
+    queuedBytes_ += total;
+    if (queuedEnd != nullptr)
+      *queuedEnd = queuedBytes_;
+    if (highWatermark_ != 0 && !aboveHighWatermark_ && pending >= highWatermark_) {
+      aboveHighWatermark_ = true;
+      crossedHigh         = true;
+    }
+  }
+
+  if (crossedHigh && onHighWatermark_) {
+    onHighWatermark_(shared_from_this(), pending);
+  }
+
+  // 分片模式下只在所属线程上投递发送；已在发送中时由发送完成接续，不必转交
+  if (loop_ != nullptr && !loop_->IsInLoopThread()) {
+    if (!isSending_.load(std::memory_order_acquire)) {
+      loop_->RunInLoop([self = shared_from_this()] { self->trySendNext(); });
+    }
+    return true;
   }
 
   trySendNext();
+  return true;
+}
+
+bool Session::sendFile(const std::string& path, std::uint64_t offset, std::uint64_t length) {
+  if (isClosed())
+    return false;
+
+  std::shared_ptr<File> file = File::open(path);
+  return file != nullptr && sendFile(std::move(file), offset, length);
+}
+
+bool Session::sendFile(std::shared_ptr<const File> file, std::uint64_t offset, std::uint64_t length) {
+  if (file == nullptr || isClosed())
+    return false;
+
+  // 超出文件末尾的范围会以0字节完成，被当作对端断开，必须在这里拒绝
+  std::uint64_t size = file->size();
+  if (offset >= size)
+    return false;
+  if (length == 0)
+    length = size - offset;
+  if (length > size - offset || static_cast<size_t>(length) != length)
+    return false;
+
+  return send(Payload::fromFile(std::move(file), offset, static_cast<size_t>(length)));
+}
+
+TimerPtr Session::runAfter(std::chrono::milliseconds delay,
+                           std::function<void(shared_session_ptr)> fn) {
+  if (!timers_ || isClosed())
+    return nullptr;
+
+  std::weak_ptr<Session> weak = shared_from_this();
+  TimerPtr timer              = TimerWheel::Create([weak, fn = std::move(fn)] {
+    if (auto session = weak.lock(); session && !session->isClosed()) {
+      fn(session);
+    }
+  });
+  timers_->Arm(timer, delay);
+  return timer;
+}
+
+void Session::cancelTimer(const TimerPtr& timer) {
+  if (timers_ && timer)
+    timers_->Cancel(timer);
+}
+
+bool Session::post(ComputeTask fn) {
+  return compute_ != nullptr && compute_->Submit(shared_from_this(), std::move(fn));
 }
 
-void Session::handleRecv(const void* data, size_t len) {
-  if (data == nullptr || len == 0)
+void Session::shutdown() {
+  // 暂停中的接收IoCtx持有本session的引用，放在最后释放
+  std::shared_ptr<Session> pausedOwner;
+
+  bool expected = false;
+  if (closed_.compare_exchange_strong(expected, true)) {
+    if (deadlineTimer_) {
+      timers_->Cancel(deadlineTimer_);
+    }
+    IoCtx* paused = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(sendMtx_);
+      std::swap(paused, pausedRecv_);
+    }
+    if (paused != nullptr) {
+      pausedOwner = std::move(paused->session);
+      sockCtx_->removeIoCtx(paused);
+    }
+    port_->Shutdown(sockCtx_->getSocket());
+
+    if (coroutine_) {
+      // 协程结束时可能释放最后一个引用，先持有自身
+      auto self = shared_from_this();
+      std::lock_guard<std::recursive_mutex> lock(coMtx_);
+      wakeReader();
+      wakeWriter();
+    }
+  }
+}
+
+size_t Session::releasePendingLocked(size_t len) {
+  globalPendingBytes_.fetch_sub(len, std::memory_order_relaxed);
+  size_t pending = pendingBytes_.load(std::memory_order_relaxed) - len;
+  pendingBytes_.store(pending, std::memory_order_relaxed);
+  return pending;
+}
+
+IoCtx* Session::handleSendProgress(size_t len, bool fromFile) {
+  IoCtx* resume = nullptr;
+  bool drained  = false;
+  {
+    std::lock_guard<std::mutex> lock(sendMtx_);
+    size_t pending = releasePendingLocked(fromFile ? 0 : len);
+    sentBytes_ += len;
+    if (aboveHighWatermark_ && pending <= lowWatermark_) {
+      aboveHighWatermark_ = false;
+      drained             = true;
+      std::swap(resume, pausedRecv_);
+    }
+  }
+
+  if (drained && onWriteDrained_) {
+    onWriteDrained_(shared_from_this());
+  }
+
+  if (coroutine_) {
+    std::lock_guard<std::recursive_mutex> lock(coMtx_);
+    wakeWriter();
+  }
+  return resume;
+}
+
+bool Session::pauseRecvIfHighWatermark(IoCtx* ctx) {
+  std::lock_guard<std::mutex> lock(sendMtx_);
+  if (!aboveHighWatermark_ || isClosed()) {
+    return false;
+  }
+  pausedRecv_ = ctx;
+  return true;
+}
+
+void Session::prepareRecv(IoCtx* ctx) {
+  ctx->recvBufCount =
+      static_cast<ULONG>(inputBuf_.prepareWrite(WSABUF_SIZE, ctx->recvBufs, MAX_RECV_BUFS));
+}
+
+void Session::handleRecv(size_t len, Timestamp receiveTime) {
+  if (len == 0)
     return;
 
-  inputBuf_.write(data, len);
-  if (onMessage_) {
-    onMessage_(shared_from_this(), &inputBuf_);
+  inputBuf_.commitWrite(len);
+  lastRecvMs_.store(TimerWheel::NowMs(), std::memory_order_relaxed);
+
+  Timestamp start;
+  if (latency_)
+    start = std::chrono::steady_clock::now();
+
+  if (coroutine_) {
+    std::lock_guard<std::recursive_mutex> lock(coMtx_);
+    coInput_.append(std::move(inputBuf_));
+    wakeReader();
+  } else if (codec_) {
+    handleFrames();
+  } else if (onMessage_) {
+    onMessage_(shared_from_this(), &inputBuf_, receiveTime);
+  }
+
+  if (latency_) {
+    std::uint64_t queueDelay = elapsedNs(receiveTime, start);
+    std::uint64_t handler    = elapsedNs(start, std::chrono::steady_clock::now());
+    latency_->queueDelay.Record(queueDelay);
+    latency_->handler.Record(handler);
+    if (WorkerMetrics* metrics = WorkerThread::CurrentMetrics()) {
+      metrics->latency.queueDelay.Record(queueDelay);
+      metrics->latency.handler.Record(handler);
+    }
   }
 }
 
-void Session::handleConnected() {
-  if (onConnected_) {
-    onConnected_(shared_from_this());
+void Session::handleFrames() {
+  auto self = shared_from_this();
+  Codec::Frame frame;
+  while (!isClosed()) {
+    Codec::Status status = codec_->decode(inputBuf_, codecScanned_, frame);
+    if (status == Codec::Status::Incomplete)
+      return;
+
+    if (status == Codec::Status::Invalid) {
+      LOG_WARN("socket %" PRIsock "上的帧超过上限%zu字节或格式错误，关闭连接",
+               sockCtx_->getSocket(),
+               codec_->maxFrameSize());
+      shutdown();
+      return;
+    }
+
+    // 只在这一帧跨越块边界时合并它本身，回调返回后再丢弃
+    const char* data = inputBuf_.peek(frame.consume);
+    if (onFrame_) {
+      onFrame_(self, std::string_view(data + frame.offset, frame.length));
+    }
+    inputBuf_.retrieve(frame.consume);
+    codecScanned_ = 0;
   }
 }
 
-void Session::handleSendUncompleted(IoCtx* ctx, size_t writtenBytes) {
-  assert(writtenBytes < ctx->buffer.size());
-  std::vector<char> remained(ctx->buffer.begin() + writtenBytes, ctx->buffer.end());
+void Session::startCoroutine(const onSessionCallback& handler) {
+  coroutine_ = true;
+  std::lock_guard<std::recursive_mutex> lock(coMtx_);
+  handler(shared_from_this());
+}
+
+bool Session::readReady(size_t need) {
+  if (readConsume_ != 0) {
+    coInput_.retrieve(readConsume_);
+    readConsume_ = 0;
+  }
+  return coInput_.readableBytes() >= need || isClosed();
+}
 
-  // can't set the isSending flag to false, we need ensure the sequence of the content
-  // isSending_.store(false, std::memory_order_release);
+void Session::suspendRead(size_t need, Waiter waiter) {
+  readNeed_ = need;
+  reader_   = waiter;
+}
 
-  {
-    std::lock_guard<std::mutex> guard(sendMtx_);
-    sendQueue_.emplace_front(std::move(remained));
+bool Session::queueWrite(Payload payload, std::uint64_t& target) {
+  if (payload.empty() || isClosed())
+    return false;
+
+  return enqueue(&payload, 1, &target);
+}
+
+bool Session::writeDone(std::uint64_t target) {
+  std::lock_guard<std::mutex> lock(sendMtx_);
+  return sentBytes_ >= target;
+}
+
+void Session::suspendWrite(std::uint64_t target, Waiter waiter) {
+  writeTarget_ = target;
+  writer_      = waiter;
+}
+
+void Session::wakeReader() {
+  if (reader_.frame == nullptr || (coInput_.readableBytes() < readNeed_ && !isClosed()))
+    return;
+
+  Waiter waiter = std::exchange(reader_, Waiter{});
+  waiter.resume(waiter.frame);
+}
+
+void Session::wakeWriter() {
+  if (writer_.frame == nullptr || (!writeDone(writeTarget_) && !isClosed()))
+    return;
+
+  Waiter waiter = std::exchange(writer_, Waiter{});
+  waiter.resume(waiter.frame);
+}
+
+LatencyMetrics::Snapshot Session::getLatency() const {
+  LatencyMetrics::Snapshot snapshot;
+  if (latency_)
+    latency_->Collect(snapshot);
+  return snapshot;
+}
+
+void Session::handleConnected() {
+  if (onConnected_) {
+    onConnected_(shared_from_this());
   }
+}
 
-  doSendNext(ctx);
+void Session::handleSendUncompleted(IoCtx* ctx) {
+  // 剩余数据仍在ctx中，直接再次投递；isSending_保持为true，保证内容的先后顺序
+  lastSendMs_.store(TimerWheel::NowMs(), std::memory_order_relaxed);
+  postSend(ctx);
 }
 
-void Session::handleSendCompleted(IoCtx* ctx) {
+void Session::handleSendCompleted(IoCtx* ctx, Timestamp completedAt) {
+  if (latency_) {
+    std::uint64_t response = elapsedNs(ctx->postedAt, completedAt);
+    latency_->response.Record(response);
+    if (WorkerMetrics* metrics = WorkerThread::CurrentMetrics()) {
+      metrics->latency.response.Record(response);
+    }
+  }
+
+  // 这一批数据已全部交给内核，先释放引用，ctx随后可能被下一批发送复用
+  ctx->ReleasePayloads();
   isSending_.store(false, std::memory_order_release);
 
   // sockCtx_->removeIoCtx(ctx);
@@ -67,43 +419,73 @@ void Session::handleSendCompleted(IoCtx* ctx) {
 }
 
 void Session::doSendNext(IoCtx* ioCtx) {
-  std::vector<char> buffer;
+  IoCtx* ctx = ioCtx;
   {
     std::lock_guard<std::mutex> guard(sendMtx_);
     if (sendQueue_.empty()) {
+      // 在锁内清除发送标志，保证与send()中的入队不会错过彼此
+      isSending_.store(false, std::memory_order_release);
+      if (ioCtx != nullptr) {
+        sockCtx_->removeIoCtx(ioCtx);
+      }
       return;
     }
 
-    buffer = std::move(sendQueue_.front());
-    sendQueue_.pop_front();
-  }
+    if (ctx == nullptr) {
+      ctx = sockCtx_->newIoCtx();
+    }
 
-  IoCtx* ctx{};
-  if (ioCtx == nullptr) {
-    ctx = sockCtx_->newIoCtx();
+    // 一次取出至多MAX_SEND_BUFS个数据块，合并为一次多缓冲区发送；
+    // 文件段单独发送，遇到文件段时先把它之前的内存数据发完
+    while (!sendQueue_.empty() && ctx->sendBufCount < MAX_SEND_BUFS) {
+      if (sendQueue_.front().file() != nullptr) {
+        if (ctx->sendBufCount == 0) {
+          ctx->SetSendFile(std::move(sendQueue_.front()));
+          sendQueue_.pop_front();
+        }
+        break;
+      }
+      ctx->AddSendBuf(std::move(sendQueue_.front()));
+      sendQueue_.pop_front();
+    }
   }
-  ctx->op         = OpType::SEND;
-  ctx->sock       = sockCtx_->getSocket();
-  ctx->buffer     = std::move(buffer);
-  ctx->wsaBuf.buf = ctx->buffer.data();
-  ctx->wsaBuf.len = static_cast<ULONG>(ctx->buffer.size());
 
-  DWORD bytesSent = 0;
-  DWORD flags     = 0;
-  int result = WSASend(ctx->sock, &ctx->wsaBuf, 1, &bytesSent, flags, &ctx->overlapped, nullptr);
+  ctx->sock = sockCtx_->getSocket();
+  if (latency_)
+    ctx->postedAt = std::chrono::steady_clock::now();
+  postSend(ctx);
+}
 
-  if (result == SOCKET_ERROR && WSAGetLastError() != WSA_IO_PENDING) {
+void Session::postSend(IoCtx* ctx) {
+  ctx->session = shared_from_this();
+
+  bool ok = ctx->sendFile != nullptr ? port_->PostSendFile(ctx) : port_->PostSend(ctx);
+  if (!ok) {
+    // 已从发送队列取出的数据不会再发出，从待发送字节数中扣除；队列中剩余的部分在析构时扣除。
+    // 之后的数据无法保持顺序，关闭连接
+    LOG_WARN("投递发送失败，关闭socket %" PRIsock, sockCtx_->getSocket());
+    std::shared_ptr<Session> self = std::move(ctx->session);
+    {
+      std::lock_guard<std::mutex> lock(sendMtx_);
+      releasePendingLocked(ctx->sendFile != nullptr ? 0 : ctx->UnsentBytes());
+    }
     isSending_.store(false, std::memory_order_release);
     sockCtx_->removeIoCtx(ctx);
-    // TODO: handle errors
+    shutdown();
   }
 }
 
 void Session::trySendNext(IoCtx* ioCtx) {
   bool expected = false;
   if (!isSending_.compare_exchange_strong(expected, true)) {
+    // 其他线程正在发送，上一次发送用过的IoCtx归还对象池
+    if (ioCtx != nullptr) {
+      sockCtx_->removeIoCtx(ioCtx);
+    }
     return;
   }
 
+  // 写超时从这一批发送开始计算
+  lastSendMs_.store(TimerWheel::NowMs(), std::memory_order_relaxed);
   doSendNext(ioCtx);
 }
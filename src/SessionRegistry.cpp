@@ -0,0 +1,88 @@
+#include "SessionRegistry.h"
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+SessionRegistry::SessionRegistry(size_t shards) {
+  if (shards == 0) {
+    shards = std::max<size_t>(std::thread::hardware_concurrency(), 1) * 4;
+  }
+
+  shardBits_ = 0;
+  while ((size_t(1) << shardBits_) < shards) {
+    ++shardBits_;
+  }
+  shardMask_ = (SessionId(1) << shardBits_) - 1;
+
+  for (size_t i = 0; i < (size_t(1) << shardBits_); ++i) {
+    shards_.push_back(std::make_unique<Shard>());
+  }
+}
+
+SessionId SessionRegistry::Add(std::shared_ptr<Session> session) {
+  size_t index = nextShard_.fetch_add(1, std::memory_order_relaxed) & shardMask_;
+  Shard& shard = *shards_[index];
+
+  std::unique_lock<std::shared_mutex> lock(shard.mtx);
+  SessionId id = (++shard.nextSeq << shardBits_) | index;
+  session->id_ = id;
+  shard.sessions.emplace(id, std::move(session));
+  return id;
+}
+
+std::shared_ptr<Session> SessionRegistry::Find(SessionId id) const {
+  Shard& shard = ShardOf(id);
+  std::shared_lock<std::shared_mutex> lock(shard.mtx);
+  auto it = shard.sessions.find(id);
+  return it != shard.sessions.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<Session> SessionRegistry::Remove(SessionId id) {
+  Shard& shard = ShardOf(id);
+  std::unique_lock<std::shared_mutex> lock(shard.mtx);
+  auto it = shard.sessions.find(id);
+  if (it == shard.sessions.end()) {
+    return nullptr;
+  }
+  std::shared_ptr<Session> session = std::move(it->second);
+  shard.sessions.erase(it);
+  return session;
+}
+
+void SessionRegistry::Shard::CopyTo(std::vector<std::shared_ptr<Session>>& out) const {
+  std::shared_lock<std::shared_mutex> lock(mtx);
+  out.reserve(out.size() + sessions.size());
+  for (const auto& entry : sessions) {
+    out.push_back(entry.second);
+  }
+}
+
+std::vector<std::shared_ptr<Session>> SessionRegistry::Snapshot() const {
+  std::vector<std::shared_ptr<Session>> out;
+  for (const auto& shard : shards_) {
+    shard->CopyTo(out);
+  }
+  return out;
+}
+
+size_t SessionRegistry::Size() const {
+  size_t total = 0;
+  for (const auto& shard : shards_) {
+    std::shared_lock<std::shared_mutex> lock(shard->mtx);
+    total += shard->sessions.size();
+  }
+  return total;
+}
+
+std::vector<std::shared_ptr<Session>> SessionRegistry::Clear() {
+  std::vector<std::shared_ptr<Session>> out;
+  for (const auto& shard : shards_) {
+    std::unique_lock<std::shared_mutex> lock(shard->mtx);
+    for (auto& entry : shard->sessions) {
+      out.push_back(std::move(entry.second));
+    }
+    shard->sessions.clear();
+  }
+  return out;
+}
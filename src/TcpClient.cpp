@@ -0,0 +1,194 @@
+#include "TcpClient.h"
+
+#include "IOCPServer.h"
+#include "Session.h"
+
+#include <algorithm>
+
+namespace {
+
+void shutdownAll(std::vector<shared_session_ptr>& sessions) {
+  for (auto& session : sessions) {
+    session->shutdown();
+  }
+}
+
+} // namespace
+
+TcpClient::TcpClient(IOCPServer& server, std::string address, unsigned short port)
+    : server_(server)
+    , address_(std::move(address))
+    , port_(port)
+    , pool_(std::make_shared<Pool>()) {}
+
+TcpClient::~TcpClient() { Clear(); }
+
+void TcpClient::setMaxIdle(size_t count) {
+  std::vector<shared_session_ptr> expired;
+  {
+    std::lock_guard<std::mutex> lock(pool_->mtx);
+    pool_->maxIdle = count;
+    auto& idle     = pool_->idle;
+    if (idle.size() > count) {
+      // 先淘汰最冷的连接
+      size_t excess = idle.size() - count;
+      for (size_t i = 0; i < excess; ++i) {
+        expired.push_back(std::move(idle[i].session));
+      }
+      idle.erase(idle.begin(), idle.begin() + static_cast<std::ptrdiff_t>(excess));
+    }
+  }
+  shutdownAll(expired);
+}
+
+void TcpClient::setIdleTimeout(std::chrono::milliseconds timeout) {
+  std::lock_guard<std::mutex> lock(pool_->mtx);
+  pool_->idleTimeout = timeout;
+}
+
+bool TcpClient::Connect(onConnectCallback done) {
+  // 连接设置按值捕获，TcpClient先于连接完成析构时也能正常应用
+  auto connected = [onConnected = onConnected_, onMessage = onMessage_, done = std::move(done)](
+                       shared_session_ptr session, int error) {
+    if (session) {
+      if (onMessage) {
+        session->setMessageCallback(onMessage);
+      }
+      if (onConnected) {
+        onConnected(session);
+      }
+    }
+    if (done) {
+      done(std::move(session), error);
+    }
+  };
+  return server_.Connect(address_, port_, std::move(connected));
+}
+
+bool TcpClient::Acquire(onConnectCallback done) {
+  shared_session_ptr session;
+  std::vector<shared_session_ptr> expired;
+  {
+    std::lock_guard<std::mutex> lock(pool_->mtx);
+    pool_->PruneLocked(Clock::now(), expired);
+    if (!pool_->idle.empty()) {
+      session = std::move(pool_->idle.back().session);
+      pool_->idle.pop_back();
+    }
+  }
+  shutdownAll(expired);
+
+  if (!session) {
+    return Connect(std::move(done));
+  }
+  if (done) {
+    done(std::move(session), 0);
+  }
+  return true;
+}
+
+void TcpClient::Release(const shared_session_ptr& session) {
+  if (session) {
+    pool_->Put(session);
+  }
+}
+
+size_t TcpClient::Prewarm(size_t count) {
+  size_t started = 0;
+  std::vector<shared_session_ptr> expired;
+  {
+    std::lock_guard<std::mutex> lock(pool_->mtx);
+    pool_->PruneLocked(Clock::now(), expired);
+    count           = std::min(count, pool_->maxIdle);
+    size_t existing = pool_->idle.size() + pool_->warming;
+    if (existing < count) {
+      started = count - existing;
+      pool_->warming += started;
+    }
+  }
+  shutdownAll(expired);
+
+  std::weak_ptr<Pool> weakPool = pool_;
+  for (size_t i = 0; i < started; ++i) {
+    bool posted = Connect([weakPool](shared_session_ptr session, int) {
+      auto pool = weakPool.lock();
+      if (!pool) {
+        if (session) {
+          session->shutdown(); // TcpClient已析构
+        }
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(pool->mtx);
+        --pool->warming;
+      }
+      if (session) {
+        pool->Put(session);
+      }
+    });
+    if (!posted) {
+      std::lock_guard<std::mutex> lock(pool_->mtx);
+      pool_->warming -= started - i;
+      return i;
+    }
+  }
+  return started;
+}
+
+size_t TcpClient::getIdleCount() {
+  std::vector<shared_session_ptr> expired;
+  size_t count;
+  {
+    std::lock_guard<std::mutex> lock(pool_->mtx);
+    pool_->PruneLocked(Clock::now(), expired);
+    count = pool_->idle.size();
+  }
+  shutdownAll(expired);
+  return count;
+}
+
+void TcpClient::Clear() {
+  std::vector<IdleEntry> idle;
+  {
+    std::lock_guard<std::mutex> lock(pool_->mtx);
+    idle.swap(pool_->idle);
+  }
+  for (auto& entry : idle) {
+    entry.session->shutdown();
+  }
+}
+
+void TcpClient::Pool::Put(const shared_session_ptr& session) {
+  std::vector<shared_session_ptr> expired;
+  bool kept = false;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto now = Clock::now();
+    PruneLocked(now, expired);
+    if (!session->isClosed() && idle.size() < maxIdle) {
+      idle.push_back({session, now});
+      kept = true;
+    }
+  }
+  shutdownAll(expired);
+  if (!kept) {
+    session->shutdown();
+  }
+}
+
+void TcpClient::Pool::PruneLocked(Clock::time_point now, std::vector<shared_session_ptr>& expired) {
+  size_t keep = 0;
+  for (size_t i = 0; i < idle.size(); ++i) {
+    IdleEntry& entry = idle[i];
+    bool timedOut    = idleTimeout.count() > 0 && now - entry.since >= idleTimeout;
+    if (timedOut || entry.session->isClosed()) {
+      expired.push_back(std::move(entry.session));
+      continue;
+    }
+    if (keep != i) {
+      idle[keep] = std::move(entry);
+    }
+    ++keep;
+  }
+  idle.resize(keep);
+}
@@ -0,0 +1,195 @@
+#include "TimerWheel.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace {
+
+constexpr std::uint64_t kNever = std::numeric_limits<std::uint64_t>::max();
+
+} // namespace
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick)
+    : tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(1))
+    , start_(Clock::now())
+    , nextExpire_(kNever) {
+  for (auto& level : slots_) {
+    for (TimerLink& head : level) {
+      head.prev = head.next = &head;
+    }
+  }
+}
+
+TimerWheel::~TimerWheel() {
+  // 释放仍由时间轮持有的定时器
+  std::lock_guard<std::mutex> guard(mtx_);
+  for (auto& level : slots_) {
+    for (TimerLink& head : level) {
+      while (head.next != &head) {
+        Timer* timer = static_cast<Timer*>(head.next);
+        Unlink(timer);
+        timer->self_.reset();
+      }
+    }
+  }
+}
+
+std::uint64_t TimerWheel::NowTick() const {
+  return static_cast<std::uint64_t>((Clock::now() - start_) / tick_);
+}
+
+void TimerWheel::Arm(const TimerPtr& timer, std::chrono::milliseconds delay) {
+  // 向上取整，保证不会早于delay触发
+  std::uint64_t ticks =
+      delay.count() <= 0 ? 0 : static_cast<std::uint64_t>((delay + tick_ - std::chrono::milliseconds(1)) / tick_);
+
+  std::lock_guard<std::mutex> guard(mtx_);
+  if (timer->armed()) {
+    Unlink(timer.get());
+  } else {
+    if (size_.fetch_add(1, std::memory_order_relaxed) == 0) {
+      current_ = std::max(current_, NowTick()); // 空闲期间无须逐tick推进
+    }
+    timer->self_ = timer;
+  }
+  // current_可能落后于当前时间（尚未Advance），以两者中较晚者为起点
+  timer->expire_ = std::max(current_, NowTick()) + ticks;
+  Insert(timer.get());
+
+  if (timer->expire_ < nextExpire_.load(std::memory_order_relaxed)) {
+    nextExpire_.store(timer->expire_, std::memory_order_relaxed);
+  }
+}
+
+void TimerWheel::Cancel(const TimerPtr& timer) {
+  std::shared_ptr<Timer> self; // 在解锁之后释放
+  std::lock_guard<std::mutex> guard(mtx_);
+  if (!timer->armed()) {
+    return;
+  }
+  Unlink(timer.get());
+  self = std::move(timer->self_);
+  size_.fetch_sub(1, std::memory_order_relaxed);
+  // nextExpire_只是下界，不必更新，最多多一次空转
+}
+
+size_t TimerWheel::Advance() {
+  std::uint64_t now = NowTick();
+  if (now < nextExpire_.load(std::memory_order_relaxed)) {
+    return 0;
+  }
+
+  std::vector<std::shared_ptr<Timer>> expired;
+  {
+    std::lock_guard<std::mutex> guard(mtx_);
+    while (current_ <= now) {
+      size_t slot = current_ & kSlotMask;
+      if (slot == 0) {
+        // 第0层开始新的一圈，逐层把上一层当前槽的定时器下放
+        for (size_t level = 1; level < kLevels; ++level) {
+          size_t upper = (current_ >> (level * kSlotBits)) & kSlotMask;
+          Cascade(level, upper);
+          if (upper != 0) {
+            break;
+          }
+        }
+      }
+
+      TimerLink& head = slots_[0][slot];
+      while (head.next != &head) {
+        Timer* timer = static_cast<Timer*>(head.next);
+        Unlink(timer);
+        expired.push_back(std::move(timer->self_));
+      }
+      ++current_;
+    }
+    size_.fetch_sub(expired.size(), std::memory_order_relaxed);
+    UpdateNextExpire();
+  }
+
+  for (auto& timer : expired) {
+    timer->callback_();
+  }
+  return expired.size();
+}
+
+int TimerWheel::NextTimeoutMs(int maxMs) const {
+  std::uint64_t next = nextExpire_.load(std::memory_order_relaxed);
+  if (next == kNever) {
+    return maxMs;
+  }
+  std::uint64_t now = NowTick();
+  if (next <= now) {
+    return 0;
+  }
+  // 按tick边界取整，醒来时保证已经到达next
+  auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+      start_ + tick_ * next - Clock::now());
+  return static_cast<int>(std::min<std::int64_t>(std::max<std::int64_t>(wait.count(), 0) + 1, maxMs));
+}
+
+void TimerWheel::Insert(Timer* timer) {
+  std::uint64_t delta = timer->expire_ > current_ ? timer->expire_ - current_ : 0;
+
+  TimerLink* head;
+  if (delta == 0) {
+    head = &slots_[0][current_ & kSlotMask]; // 已到期，下一次推进时处理
+  } else {
+    size_t level = 0;
+    while (level + 1 < kLevels && delta >= (std::uint64_t(1) << ((level + 1) * kSlotBits))) {
+      ++level;
+    }
+    std::uint64_t expire = timer->expire_;
+    if (delta >= (std::uint64_t(1) << (kLevels * kSlotBits))) {
+      // 超出整个时间轮的范围，先放在最高层最远的槽，下放时再按实际到期时间重新计算
+      expire = current_ + (std::uint64_t(1) << (kLevels * kSlotBits)) - 1;
+    }
+    head = &slots_[level][(expire >> (level * kSlotBits)) & kSlotMask];
+  }
+
+  timer->prev      = head->prev;
+  timer->next      = head;
+  head->prev->next = timer;
+  head->prev       = timer;
+}
+
+void TimerWheel::Unlink(TimerLink* link) {
+  link->prev->next = link->next;
+  link->next->prev = link->prev;
+  link->prev = link->next = nullptr;
+}
+
+void TimerWheel::Cascade(size_t level, size_t slot) {
+  TimerLink& head = slots_[level][slot];
+  TimerLink* link = head.next;
+  head.prev = head.next = &head;
+  while (link != &head) {
+    TimerLink* next = link->next;
+    Insert(static_cast<Timer*>(link));
+    link = next;
+  }
+}
+
+void TimerWheel::UpdateNextExpire() {
+  if (size_.load(std::memory_order_relaxed) == 0) {
+    nextExpire_.store(kNever, std::memory_order_relaxed);
+    return;
+  }
+  // 第0层本圈剩余的槽中第一个非空的即为最早到期；都为空时，
+  // 更高层的定时器最早也要到本圈结束下放后才会到期
+  if ((current_ & kSlotMask) == 0) {
+    nextExpire_.store(current_, std::memory_order_relaxed); // 新一圈的下放尚未进行
+    return;
+  }
+  std::uint64_t boundary = (current_ | kSlotMask) + 1;
+  std::uint64_t next     = boundary;
+  for (std::uint64_t tick = current_; tick < boundary; ++tick) {
+    const TimerLink& head = slots_[0][tick & kSlotMask];
+    if (head.next != &head) {
+      next = tick;
+      break;
+    }
+  }
+  nextExpire_.store(next, std::memory_order_relaxed);
+}
@@ -0,0 +1,484 @@
+#ifdef __linux__
+
+  #include "UringPort.h"
+
+  #include "File.h"
+  #include "log.h"
+
+  #include <algorithm>
+  #include <cstring>
+  #include <fcntl.h>
+  #include <poll.h>
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #include <thread>
+  #include <unistd.h>
+
+namespace {
+
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd,
+                   unsigned toSubmit,
+                   unsigned minComplete,
+                   unsigned flags,
+                   const void* arg = nullptr,
+                   size_t argSize  = 0) {
+  return static_cast<int>(
+      ::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+// 环的头尾指针与内核共享，读写需要带上内存序
+unsigned loadAcquire(const unsigned* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+
+void storeRelease(unsigned* p, unsigned v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+// IoCtx按缓存行对齐，user_data的最低位空闲，用来标记sendFile中文件->管道的一环
+constexpr __u64 kSpliceInTag = 1;
+
+size_t pageSize() {
+  static const size_t size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+// 当前线程作为工作线程从哪个端口取完成事件；它在该端口上投递的请求暂不提交，
+// 留到下一次Dequeue时一起提交，一批完成事件引发的投递只需一次io_uring_enter
+thread_local const UringPort* batchingPort = nullptr;
+
+} // namespace
+
+UringPort::UringPort(unsigned entries)
+    : entries_(entries) {}
+
+UringPort::~UringPort() {
+  if (sqes_) {
+    ::munmap(sqes_, sqesSize_);
+  }
+  if (cqRing_ && cqRing_ != sqRing_) {
+    ::munmap(cqRing_, cqRingSize_);
+  }
+  if (sqRing_) {
+    ::munmap(sqRing_, sqRingSize_);
+  }
+  // 关闭ring会取消所有尚未完成的请求
+  if (ringFd_ >= 0) {
+    ::close(ringFd_);
+  }
+}
+
+bool UringPort::Init() {
+  io_uring_params params{};
+  params.flags      = IORING_SETUP_CQSIZE;
+  params.cq_entries = entries_ * 4; // 每个连接可能同时挂着recv与send
+
+  ringFd_ = io_uring_setup(entries_, &params);
+  if (ringFd_ < 0) {
+    LOG_ERROR("io_uring_setup failed with error: %d", errno);
+    return false;
+  }
+
+  features_   = params.features;
+  sqEntries_  = params.sq_entries;
+  sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+  bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (singleMmap) {
+    sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+  }
+
+  sqRing_ = ::mmap(nullptr,
+                   sqRingSize_,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE,
+                   ringFd_,
+                   IORING_OFF_SQ_RING);
+  if (sqRing_ == MAP_FAILED) {
+    sqRing_ = nullptr;
+    LOG_ERROR("mmap sq ring failed with error: %d", errno);
+    return false;
+  }
+
+  if (singleMmap) {
+    cqRing_ = sqRing_;
+  } else {
+    cqRing_ = ::mmap(nullptr,
+                     cqRingSize_,
+                     PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE,
+                     ringFd_,
+                     IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED) {
+      cqRing_ = nullptr;
+      LOG_ERROR("mmap cq ring failed with error: %d", errno);
+      return false;
+    }
+  }
+
+  sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = ::mmap(nullptr,
+                      sqesSize_,
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE,
+                      ringFd_,
+                      IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    LOG_ERROR("mmap sqes failed with error: %d", errno);
+    return false;
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  char* sq = static_cast<char*>(sqRing_);
+  sqHead_  = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sqTail_  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sqMask_  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+  char* cq = static_cast<char*>(cqRing_);
+  cqHead_  = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cqTail_  = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cqMask_  = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes_    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  return true;
+}
+
+template <typename... Fill>
+bool UringPort::Submit(Fill&&... fill) {
+  std::lock_guard<std::mutex> guard(sqMtx_);
+
+  // SQ中暂缓提交的请求放不下这一组时先提交它们；内核在io_uring_enter返回前已消费SQE。
+  // CQ溢出时SQ可能仍然是满的，此时投递失败，不在持锁时等待工作线程取走完成事件
+  if (*sqTail_ - loadAcquire(sqHead_) + sizeof...(fill) > sqEntries_) {
+    bool busy = false;
+    if (!SubmitPending(busy)) {
+      return false;
+    }
+    if (*sqTail_ - loadAcquire(sqHead_) + sizeof...(fill) > sqEntries_) {
+      LOG_ERROR("io_uring submission queue is full");
+      return false;
+    }
+  }
+
+  unsigned tail = *sqTail_;
+  auto push     = [&](auto&& fillOne) {
+    unsigned index    = tail & *sqMask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    fillOne(sqe);
+    sqArray_[index] = index;
+    ++tail;
+  };
+  (push(fill), ...);
+  storeRelease(sqTail_, tail);
+
+  // 工作线程处理完成事件期间的投递留到它下一次Dequeue时提交，其他线程立即提交
+  if (batchingPort == this) {
+    return true;
+  }
+  // 暂时无法提交的请求已在SQ中，由工作线程下一次Dequeue时提交
+  bool busy = false;
+  return SubmitPending(busy);
+}
+
+bool UringPort::SubmitPending(bool& busy) {
+  for (;;) {
+    unsigned pending = *sqTail_ - loadAcquire(sqHead_);
+    if (pending == 0) {
+      return true;
+    }
+    int ret = io_uring_enter(ringFd_, pending, 0, 0);
+    if (ret >= 0 || errno == EINTR) {
+      continue;
+    }
+    if (errno == EAGAIN || errno == EBUSY) {
+      busy = true;
+      return true;
+    }
+    LOG_ERROR("io_uring_enter failed with error: %d", errno);
+    return false;
+  }
+}
+
+bool UringPort::Listen(SOCKET /* listenSock */) { return true; }
+
+bool UringPort::Associate(SOCKET /* sock */, ULONG_PTR /* key */) {
+  return true; // io_uring按请求提交，无需预先关联
+}
+
+bool UringPort::PostAccept(SOCKET listenSock, IoCtx* ctx) {
+  ctx->sock = INVALID_SOCKET;
+  ctx->op   = OpType::ACCEPT;
+  return Submit([&](io_uring_sqe* sqe) {
+    sqe->opcode       = IORING_OP_ACCEPT;
+    sqe->fd           = listenSock;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data    = reinterpret_cast<__u64>(ctx);
+  });
+}
+
+void UringPort::GetAcceptAddrs(IoCtx* ctx, sockaddr_in* localAddr, sockaddr_in* remoteAddr) {
+  socklen_t localLen = sizeof(sockaddr_in), remoteLen = sizeof(sockaddr_in);
+  std::memset(localAddr, 0, sizeof(sockaddr_in));
+  std::memset(remoteAddr, 0, sizeof(sockaddr_in));
+  ::getsockname(ctx->sock, reinterpret_cast<sockaddr*>(localAddr), &localLen);
+  ::getpeername(ctx->sock, reinterpret_cast<sockaddr*>(remoteAddr), &remoteLen);
+}
+
+bool UringPort::PostConnect(IoCtx* ctx) {
+  ctx->op = OpType::CONNECT;
+  bool ok = Submit([&](io_uring_sqe* sqe) {
+    sqe->opcode    = IORING_OP_CONNECT;
+    sqe->fd        = ctx->sock;
+    sqe->addr      = reinterpret_cast<__u64>(&ctx->peerAddr);
+    sqe->off       = sizeof(ctx->peerAddr);
+    sqe->user_data = reinterpret_cast<__u64>(ctx);
+  });
+  if (!ok) {
+    LOG_ERROR("failed to post connect on socket %" PRIsock, ctx->sock);
+  }
+  return ok;
+}
+
+bool UringPort::PostRecv(IoCtx* ctx) {
+  ctx->op = OpType::RECV;
+  bool ok = Submit([&](io_uring_sqe* sqe) {
+    sqe->fd        = ctx->sock;
+    sqe->user_data = reinterpret_cast<__u64>(ctx);
+    if (ctx->recvBufCount == 1) {
+      sqe->opcode = IORING_OP_RECV;
+      sqe->addr   = reinterpret_cast<__u64>(ctx->recvBufs[0].buf);
+      sqe->len    = static_cast<__u32>(ctx->recvBufs[0].len);
+    } else {
+      ctx->msg            = msghdr{};
+      ctx->msg.msg_iov    = reinterpret_cast<iovec*>(ctx->recvBufs);
+      ctx->msg.msg_iovlen = ctx->recvBufCount;
+      sqe->opcode         = IORING_OP_RECVMSG;
+      sqe->addr           = reinterpret_cast<__u64>(&ctx->msg);
+      sqe->len            = 1;
+    }
+  });
+  if (!ok) {
+    LOG_ERROR("failed to post recv on socket %" PRIsock, ctx->sock);
+  }
+  return ok;
+}
+
+bool UringPort::PostRecvReady(IoCtx* ctx) {
+  ctx->op = OpType::RECV_READY;
+  bool ok = Submit([&](io_uring_sqe* sqe) {
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = ctx->sock;
+    sqe->poll32_events = POLLIN | POLLRDHUP;
+    sqe->user_data     = reinterpret_cast<__u64>(ctx);
+  });
+  if (!ok) {
+    LOG_ERROR("failed to post poll on socket %" PRIsock, ctx->sock);
+  }
+  return ok;
+}
+
+bool UringPort::PostSend(IoCtx* ctx) {
+  ctx->op             = OpType::SEND;
+  ctx->msg            = msghdr{};
+  ctx->msg.msg_iov    = reinterpret_cast<iovec*>(ctx->sendBufs);
+  ctx->msg.msg_iovlen = ctx->sendBufCount;
+  return Submit([&](io_uring_sqe* sqe) {
+    sqe->opcode    = IORING_OP_SENDMSG;
+    sqe->fd        = ctx->sock;
+    sqe->addr      = reinterpret_cast<__u64>(&ctx->msg);
+    sqe->len       = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = reinterpret_cast<__u64>(ctx);
+  });
+}
+
+size_t UringPort::PreparePipe(IoCtx* ctx) {
+  if (ctx->pipeFds[0] < 0) {
+    if (::pipe2(ctx->pipeFds, O_CLOEXEC) != 0) {
+      LOG_ERROR("pipe2 failed with error: %d", errno);
+      return 0;
+    }
+    // 尽量把管道扩大到一个分块的大小，超出系统上限时保持原容量
+    ::fcntl(ctx->pipeFds[1], F_SETPIPE_SZ, SENDFILE_CHUNK_SIZE);
+  }
+  int size = ::fcntl(ctx->pipeFds[1], F_GETPIPE_SZ);
+  return size > 0 ? static_cast<size_t>(size) : 0;
+}
+
+bool UringPort::PostSendFile(IoCtx* ctx) {
+  // io_uring没有sendfile操作，用两次splice实现：文件->管道->套接字，数据不经过用户态。
+  // 两次splice不链接，文件->管道完成后才按实际读到的字节数投递管道->套接字，见Reap
+  ctx->op = OpType::SEND;
+  if (ctx->pipeBytes > 0) {
+    return PostSpliceOut(ctx); // 上次读入管道的数据还没有发完
+  }
+
+  size_t pipeSize = PreparePipe(ctx);
+  if (pipeSize == 0) {
+    return false;
+  }
+
+  // 文件数据按页放入管道，每页占一个槽位：起点不在页边界时，同样容量的管道少装一页内偏移的数据
+  size_t pageOffset = static_cast<size_t>(ctx->fileOffset % pageSize());
+  size_t len        = static_cast<size_t>(std::min<std::uint64_t>(
+      ctx->fileRemaining, std::min<size_t>(pipeSize - pageOffset, SENDFILE_CHUNK_SIZE)));
+  return Submit([&](io_uring_sqe* sqe) {
+    sqe->opcode        = IORING_OP_SPLICE;
+    sqe->splice_fd_in  = ctx->sendFile->handle();
+    sqe->splice_off_in = ctx->fileOffset;
+    sqe->fd            = ctx->pipeFds[1];
+    sqe->off           = static_cast<__u64>(-1);
+    sqe->len           = static_cast<__u32>(len);
+    sqe->splice_flags  = SPLICE_F_MOVE;
+    sqe->user_data     = reinterpret_cast<__u64>(ctx) | kSpliceInTag;
+  });
+}
+
+bool UringPort::PostSpliceOut(IoCtx* ctx) {
+  return Submit([&](io_uring_sqe* sqe) {
+    sqe->opcode        = IORING_OP_SPLICE;
+    sqe->splice_fd_in  = ctx->pipeFds[0];
+    sqe->splice_off_in = static_cast<__u64>(-1);
+    sqe->fd            = ctx->sock;
+    sqe->off           = static_cast<__u64>(-1);
+    sqe->len           = static_cast<__u32>(ctx->pipeBytes);
+    sqe->splice_flags  = SPLICE_F_MOVE;
+    sqe->user_data     = reinterpret_cast<__u64>(ctx);
+  });
+}
+
+void UringPort::Shutdown(SOCKET sock) {
+  // io_uring持有文件引用，仅close不会结束挂起的recv；shutdown后recv以0字节完成，send以错误完成
+  ::shutdown(sock, SHUT_RDWR);
+}
+
+void UringPort::Close(SOCKET sock) { ::close(sock); }
+
+bool UringPort::Reap(const io_uring_cqe& cqe, Completion& out) {
+  if (cqe.user_data & kSpliceInTag) {
+    // sendFile中文件->管道的一环：读到数据后接着把管道中的这些字节发往套接字，由那一环上报结果；
+    // 读到的比请求的少时只发读到的部分，下次从新的偏移继续读
+    IoCtx* ctx = reinterpret_cast<IoCtx*>(cqe.user_data & ~kSpliceInTag);
+    if (cqe.res > 0) {
+      ctx->pipeBytes = static_cast<size_t>(cqe.res);
+      if (PostSpliceOut(ctx)) {
+        return false;
+      }
+    }
+    out     = Completion{};
+    out.ctx = ctx;
+    if (cqe.res < 0) {
+      out.error = static_cast<DWORD>(-cqe.res);
+    } else if (cqe.res == 0) {
+      out.error = ENODATA; // 还没读到文件段的末尾就遇到了EOF，文件在发送过程中被截断
+    } else {
+      out.error = EBUSY; // 管道->套接字一环投递失败
+    }
+    return true;
+  }
+
+  out     = Completion{};
+  out.ctx = reinterpret_cast<IoCtx*>(cqe.user_data);
+  if (out.ctx == nullptr) {
+    return true; // Wakeup投递的NOP
+  }
+  if (out.ctx->sendFile != nullptr && out.ctx->op == OpType::SEND && cqe.res > 0) {
+    // 没有发完的数据留在管道中，下次投递时先发送它们
+    out.ctx->pipeBytes -= static_cast<size_t>(cqe.res);
+  }
+  if (cqe.res < 0) {
+    out.error = static_cast<DWORD>(-cqe.res);
+  } else if (out.ctx->op == OpType::ACCEPT) {
+    out.ctx->sock = cqe.res; // 新连接的套接字
+  } else if (out.ctx->op == OpType::RECV_READY) {
+    // POLL_ADD返回就绪事件掩码，零字节读统一以0字节完成
+  } else {
+    out.bytesTransferred = static_cast<DWORD>(cqe.res);
+  }
+  return true;
+}
+
+bool UringPort::Dequeue(
+    size_t /* worker */, Completion* out, size_t maxCount, size_t& count, int timeoutMs) {
+  count        = 0;
+  batchingPort = this;
+
+  for (;;) {
+    // 提交上一批完成事件处理期间暂缓的请求；CQ溢出时先取走完成事件，下一轮再提交
+    bool busy = false;
+    {
+      std::lock_guard<std::mutex> guard(sqMtx_);
+      if (!SubmitPending(busy)) {
+        return false;
+      }
+    }
+
+    bool reaped;
+    {
+      // 一次取出CQ中已有的至多maxCount个事件
+      std::lock_guard<std::mutex> guard(cqMtx_);
+      unsigned head = *cqHead_;
+      unsigned tail = loadAcquire(cqTail_);
+      reaped        = head != tail;
+      for (; head != tail && count < maxCount; ++head) {
+        if (Reap(cqes_[head & *cqMask_], out[count])) {
+          ++count;
+        }
+      }
+      storeRelease(cqHead_, head);
+      if (count > 0) {
+        return true;
+      }
+    }
+
+    if (reaped) {
+      // 取走的都是不上报的事件（文件->管道一环），Reap为它们投递的请求先提交再等待
+      continue;
+    }
+
+    if (busy) {
+      // 溢出的完成事件由其他工作线程取走，或内核暂时无法分配，让出CPU后重新提交
+      std::this_thread::yield();
+      continue;
+    }
+
+    // 没有可取的事件，在内核中等待至少一个完成
+    int ret;
+    if (timeoutMs < 0) {
+      ret = io_uring_enter(ringFd_, 0, 1, IORING_ENTER_GETEVENTS);
+    } else if (features_ & IORING_FEAT_EXT_ARG) {
+      __kernel_timespec ts{timeoutMs / 1000, (timeoutMs % 1000) * 1000000LL};
+      io_uring_getevents_arg arg{};
+      arg.ts = reinterpret_cast<__u64>(&ts);
+      ret    = io_uring_enter(
+          ringFd_, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+      if (ret < 0 && errno == ETIME) {
+        return true;
+      }
+    } else {
+      // 旧内核不支持带超时的等待，改为在ring的fd上poll：CQ非空时可读；
+      // 唤醒后事件可能已被其他工作线程取走，回到循环开头重新收割，每轮都最多等待timeoutMs
+      pollfd pfd{ringFd_, POLLIN, 0};
+      ret = ::poll(&pfd, 1, timeoutMs);
+      if (ret == 0) {
+        return true;
+      }
+    }
+    if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      LOG_ERROR("io_uring_enter failed with error: %d", errno);
+      return false;
+    }
+  }
+}
+
+void UringPort::Wakeup() {
+  Submit([](io_uring_sqe* sqe) {
+    sqe->opcode    = IORING_OP_NOP;
+    sqe->user_data = 0;
+  });
+}
+
+#endif
@@ -3,13 +3,35 @@
 #include "IOCPServer.h"
 #include "log.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 
-WorkerThread::WorkerThread(IOCPServer& srv, HANDLE completionPort)
-    : srv_(srv)
-    , completionPort_(completionPort)
-    , running_(false) {}
+namespace {
+
+// 其他线程设定的定时器不会唤醒本线程，等待完成事件最多这么久，也是这类定时器的最大延迟
+constexpr int kMaxTimerWaitMs = 100;
+
+// 当前线程对应的WorkerThread
+thread_local const WorkerThread* tlsCurrentWorker = nullptr;
+
+} // namespace
+
+WorkerThread::WorkerThread(IOCPServer& srv,
+                           CompletionPort& completionPort,
+                           size_t index,
+                           size_t shard,
+                           size_t batchSize,
+                           WorkerMetrics& metrics)
+    : completionPort_(completionPort)
+    , index_(index)
+    , shard_(shard)
+    , threadId_(0)
+    , running_(false)
+    , batch_(std::max<size_t>(batchSize, 1))
+    , timers_(std::make_shared<TimerWheel>())
+    , metrics_(metrics)
+    , srv_(srv) {}
 
 WorkerThread::~WorkerThread() {
   this->Stop();
@@ -28,59 +50,133 @@ void WorkerThread::Start() {
 
 void WorkerThread::Stop() { running_.store(false, std::memory_order_release); }
 
+bool WorkerThread::IsInLoopThread() const { return tlsCurrentWorker == this; }
+
+WorkerMetrics* WorkerThread::CurrentMetrics() {
+  return tlsCurrentWorker != nullptr ? &tlsCurrentWorker->metrics_ : nullptr;
+}
+
+void WorkerThread::RunInLoop(Mailbox::Task fn) {
+  if (IsInLoopThread()) {
+    fn();
+    return;
+  }
+  mailbox_.Push(std::move(fn));
+  if (!wakePending_.exchange(true, std::memory_order_acq_rel)) {
+    completionPort_.Wakeup();
+  }
+}
+
+void WorkerThread::RunPending() {
+  // 先清除标志再取任务：此后追加的任务要么在这一轮被取走，要么会再次唤醒本线程
+  if (!wakePending_.exchange(false, std::memory_order_acq_rel)) {
+    return;
+  }
+  Mailbox::Task task;
+  while (mailbox_.Pop(task)) {
+    task();
+  }
+}
+
 void WorkerThread::ThreadProc() {
+  tlsCurrentWorker = this;
   while (running_.load(std::memory_order_acquire)) {
-    DWORD bytesTransferred  = 0;
-    ULONG_PTR completionKey = 0;
-    LPOVERLAPPED overlapped = nullptr;
+    size_t count = 0;
 
-    // 等待完成端口事件
-    BOOL result = GetQueuedCompletionStatus(completionPort_,
-                                            &bytesTransferred,
-                                            &completionKey,
-                                            &overlapped,
-                                            INFINITE);
+    // 一次取出一批完成事件，最迟在最早的定时器到期时返回；
+    // 上一批处理中投递的I/O在io_uring后端上到这里才一起提交
+    if (!completionPort_.Dequeue(
+            index_, batch_.data(), batch_.size(), count, timers_->NextTimeoutMs(kMaxTimerWaitMs))) {
+      break;
+    }
 
     if (!running_.load(std::memory_order_acquire)) {
       break;
     }
 
-    // 处理完成事件
-    HandleCompletion(bytesTransferred, completionKey, overlapped, result);
+    // 处理完成事件，同一批事件共用取出时的时间戳
+    Timestamp dequeuedAt = count > 0 ? std::chrono::steady_clock::now() : Timestamp{};
+    for (size_t i = 0; i < count; ++i) {
+      HandleCompletion(batch_[i], dequeuedAt);
+      batch_[i] = Completion{};
+    }
+
+    // 执行其他线程转交的任务
+    RunPending();
+
+    // 执行到期的定时器
+    timers_->Advance();
+
+    // 整批处理完之后的钩子
+    if (count > 0) {
+      bumpCounter(metrics_.batches);
+      metrics_.batchSize.Record(count);
+      srv_.HandleBatch(count);
+    }
   }
 }
 
-void WorkerThread::HandleCompletion(DWORD bytesTransferred,
-                                    ULONG_PTR completionKey,
-                                    LPOVERLAPPED overlapped,
-                                    BOOL result) {
+void WorkerThread::HandleCompletion(const Completion& completion, Timestamp dequeuedAt) {
   // 获取重叠上下文
-  IoCtx* ctx = CONTAINING_RECORD(overlapped, IoCtx, overlapped);
+  IoCtx* ctx             = completion.ctx;
+  DWORD bytesTransferred = completion.bytesTransferred;
+  if (ctx == nullptr) {
+    return; // 唤醒事件
+  }
 
-  if (!result) {
-    DWORD dwError = GetLastError();
+  // 取回投递时存放在IoCtx中的session引用，处理期间由它保证session存活
+  std::shared_ptr<Session> session = std::move(ctx->session);
 
-    switch (dwError) {
-    case WAIT_TIMEOUT:
+  if (completion.error != 0) {
+    DWORD dwError = completion.error;
+    metrics_.RecordError(dwError);
+
+    if (ctx->op == OpType::CONNECT) {
+      srv_.HandleConnect(ctx, dwError); // 失败原因交给发起连接的一方
       return;
+    }
 
+    switch (dwError) {
+#ifdef _WIN32
     case ERROR_NETNAME_DELETED:
-      srv_.RemoveSession(ctx->sock);
-      return;
+    case ERROR_OPERATION_ABORTED: // session已关闭，挂起的I/O被取消
+    case WSAECONNRESET:           // 批量取出时错误码由WSAGetOverlappedResult给出
+    case WSAECONNABORTED:
+#else
+    case ECONNRESET:
+    case EPIPE:
+    case ECANCELED:
+#endif
+      break;
 
     default:
       // 其他未知错误
       // 记录日志并决定是否继续
-      LOG("GetQueuedCompletionStatus failed: %d, close the socket %d", dwError, ctx->sock);
-      srv_.RemoveSession(ctx->sock);
-      return;
+      LOG_WARN("GetQueuedCompletionStatus failed: %d, close the socket %" PRIsock,
+               static_cast<int>(dwError),
+               ctx->sock);
+      break;
     }
+
+    if (session) {
+      session->getSockCtx()->removeIoCtx(ctx);
+      srv_.RemoveSession(session);
+    } else if (ctx->op == OpType::ACCEPT) {
+      srv_.HandleAcceptError(ctx, shard_);
+    }
+    return;
   }
 
   // 接收到客户端发送的FIN包
   if ((bytesTransferred == 0) && (ctx->op == OpType::RECV || ctx->op == OpType::SEND)) {
-    LOG("socket %d 断开连接", ctx->sock);
-    srv_.RemoveSession(ctx->sock);
+    bumpCounter(metrics_.eofs);
+    if (session) {
+      if (!session->isClosed()) {
+        LOG_INFO("socket %" PRIsock " 断开连接", ctx->sock);
+      }
+      session->getSockCtx()->removeIoCtx(ctx);
+      srv_.RemoveSession(session);
+    }
     return;
   }
 
@@ -88,21 +184,40 @@ void WorkerThread::HandleCompletion(DWORD bytesTransferred,
   switch (ctx->op) {
   case OpType::ACCEPT: {
     // 处理Accept完成
-    srv_.HandleAccept(ctx);
+    bumpCounter(metrics_.accepts);
+    srv_.HandleAccept(ctx, shard_);
+    break;
+  }
+  case OpType::CONNECT: {
+    bumpCounter(metrics_.connects);
+    srv_.HandleConnect(ctx, 0);
     break;
   }
   case OpType::RECV: {
-    std::shared_ptr<Session> session = srv_.getSession(ctx->sock);
-    srv_.HandleRecv(session, ctx, static_cast<size_t>(bytesTransferred));
+    bumpCounter(metrics_.recvs);
+    bumpCounter(metrics_.bytesIn, bytesTransferred);
+    srv_.HandleRecv(std::move(session), ctx, static_cast<size_t>(bytesTransferred), dequeuedAt);
+    break;
+  }
+  case OpType::RECV_READY: {
+    bumpCounter(metrics_.recvReadies);
+    srv_.HandleRecvReady(std::move(session), ctx);
     break;
   }
   case OpType::SEND: {
-    std::shared_ptr<Session> session = srv_.getSession(ctx->sock);
-    srv_.HandleSend(session, ctx, static_cast<size_t>(bytesTransferred));
+    bumpCounter(metrics_.sends);
+    bumpCounter(metrics_.bytesOut, bytesTransferred);
+    if (session) {
+      // 待发送字节数此时仍包含刚完成的内存数据；文件段不计入待发送字节数
+      size_t pending = session->getPendingSendBytes();
+      size_t sent    = ctx->sendFile != nullptr ? 0 : static_cast<size_t>(bytesTransferred);
+      metrics_.sendQueueBytes.Record(pending > sent ? pending - sent : 0);
+    }
+    srv_.HandleSend(std::move(session), ctx, static_cast<size_t>(bytesTransferred), dequeuedAt);
     break;
   }
   default:
-    LOG("uninitialized operation flag!");
+    LOG_ERROR("uninitialized operation flag!");
     break;
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,317 @@
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+constexpr auto kFlushInterval = std::chrono::milliseconds(50); // 写线程空闲时的最长等待
+
+const char* levelName(LogLevel level) {
+  switch (level) {
+  case LogLevel::Trace:
+    return "TRACE";
+  case LogLevel::Debug:
+    return "DEBUG";
+  case LogLevel::Info:
+    return "INFO";
+  case LogLevel::Warn:
+    return "WARN";
+  case LogLevel::Error:
+    return "ERROR";
+  }
+  return "?";
+}
+
+} // namespace
+
+SimpleLogger::SimpleLogger() {
+  logFile_ = std::fopen("appLog.log", "a");
+  if (logFile_ == nullptr) {
+    std::cerr << "无法打开日志文件 appLog.log" << std::endl;
+  }
+  writeBuf_.reserve(kRingSize * 64);
+  writer_ = std::thread(&SimpleLogger::writerLoop, this);
+}
+
+SimpleLogger::~SimpleLogger() {
+  {
+    std::lock_guard<std::mutex> guard(wakeMtx_);
+    running_ = false;
+  }
+  wakeCv_.notify_one();
+  writer_.join();
+
+  if (logFile_ != nullptr) {
+    std::fclose(logFile_);
+  }
+}
+
+SimpleLogger::Ring& SimpleLogger::localRing() {
+  // 线程退出时只标记，环由写线程取空后释放
+  struct Holder {
+    std::shared_ptr<Ring> ring;
+    ~Holder() {
+      if (ring) {
+        ring->retired.store(true, std::memory_order_release);
+      }
+    }
+  };
+  thread_local Holder holder;
+
+  if (!holder.ring) {
+    holder.ring = std::make_shared<Ring>();
+    std::lock_guard<std::mutex> guard(ringsMtx_);
+    rings_.push_back(holder.ring);
+  }
+  return *holder.ring;
+}
+
+void SimpleLogger::log(LogLevel level, const char* format, ...) {
+  Record* record = beginRecord(level);
+  if (record == nullptr) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  int n = std::vsnprintf(record->text, sizeof(record->text), format, args);
+  va_end(args);
+  commitRecord(record, n);
+}
+
+SimpleLogger::Record* SimpleLogger::beginRecord(LogLevel level) {
+  Ring& ring  = localRing();
+  size_t tail = ring.tail.load(std::memory_order_relaxed);
+
+  while (tail - ring.head.load(std::memory_order_acquire) >= kRingSize) {
+    if (policy_.load(std::memory_order_relaxed) == OverflowPolicy::Drop) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    wakeCv_.notify_one();
+    std::this_thread::yield();
+  }
+
+  Record* record = &ring.records[tail & (kRingSize - 1)];
+  record->level  = level;
+  return record;
+}
+
+void SimpleLogger::commitRecord(Record* record, int n) {
+  if (n < 0) {
+    std::strcpy(record->text, "格式化失败");
+    n = static_cast<int>(std::strlen(record->text));
+  }
+  record->len  = static_cast<std::uint32_t>(std::min<size_t>(n, sizeof(record->text) - 1));
+  record->time = std::time(nullptr);
+
+  Ring& ring  = localRing();
+  size_t tail = ring.tail.load(std::memory_order_relaxed) + 1;
+  ring.tail.store(tail, std::memory_order_release);
+
+  // 缓冲过半时提前唤醒写线程，否则等它按周期收集
+  if (tail - ring.head.load(std::memory_order_relaxed) == kRingSize / 2) {
+    wakeCv_.notify_one();
+  }
+}
+
+void SimpleLogger::flush() {
+  std::unique_lock<std::mutex> lock(wakeMtx_);
+  std::uint64_t ticket = ++flushRequested_;
+  wakeCv_.notify_one();
+  flushCv_.wait(lock, [&] { return flushDone_ >= ticket || !running_; });
+}
+
+void SimpleLogger::writerLoop() {
+  for (;;) {
+    std::uint64_t ticket;
+    bool running;
+    {
+      std::unique_lock<std::mutex> lock(wakeMtx_);
+      wakeCv_.wait_for(lock, kFlushInterval, [&] {
+        return !running_ || flushRequested_ != flushDone_;
+      });
+      ticket  = flushRequested_;
+      running = running_;
+    }
+
+    drain();
+
+    {
+      std::lock_guard<std::mutex> guard(wakeMtx_);
+      flushDone_ = ticket;
+    }
+    flushCv_.notify_all();
+
+    if (!running) {
+      drain(); // 退出前取空剩余的日志
+      return;
+    }
+  }
+}
+
+size_t SimpleLogger::drain() {
+  std::vector<std::shared_ptr<Ring>> rings;
+  {
+    std::lock_guard<std::mutex> guard(ringsMtx_);
+    rings = rings_;
+  }
+
+  size_t count = 0;
+  for (const auto& ring : rings) {
+    bool retired = ring->retired.load(std::memory_order_acquire);
+    size_t head  = ring->head.load(std::memory_order_relaxed);
+    size_t tail  = ring->tail.load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+      const Record& record = ring->records[head & (kRingSize - 1)];
+      writeBuf_.push_back('[');
+      writeBuf_.append(timestamp(record.time));
+      writeBuf_.append("][");
+      writeBuf_.append(levelName(record.level));
+      writeBuf_.push_back(']');
+      writeBuf_.append(record.text, record.len);
+      writeBuf_.push_back('\n');
+      ++count;
+    }
+    ring->head.store(head, std::memory_order_release);
+
+    if (retired && ring->tail.load(std::memory_order_acquire) == head) {
+      std::lock_guard<std::mutex> guard(ringsMtx_);
+      rings_.erase(std::find(rings_.begin(), rings_.end(), ring));
+    }
+  }
+
+  reportSuppressed();
+
+  std::uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+  if (dropped != droppedReported_) {
+    char line[256]; // 时间戳、级别、提示文字与20位计数的最坏情况也能容纳
+    std::snprintf(line,
+                  sizeof(line),
+                  "[%s][WARN]日志缓冲区已满，丢弃了%llu条日志\n",
+                  timestamp(std::time(nullptr)),
+                  static_cast<unsigned long long>(dropped - droppedReported_));
+    writeBuf_.append(line);
+    droppedReported_ = dropped;
+  }
+
+  if (!writeBuf_.empty() && logFile_ != nullptr) {
+    std::fwrite(writeBuf_.data(), 1, writeBuf_.size(), logFile_);
+    std::fflush(logFile_);
+  }
+  writeBuf_.clear();
+  return count;
+}
+
+void SimpleLogger::reportSuppressed() {
+  std::time_t now = std::time(nullptr);
+  if (now == limitersReported_) {
+    return;
+  }
+  limitersReported_ = now;
+
+  std::lock_guard<std::mutex> guard(limitersMtx_);
+  for (LogRateLimiter* limiter : limiters_) {
+    std::uint32_t suppressed = limiter->suppressed_.exchange(0, std::memory_order_relaxed);
+    if (suppressed != 0) {
+      char line[256];
+      std::snprintf(line,
+                    sizeof(line),
+                    "[%s][WARN]%s:%d 有%u条日志因限流被丢弃\n",
+                    timestamp(now),
+                    limiter->file_,
+                    limiter->line_,
+                    suppressed);
+      writeBuf_.append(line);
+    }
+  }
+}
+
+const char* SimpleLogger::timestamp(std::time_t time) {
+  if (time != cachedTime_ || cachedStamp_[0] == '\0') {
+    std::tm tmNow{};
+#ifdef _WIN32
+    localtime_s(&tmNow, &time);
+#else
+    localtime_r(&time, &tmNow);
+#endif
+    std::strftime(cachedStamp_, sizeof(cachedStamp_), "%Y-%m-%d %H:%M:%S", &tmNow);
+    cachedTime_ = time;
+  }
+  return cachedStamp_;
+}
+
+std::string SimpleLogger::wstringToUtf8(const std::wstring& wstr) {
+#ifdef _WIN32
+  int size_needed =
+      WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), (int)wstr.size(), nullptr, 0, nullptr, nullptr);
+  std::string strTo(size_needed, 0);
+  WideCharToMultiByte(CP_UTF8,
+                      0,
+                      wstr.c_str(),
+                      (int)wstr.size(),
+                      &strTo[0],
+                      size_needed,
+                      nullptr,
+                      nullptr);
+  return strTo;
+#else
+  // wchar_t 在非Windows平台为 UTF-32
+  std::string strTo;
+  strTo.reserve(wstr.size());
+  for (wchar_t wc : wstr) {
+    auto cp = static_cast<unsigned long>(wc);
+    if (cp < 0x80) {
+      strTo.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+      strTo.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+      strTo.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+      strTo.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+      strTo.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      strTo.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+      strTo.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+      strTo.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+      strTo.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      strTo.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+  }
+  return strTo;
+#endif
+}
+
+LogRateLimiter::LogRateLimiter(const char* file, int line) : file_(file), line_(line) {
+  SimpleLogger& logger = SimpleLogger::getInstance();
+  std::lock_guard<std::mutex> guard(logger.limitersMtx_);
+  logger.limiters_.push_back(this);
+}
+
+LogRateLimiter::~LogRateLimiter() {
+  // 调用点的静态实例总是在日志单例之后构造，因此先于它析构
+  SimpleLogger& logger = SimpleLogger::getInstance();
+  std::lock_guard<std::mutex> guard(logger.limitersMtx_);
+  logger.limiters_.erase(std::find(logger.limiters_.begin(), logger.limiters_.end(), this));
+}
+
+bool LogRateLimiter::allow() {
+  std::uint32_t limit = SimpleLogger::getInstance().rateLimit();
+  if (limit == 0) {
+    return true;
+  }
+
+  std::time_t now    = std::time(nullptr);
+  std::time_t window = window_.load(std::memory_order_relaxed);
+  if (now != window && window_.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+    // 只有切换窗口成功的线程负责清零，并发时计数有少量偏差无妨
+    count_.store(0, std::memory_order_relaxed);
+  }
+
+  if (count_.fetch_add(1, std::memory_order_relaxed) < limit) {
+    return true;
+  }
+  suppressed_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
@@ -8,13 +8,16 @@ void onConnected(shared_session_ptr session) {
               session->getRemoteAddr().c_str());
 }
 
-void onMessage(shared_session_ptr session, Buffer* buffer) {
-  std::string msg(buffer->peek(), buffer->readableBytes());
+void onMessage(shared_session_ptr session, Buffer* buffer, Timestamp /* receiveTime */) {
+  std::vector<char> msg(buffer->peek(), buffer->peek() + buffer->readableBytes());
   buffer->retrieve(buffer->readableBytes());
-  std::printf("recv clien[%s] msg: %s\n", session->getRemoteAddr().c_str(), msg.c_str());
+  std::printf("recv clien[%s] msg: %.*s\n",
+              session->getRemoteAddr().c_str(),
+              static_cast<int>(msg.size()),
+              msg.data());
 
-  // do echo
-  session->send(msg.data(), msg.size());
+  // do echo, msg的内存直接交给发送队列
+  session->send(std::move(msg));
 }
 
 int main() {
@@ -22,7 +25,14 @@ int main() {
     // 创建IOCP服务器实例
     IOCPServer server("127.0.0.1", 8888);
     server.setConnectedCallback(std::bind(onConnected, std::placeholders::_1));
-    server.setMessageCallback(std::bind(onMessage, std::placeholders::_1, std::placeholders::_2));
+    server.setMessageCallback(std::bind(
+        onMessage, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+
+    // 5分钟没有任何收发的连接视为失联，主动关闭
+    server.setIdleTimeout(std::chrono::minutes(5));
+
+    // 在本机9464端口导出Prometheus格式的指标：curl http://127.0.0.1:9464/metrics
+    server.setMetricsListener("127.0.0.1", 9464);
 
     // 启动服务器
     if (!server.Start()) {
@@ -37,6 +47,13 @@ int main() {
     server.Stop();
     std::cout << "Server stopped" << std::endl;
 
+    auto pool = IoCtxPool::GetStats();
+    std::printf("IoCtx pool: acquired %llu, reused %llu, created %llu, hit rate %.2f%%\n",
+                static_cast<unsigned long long>(pool.acquired),
+                static_cast<unsigned long long>(pool.reused),
+                static_cast<unsigned long long>(pool.created),
+                pool.hitRate() * 100);
+
   } catch (const std::exception& e) {
     std::cerr << "Error: " << e.what() << std::endl;
     return 1;